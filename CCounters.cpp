@@ -1,7 +1,22 @@
 #include "CCounters.h"
+#include "CounterDefinitions.h"
+#include "EventDatabase.h"
+#include "EventSets.h"
+#include "MSRCommands.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <ctype.h>
 #ifdef _MSC_VER
 #include <intrin.h>
 #endif
+#ifndef _WIN32
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/resource.h>
+#endif
 
 #ifdef _MSC_VER
 #define Cpuid __cpuid
@@ -17,21 +32,9 @@ static void Cpuid(int Output[4], int aa)
 }
 #endif
 
+#ifdef _WIN32
 typedef DWORD_PTR ProcMaskType; // Type for processor mask
 
-// record specifying how to count a particular event on a particular CPU family
-struct SCounterDefinition
-{
-    int CounterType;                  // ID identifying what to count
-    EPMCScheme PMCScheme;             // PMC scheme. values may be OR'ed
-    EProcFamily ProcessorFamily;      // processor family. values may be OR'ed
-    int CounterFirst, CounterLast;    // counter number or a range of possible alternative counter numbers
-    int EventSelectReg;               // event select register
-    int Event;                        // event code
-    int EventMask;                    // event mask
-    const char* Description;          // name of counter.
-};
-
 // Get mask of possible CPU cores
 static inline ProcMaskType GetProcessMask()
 {
@@ -40,21 +43,25 @@ static inline ProcMaskType GetProcessMask()
     return ProcessAffMask;
 }
 
-// Set CPU to run on specified CPU core number (0-based)
-static inline void SetProcessMask(int p)
+// Set CPU to run on specified CPU core number (0-based). Returns false if failed
+static inline bool SetProcessMask(int p)
 {
     int r = (int)SetThreadAffinityMask(GetCurrentThread(), (ProcMaskType)1 << p);
     if (r == 0)
     {
         int e = GetLastError();
         printf("\nFailed to lock thread to processor %i. Error = %i\n", p, e);
+        return false;
     }
+    return true;
 }
 
 // Test if specified CPU core is available
 static inline int TestProcessMask(int p, ProcMaskType* m)
 {
-    return ((ProcMaskType)1 << p) & *m;
+    if (p < 0 || p >= (int)sizeof(ProcMaskType) * 8)
+        return 0; // not in mask
+    return ((ProcMaskType)1 << p) & *m ? 1 : 0;
 }
 
 static inline void Sleep0() // Sleep for the rest of current timeslice
@@ -74,601 +81,170 @@ static inline void SetProcessPriorityNormal()
     SetPriorityClass(GetCurrentProcess(), NORMAL_PRIORITY_CLASS);
 }
 
-//////////////////////////////////////////////////////////////////////////////
-//
-//             list of counter definitions
-//
-//////////////////////////////////////////////////////////////////////////////
-// How to add new entries to this list:
-//
-// Warning: Be sure to save backup copies of your files before you make any
-// changes here. A wrong register number can result in a crash in the driver.
-// This results in a blue screen and possibly loss of your most recently
-// modified file.
-//
-// Set CounterType to any vacant id number. Use the same id for similar events
-// in different processor families. The other fields depend on the processor
-// family as follows:
-//
-// Pentium 1 and Pentium MMX:
-//    Set ProcessorFamily = INTEL_P1MMX.
-//    CounterFirst = 0, CounterLast = 1, Event = Event number,
-//    EventMask = Counter control code.
-//
-// Pentium Pro, Pentium II, Pentium III, Pentium M, Core Solo/Duo
-//    Set ProcessorFamily = INTEL_P23M for events that are valid for all these
-//    processors or INTEL_PM or INTEL_CORE for events that only apply to
-//    one processor.
-//    CounterFirst = 0, CounterLast = 1,
-//    Event = Event number, EventMask = Unit mask.
-//
-// Core 2
-//    Set ProcessorFamily = INTEL_CORE2.
-//    Fixed function counters:
-//    CounterFirst = 0x40000000 + MSR Address - 0x309. (Intel manual Oct. 2006 is wrong)
-//    All other counters:
-//    CounterFirst = 0, CounterLast = 1,
-//    Event = Event number, EventMask = Unit mask.
-//
-// Pentium 4 and Pentium 4 with EM64T (Netburst):
-//    Set ProcessorFamily = INTEL_P4.
-//    Look in Software Developer's Manual vol. 3 appendix A, table of
-//    Performance Monitoring Events.
-//    Set CounterFirst and CounterLast to the range of possible counter
-//    registers listed under "Counter numbers per ESCR".
-//    Set EventSelectReg to the value listed for "CCCR Select".
-//    Set Event to the value indicated for "ESCR Event Select".
-//    Set EventMask to a combination of the relevant bits for "ESCR Event Mask".
-//    You don't need the table named "Performance Counter MSRs and Associated
-//    CCCR and ESCR MSRs". This table is already implemented in the function
-//    CCounters::GetP4EventSelectRegAddress.
-//
-// AMD Athlon 64, Opteron
-//    Set ProcessorFamily = AMD_ATHLON64.
-//    CounterFirst = 0, CounterLast = 3, Event = Event mask,
-//    EventMask = Unit mask.
-//
-
-static const SCounterDefinition CounterDefinitions[] = {
-    //  id   scheme cpu    countregs eventreg event  mask   name
-    {100,  S_P4, PRALL,  4,   7,     0,      9,      7,  "Uops"     }, // uops from any source
-    {101,  S_P4, PRALL,  4,   7,     0,      9,      2,  "UopsTC"   }, // uops from trace cache
-    {102,  S_P4, PRALL,  4,   7,     0,      9,      1,  "UopsDec"  }, // uops directly from decoder
-    {103,  S_P4, PRALL,  4,   7,     0,      9,      4,  "UopsMCode"}, // uops from microcode ROM
-    {110,  S_P4, PRALL, 12,  17,     4,      1,      1,  "UopsNB"   }, // uops non-bogus
-    {111,  S_P4, PRALL, 12,  17,     4,      2,   0x0c,  "UopsBogus"}, // uops bogus
-    {150,  S_P4, PRALL,  8,  11,     1,      4, 0x8000,  "UopsFP"   }, // uops floating point, except move etc.
-    {151,  S_P4, PRALL,  8,  11,     1,   0x2e,      8,  "UopsFPMov"}, // uops floating point and SIMD move
-    {152,  S_P4, PRALL,  8,  11,     1,   0x2e,   0x10,  "UopsFPLd" }, // uops floating point and SIMD load
-    {160,  S_P4, PRALL,  8,  11,     1,      2, 0x8000,  "UopsMMX"  }, // uops 64-bit MMX
-    {170,  S_P4, PRALL,  8,  11,     1,   0x1a, 0x8000,  "UopsXMM"  }, // uops 128-bit integer XMM
-    {200,  S_P4, PRALL, 12,  17,     5,      6,   0x0f,  "Branch"   }, // branches
-    {201,  S_P4, PRALL, 12,  17,     5,      6,   0x0c,  "BrTaken"  }, // branches taken
-    {202,  S_P4, PRALL, 12,  17,     5,      6,   0x03,  "BrNTaken" }, // branches not taken
-    {203,  S_P4, PRALL, 12,  17,     5,      6,   0x05,  "BrPredict"}, // branches predicted
-    {204,  S_P4, PRALL, 12,  17,     4,      3,   0x01,  "BrMispred"}, // branches mispredicted
-    {210,  S_P4, PRALL,  4,   7,     2,      5,   0x02,  "CondJMisp"}, // conditional jumps mispredicted
-    {211,  S_P4, PRALL,  4,   7,     2,      5,   0x04,  "CallMisp" }, // indirect call mispredicted
-    {212,  S_P4, PRALL,  4,   7,     2,      5,   0x08,  "RetMisp"  }, // return mispredicted
-    {220,  S_P4, PRALL,  4,   7,     2,      5,   0x10,  "IndirMisp"}, // indirect calls, jumps and returns mispredicted
-    {310,  S_P4, PRALL,  0,   3,     0,      3,   0x01,  "TCMiss"   }, // trace cache miss
-    {320,  S_P4, PRALL,  0,   3,     7,   0x0c,  0x100,  "Cach2Miss"}, // level 2 cache miss
-    {321,  S_P4, PRALL,  0,   3,     7,   0x0c,  0x200,  "Cach3Miss"}, // level 3 cache miss
-    {330,  S_P4, PRALL,  0,   3,     3,   0x18,   0x02,  "ITLBMiss" }, // instructions TLB Miss
-    {340,  S_P4, PRALL,  0,   3,     2,      3,   0x3a,  "LdReplay" }, // memory load replay
-
-
-    //  id   scheme cpu    countregs eventreg event  mask   name
-    {  9,  S_P1, PRALL,  0,   1,     0,   0x16,        2,  "Instruct" }, // instructions executed
-    { 11,  S_P1, PRALL,  0,   1,     0,   0x17,        2,  "InstVpipe"}, // instructions executed in V-pipe
-    {202,  S_P1, PRALL,  0,   1,     0,   0x15,        2,  "Flush"    }, // pipeline flush due to branch misprediction or serializing event
-    {310,  S_P1, PRALL,  0,   1,     0,   0x0e,        2,  "CodeMiss" }, // code cache miss
-    {311,  S_P1, PRALL,  0,   1,     0,   0x29,        2,  "DataMiss" }, // data cache miss
-
-
-    //  id   scheme  cpu     countregs eventreg event  mask   name
-    {  9, S_P2MC, PRALL,    0,   1,     0,   0xc0,     0,  "Instruct" }, // instructions executed
-    { 10, S_P2MC, PRALL,    0,   1,     0,   0xd0,     0,  "IDecode"  }, // instructions decoded
-    { 20, S_P2MC, PRALL,    0,   1,     0,   0x80,     0,  "IFetch"   }, // instruction fetches
-    { 21, S_P2MC, PRALL,    0,   1,     0,   0x86,     0,  "IFetchStl"}, // instruction fetch stall
-    { 22, S_P2MC, PRALL,    0,   1,     0,   0x87,     0,  "ILenStal" }, // instruction length decoder stalls
-    {100, S_P2MC, INTEL_PM, 0,   1,     0,   0xc2,     0,  "Uops(F)"  }, // microoperations in fused domain
-    {100, S_P2MC, PRALL,    0,   1,     0,   0xc2,     0,  "Uops"     }, // microoperations
-    {110, S_P2MC, INTEL_PM, 0,   1,     0,   0xa0,     0,  "Uops(UF)" }, // unfused microoperations submitted to execution units (Undocumented counter!)
-    {104, S_P2MC, INTEL_PM, 0,   1,     0,   0xda,     0,  "UopsFused"}, // fused uops
-    {115, S_P2MC, INTEL_PM, 0,   1,     0,   0xd3,     0,  "SynchUops"}, // stack synchronization uops
-    {121, S_P2MC, PRALL,    0,   1,     0,   0xd2,     0,  "PartRStl" }, // partial register access stall
-    {130, S_P2MC, PRALL,    0,   1,     0,   0xa2,     0,  "Rs Stall" }, // all resource stalls
-    {201, S_P2MC, PRALL,    0,   1,     0,   0xc9,     0,  "BrTaken"  }, // branches taken
-    {204, S_P2MC, PRALL,    0,   1,     0,   0xc5,     0,  "BrMispred"}, // mispredicted branches
-    {205, S_P2MC, PRALL,    0,   1,     0,   0xe6,     0,  "BTBMiss"  }, // static branch prediction made
-    {310, S_P2MC, PRALL,    0,   1,     0,   0x28,  0x0f,  "CodeMiss" }, // level 2 cache code fetch
-    {311, S_P2MC, INTEL_P23,0,   1,     0,   0x29,  0x0f,  "L1D Miss" }, // level 2 cache data fetch
-
-    // Core 2:
-    // The first three counters are fixed-function counters having their own register,
-    // The rest of the counters are competing for the same two counter registers.
-    //  id   scheme cpu      countregs eventreg event  mask   name
-    {1,   S_ID2, PRALL,   0x40000001,  0,0,   0,      0,   "Core cyc"  }, // core clock cycles
-    {2,   S_ID2, PRALL,   0x40000002,  0,0,   0,      0,   "Ref cyc"   }, // Reference clock cycles
-    {9,   S_ID2, PRALL,   0x40000000,  0,0,   0,      0,   "Instruct"  }, // Instructions (reference counter)
-    {10,  S_ID2, PRALL,   0,   1,     0,   0xc0,     0x0f, "Instruct"  }, // Instructions
-    {11,  S_ID2, PRALL,   0,   1,     0,   0xc0,     0x01, "Read inst" }, // Instructions involving read, fused count as one
-    {12,  S_ID2, PRALL,   0,   1,     0,   0xc0,     0x02, "Write ins" }, // Instructions involving write, fused count as one
-    {13,  S_ID2, PRALL,   0,   1,     0,   0xc0,     0x04, "NonMem in" }, // Instructions without memory
-    {20,  S_ID2, PRALL,   0,   1,     0,   0x80,      0,   "Insfetch"  }, // instruction fetches. < instructions ?
-    {21,  S_ID2, PRALL,   0,   1,     0,   0x86,      0,   "IFetchStl" }, // instruction fetch stall
-    {22,  S_ID2, PRALL,   0,   1,     0,   0x87,      0,   "ILenStal"  }, // instruction length decoder stalls (length changing prefix)
-    {23,  S_ID2, PRALL,   0,   1,     0,   0x83,      0,   "IQue ful"  }, // instruction queue full
-    {100, S_ID2, PRALL,   0,   1,     0,   0xc2,     0x0f, "Uops"      }, // uops retired, fused domain
-    {101, S_ID2, PRALL,   0,   1,     0,   0xc2,     0x01, "Fused Rd"  }, // fused read uops
-    {102, S_ID2, PRALL,   0,   1,     0,   0xc2,     0x02, "Fused Wrt" }, // fused write uops
-    {103, S_ID2, PRALL,   0,   1,     0,   0xc2,     0x04, "Macrofus"  }, // macrofused uops
-    {104, S_ID2, PRALL,   0,   1,     0,   0xc2,     0x07, "FusedUop"  }, // fused uops, all kinds
-    {105, S_ID2, PRALL,   0,   1,     0,   0xc2,     0x08, "NotFusUop" }, // uops, not fused
-    {110, S_ID2, PRALL,   0,   1,     0,   0xa0,        0, "Uops UFD"  }, // uops dispatched, unfused domain. Imprecise
-    {111, S_ID2, PRALL,   0,   1,     0,   0xa2,        0, "res.stl."  }, // any resource stall
-    {115, S_ID2, PRALL,   0,   1,     0,   0xab,     0x01, "SP synch"  }, // Stack synchronization uops
-    {116, S_ID2, PRALL,   0,   1,     0,   0xab,     0x02, "SP engine" }, // Stack engine additions
-    {121, S_ID2, PRALL,   0,   1,     0,   0xd2,     0x02, "Part.reg"  }, // Partial register synchronization, clock cycles
-    {122, S_ID2, PRALL,   0,   1,     0,   0xd2,     0x04, "part.flag" }, // partial flags stall, clock cycles
-    {123, S_ID2, PRALL,   0,   1,     0,   0xd2,     0x08, "FP SW stl" }, // floating point status word stall
-    {130, S_ID2, PRALL,   0,   1,     0,   0xd2,     0x01, "R Rd stal" }, // ROB register read stall
-    {140, S_ID2, PRALL,   0,   1,     0,   0x19,     0x00, "I2FP pass" }, // bypass delay to FP unit from int unit
-    {141, S_ID2, PRALL,   0,   1,     0,   0x19,     0x01, "FP2I pass" }, // bypass delay to SIMD/int unit from fp unit (These counters cannot be used simultaneously)
-    {150, S_ID2, PRALL,   0,   0,     0,   0xa1,     0x01, "uop p0"    }, // uops port 0. Can only use first counter
-    {151, S_ID2, PRALL,   0,   0,     0,   0xa1,     0x02, "uop p1"    }, // uops port 1. Can only use first counter
-    {152, S_ID2, PRALL,   0,   0,     0,   0xa1,     0x04, "uop p2"    }, // uops port 2. Can only use first counter
-    {153, S_ID2, PRALL,   0,   0,     0,   0xa1,     0x08, "uop p3"    }, // uops port 3. Can only use first counter
-    {154, S_ID2, PRALL,   0,   0,     0,   0xa1,     0x10, "uop p4"    }, // uops port 4. Can only use first counter
-    {155, S_ID2, PRALL,   0,   0,     0,   0xa1,     0x20, "uop p5"    }, // uops port 5. Can only use first counter
-    {201, S_ID2, PRALL,   0,   1,     0,   0xc4,     0x0c, "BrTaken"   }, // branches taken. (Mask: 1=pred.not taken, 2=mispred not taken, 4=pred.taken, 8=mispred taken)
-    {204, S_ID2, PRALL,   0,   1,     0,   0xc4,     0x0a, "BrMispred" }, // mispredicted branches
-    {205, S_ID2, PRALL,   0,   1,     0,   0xe6,      0,   "BTBMiss"   }, // static branch prediction made
-    {210, S_ID2, PRALL,   0,   1,     0,   0x97,      0,   "BranchBu1" }, // branch taken bubble 1
-    {211, S_ID2, PRALL,   0,   1,     0,   0x98,      0,   "BranchBu2" }, // branch taken bubble 2 (these two values must be added)
-    {310, S_ID2, PRALL,   0,   1,     0,   0x28,     0x0f, "CodeMiss"  }, // level 2 cache code fetch
-    {311, S_ID2, PRALL,   0,   1,     0,   0x29,     0x0f, "L1D Miss"  }, // level 2 cache data fetch
-    {320, S_ID2, PRALL,   0,   1,     0,   0x24,     0x00, "L2 Miss"   }, // level 2 cache miss
-
-    // Nehalem, Sandy Bridge, Ivy Bridge
-    // The first three counters are fixed-function counters having their own register,
-    // The rest of the counters are competing for the same counter registers.
-    // id   scheme  cpu       countregs eventreg event  mask   name
-    {1,   S_ID3,  INTEL_7I,  0x40000001,  0,0,   0,      0,   "Core cyc"   }, // core clock cycles
-    {2,   S_ID3,  INTEL_7I,  0x40000002,  0,0,   0,      0,   "Ref cyc"    }, // Reference clock cycles
-    {9,   S_ID3,  INTEL_7I,  0x40000000,  0,0,   0,      0,   "Instruct"   }, // Instructions (reference counter)
-    {10,  S_ID3,  INTEL_7I,  0,   3,     0,   0xc0,     0x01, "Instruct"   }, // Instructions
-    {22,  S_ID3,  INTEL_7I,  0,   3,     0,   0x87,      0,   "ILenStal"   }, // instruction length decoder stalls (length changing prefix)
-    {24,  S_ID3,  INTEL_7I,  0,   3,     0,   0xA8,     0x01, "Loop uops"  }, // uops from loop stream detector
-    {25,  S_ID3,  INTEL_7I,  0,   3,     0,   0x79,     0x04, "Dec uops"   }, // uops from decoders. (MITE = Micro-instruction Translation Engine)
-    {26,  S_ID3,  INTEL_7I,  0,   3,     0,   0x79,     0x08, "Cach uops"  }, // uops from uop cache. (DSB = Decoded Stream Buffer)
-    {100, S_ID3,  INTEL_7I,  0,   3,     0,   0xc2,     0x01, "Uops"       }, // uops retired, unfused domain
-    {103, S_ID3,  INTEL_7I,  0,   3,     0,   0xc2,     0x04, "Macrofus"   }, // macrofused uops, Sandy Bridge
-    {104, S_ID3,  INTEL_7I,  0,   3,     0,   0x0E,     0x01, "Uops F.D."  }, // uops, fused domain, Sandy Bridge
-    {105, S_ID3,  INTEL_7,   0,   3,     0,   0x0E,     0x02, "fused uop"  }, // microfused uops
-    {110, S_ID3,  INTEL_7,   0,   3,     0,   0xa0,        0, "Uops UFD?"  }, // uops dispatched, unfused domain. Imprecise, Sandy Bridge
-    {111, S_ID3,  INTEL_7I,  0,   3,     0,   0xa2,        1, "res.stl."   }, // any resource stall
-    {121, S_ID3,  INTEL_7,   0,   3,     0,   0xd2,     0x02, "Part.reg"   }, // Partial register synchronization, clock cycles, Sandy Bridge
-    {122, S_ID3,  INTEL_7,   0,   3,     0,   0xd2,     0x01, "part.flag"  }, // partial flags stall, clock cycles, Sandy Bridge
-    {123, S_ID3,  INTEL_7,   0,   3,     0,   0xd2,     0x04, "R Rd stal"  }, // ROB register read stall, Sandy Bridge
-    {124, S_ID3,  INTEL_7,   0,   3,     0,   0xd2,     0x0F, "RAT stal"   }, // RAT stall, any, Sandy Bridge
-    {150, S_ID3,  INTEL_7,   0,   3,     0,   0xb1,     0x01, "uop p0"     }, // uops port 0.
-    {151, S_ID3,  INTEL_7,   0,   3,     0,   0xb1,     0x02, "uop p1"     }, // uops port 1.
-    {152, S_ID3,  INTEL_7,   0,   3,     0,   0xb1,     0x04, "uop p2"     }, // uops port 2.
-    {153, S_ID3,  INTEL_7,   0,   3,     0,   0xb1,     0x08, "uop p3"     }, // uops port 3.
-    {154, S_ID3,  INTEL_7,   0,   3,     0,   0xb1,     0x10, "uop p4"     }, // uops port 4.
-    {155, S_ID3,  INTEL_7,   0,   3,     0,   0xb1,     0x20, "uop p5"     }, // uops port 5.
-    {156, S_ID3,  INTEL_7,   0,   3,     0,   0xb1,     0x40, "uop p015"   }, // uops port 0,1,5.
-    {157, S_ID3,  INTEL_7,   0,   3,     0,   0xb1,     0x80, "uop p234"   }, // uops port 2,3,4.
-    {150, S_ID3,  INTEL_IVY, 0,   3,     0,   0xa1,     0x01, "uop p0"     }, // uops port 0
-    {151, S_ID3,  INTEL_IVY, 0,   3,     0,   0xa1,     0x02, "uop p1"     }, // uops port 1
-    {152, S_ID3,  INTEL_IVY, 0,   3,     0,   0xa1,     0x0c, "uop p2"     }, // uops port 2
-    {153, S_ID3,  INTEL_IVY, 0,   3,     0,   0xa1,     0x30, "uop p3"     }, // uops port 3
-    {154, S_ID3,  INTEL_IVY, 0,   3,     0,   0xa1,     0x40, "uop p4"     }, // uops port 4
-    {155, S_ID3,  INTEL_IVY, 0,   3,     0,   0xa1,     0x80, "uop p5"     }, // uops port 5
-    {160, S_ID3,  INTEL_IVY, 0,   3,     0,   0xa1,     0xFF, "uop p05"    }, // uops port 0-5
-    {201, S_ID3,  INTEL_IVY, 0,   1,     0,   0xc4,     0x20, "BrTaken"    }, // branches taken. (Mask: 1=pred.not taken, 2=mispred not taken, 4=pred.taken, 8=mispred taken)
-    {204, S_ID3,  INTEL_7,   0,   3,     0,   0xc5,     0x0a, "BrMispred"  }, // mispredicted branches
-    {207, S_ID3,  INTEL_7I,  0,   3,     0,   0xc5,     0x0,  "BrMispred"  }, // mispredicted branches
-    {205, S_ID3,  INTEL_7,   0,   3,     0,   0xe6,      2,   "BTBMiss"    }, // static branch prediction made, Sandy Bridge
-    {220, S_ID3,  INTEL_IVY, 0,   3,     0,   0x58,     0x03, "Mov elim"   }, // register moves eliminated
-    {221, S_ID3,  INTEL_IVY, 0,   3,     0,   0x58,     0x0C, "Mov elim-"  }, // register moves elimination unsuccessful
-    {311, S_ID3,  INTEL_7I,  0,   3,     0,   0x28,     0x0f, "L1D Miss"   }, // level 1 data cache miss
-    {312, S_ID3,  INTEL_7,   0,   3,     0,   0x24,     0x0f, "L1 Miss"    }, // level 2 cache requests
-
-    // Haswell
-    // The first three counters are fixed-function counters having their own register,
-    // The rest of the counters are competing for the same four counter registers.
-    // id   scheme  cpu       countregs eventreg event  mask   name
-    {1,   S_ID3,  INTEL_HASW, 0x40000001,  0,0,   0,     0,   "Core cyc"   }, // core clock cycles
-    {2,   S_ID3,  INTEL_HASW, 0x40000002,  0,0,   0,     0,   "Ref cyc"    }, // Reference clock cycles
-    {9,   S_ID3,  INTEL_HASW, 0x40000000,  0,0,   0,     0,   "Instruct"   }, // Instructions (reference counter)
-    {10,  S_ID3,  INTEL_HASW, 0,  3,     0,   0xc0,     0x01, "Instruct"   }, // Instructions
-    {22,  S_ID3,  INTEL_HASW, 0,  3,     0,   0x87,     0x01, "ILenStal"   }, // instruction length decoder stall due to length changing prefix
-    {24,  S_ID3,  INTEL_HASW, 0,  3,     0,   0xA8,     0x01, "Loop uops"  }, // uops from loop stream detector
-    {25,  S_ID3,  INTEL_HASW, 0,  3,     0,   0x79,     0x04, "Dec uops"   }, // uops from decoders. (MITE = Micro-instruction Translation Engine)
-    {26,  S_ID3,  INTEL_HASW, 0,  3,     0,   0x79,     0x08, "Cach uops"  }, // uops from uop cache. (DSB = Decoded Stream Buffer)
-    {100, S_ID3,  INTEL_HASW, 0,  3,     0,   0xc2,     0x01, "Uops"       }, // uops retired, unfused domain
-    {104, S_ID3,  INTEL_HASW, 0,  3,     0,   0x0e,     0x01, "uops RAT"   }, // uops from RAT to RS
-    {111, S_ID3,  INTEL_HASW, 0,  3,     0,   0xa2,     0x01, "res.stl."   }, // any resource stall
-    {131, S_ID3,  INTEL_HASW, 0,  3,     0,   0xC1,     0x18, "AVX trans"  }, // VEX - non-VEX transition penalties
-    {150, S_ID3,  INTEL_HASW, 0,  3,     0,   0xa1,     0x01, "uop p0"     }, // uops port 0.
-    {151, S_ID3,  INTEL_HASW, 0,  3,     0,   0xa1,     0x02, "uop p1"     }, // uops port 1.
-    {152, S_ID3,  INTEL_HASW, 0,  3,     0,   0xa1,     0x04, "uop p2"     }, // uops port 2.
-    {153, S_ID3,  INTEL_HASW, 0,  3,     0,   0xa1,     0x08, "uop p3"     }, // uops port 3.
-    {154, S_ID3,  INTEL_HASW, 0,  3,     0,   0xa1,     0x10, "uop p4"     }, // uops port 4.
-    {155, S_ID3,  INTEL_HASW, 0,  3,     0,   0xa1,     0x20, "uop p5"     }, // uops port 5.
-    {156, S_ID3,  INTEL_HASW, 0,  3,     0,   0xa1,     0x40, "uop p6"     }, // uops port 6.
-    {157, S_ID3,  INTEL_HASW, 0,  3,     0,   0xa1,     0x80, "uop p7"     }, // uops port 7.
-    {160, S_ID3,  INTEL_HASW, 0,  3,     0,   0xa1,     0xFF, "uop p07"    }, // uops port 0-7
-    {201, S_ID3,  INTEL_HASW, 0,  3,     0,   0xC4,     0x20, "BrTaken"    }, // branches taken
-    {207, S_ID3,  INTEL_HASW, 0,  3,     0,   0xc5,     0x00, "BrMispred"  }, // mispredicted branches
-    {220, S_ID3,  INTEL_HASW, 0,  3,     0,   0x58,     0x03, "Mov elim"   }, // register moves eliminated
-    {221, S_ID3,  INTEL_HASW, 0,  3,     0,   0x58,     0x0C, "Mov elim-"  }, // register moves elimination unsuccessful
-    {310, S_ID3,  INTEL_HASW, 0,  3,     0,   0x80,     0x02, "CodeMiss"   }, // code cache misses
-    {311, S_ID3,  INTEL_HASW, 0,  3,     0,   0x24,     0xe1, "L1D Miss"   }, // level 1 data cache miss
-    {320, S_ID3,  INTEL_HASW, 0,  3,     0,   0x24,     0x27, "L2 Miss"    }, // level 2 cache misses
-
-    // Skylake
-    // The first three counters are fixed-function counters having their own register,
-    // The rest of the counters are competing for the same four counter registers.
-    // id   scheme  cpu       countregs eventreg event  mask   name
-    {1,   S_ID4,  INTEL_SKYL, 0x40000001,  0,0,   0,     0,   "Core cyc"   }, // core clock cycles
-    {2,   S_ID4,  INTEL_SKYL, 0x40000002,  0,0,   0,     0,   "Ref cyc"    }, // Reference clock cycles
-    {9,   S_ID4,  INTEL_SKYL, 0x40000000,  0,0,   0,     0,   "Instruct"   }, // Instructions (reference counter)
-    {10,  S_ID4,  INTEL_SKYL, 0,  3,     0,   0xc0,     0x01, "Instruct"   }, // Instructions
-    {22,  S_ID4,  INTEL_SKYL, 0,  3,     0,   0x87,     0x01, "ILenStal"   }, // instruction length decoder stall due to length changing prefix
-    {24,  S_ID4,  INTEL_SKYL, 0,  3,     0,   0xA8,     0x01, "Loop uops"  }, // uops from loop stream detector
-    {25,  S_ID4,  INTEL_SKYL, 0,  3,     0,   0x79,     0x04, "Dec uops"   }, // uops from decoders. (MITE = Micro-instruction Translation Engine)
-    {26,  S_ID4,  INTEL_SKYL, 0,  3,     0,   0x79,     0x08, "Cach uops"  }, // uops from uop cache. (DSB = Decoded Stream Buffer)
-    {100, S_ID4,  INTEL_SKYL, 0,  3,     0,   0xc2,     0x01, "Uops"       }, // uops retired, unfused domain
-    {104, S_ID4,  INTEL_SKYL, 0,  3,     0,   0x0e,     0x01, "uops RAT"   }, // uops from RAT to RS
-    {111, S_ID4,  INTEL_SKYL, 0,  3,     0,   0xa2,     0x01, "res.stl."   }, // any resource stall
-    {131, S_ID4,  INTEL_SKYL, 0,  3,     0,   0xC1,     0x18, "AVX trans"  }, // VEX - non-VEX transition penalties
-    {150, S_ID4,  INTEL_SKYL, 0,  3,     0,   0xa1,     0x01, "uop p0"     }, // uops port 0.
-    {151, S_ID4,  INTEL_SKYL, 0,  3,     0,   0xa1,     0x02, "uop p1"     }, // uops port 1.
-    {152, S_ID4,  INTEL_SKYL, 0,  3,     0,   0xa1,     0x04, "uop p2"     }, // uops port 2.
-    {153, S_ID4,  INTEL_SKYL, 0,  3,     0,   0xa1,     0x08, "uop p3"     }, // uops port 3.
-    {154, S_ID4,  INTEL_SKYL, 0,  3,     0,   0xa1,     0x10, "uop p4"     }, // uops port 4.
-    {155, S_ID4,  INTEL_SKYL, 0,  3,     0,   0xa1,     0x20, "uop p5"     }, // uops port 5.
-    {156, S_ID4,  INTEL_SKYL, 0,  3,     0,   0xa1,     0x40, "uop p6"     }, // uops port 6.
-    {157, S_ID4,  INTEL_SKYL, 0,  3,     0,   0xa1,     0x80, "uop p7"     }, // uops port 7.
-    {160, S_ID4,  INTEL_SKYL, 0,  3,     0,   0xa1,     0xFF, "uop p07"    }, // uops port 0-7
-    {201, S_ID4,  INTEL_SKYL, 0,  3,     0,   0xC4,     0x20, "BrTaken"    }, // branches taken
-    {207, S_ID4,  INTEL_SKYL, 0,  3,     0,   0xC5,     0x00, "BrMispred"  }, // mispredicted branches
-    {220, S_ID4,  INTEL_SKYL, 0,  3,     0,   0x58,     0x03, "Mov elim"   }, // register moves eliminated
-    {221, S_ID4,  INTEL_SKYL, 0,  3,     0,   0x58,     0x0C, "Mov elim-"  }, // register moves elimination unsuccessful
-    {310, S_ID4,  INTEL_SKYL, 0,  3,     0,   0x80,     0x02, "CodeMiss"   }, // code cache misses
-    {311, S_ID4,  INTEL_SKYL, 0,  3,     0,   0x24,     0xe1, "L1D Miss"   }, // level 1 data cache miss
-    {320, S_ID4,  INTEL_SKYL, 0,  3,     0,   0x24,     0x27, "L2 Miss"    }, // level 2 cache misses
-
-    // Ice Lake and Tiger lake
-    // The first three counters are fixed-function counters having their own register,
-    // The rest of the counters are competing for the same four counter registers.
-    // id   scheme  cpu       countregs eventreg event  mask   name
-    {1,   S_ID4,  INTEL_ICE, 0x40000001,  0,0,   0,     0,   "Core cyc"   }, // core clock cycles
-    {2,   S_ID4,  INTEL_ICE, 0x40000002,  0,0,   0,     0,   "Ref cyc"    }, // Reference clock cycles
-    {9,   S_ID4,  INTEL_ICE, 0x40000000,  0,0,   0,     0,   "Instruct"   }, // Instructions (reference counter)
-    {10,  S_ID4,  INTEL_ICE, 0,  7,     0,   0xc0,     0x00, "Instruct"   }, // Instructions
-    {22,  S_ID4,  INTEL_ICE, 0,  7,     0,   0x87,     0x01, "ILenStal"   }, // instruction length decoder stall due to length changing prefix
-    {24,  S_ID4,  INTEL_ICE, 0,  7,     0,   0xA8,     0x01, "Loop uops"  }, // uops from loop stream detector
-    {25,  S_ID4,  INTEL_ICE, 0,  7,     0,   0x79,     0x04, "Dec uops"   }, // uops from decoders. (MITE = Micro-instruction Translation Engine)
-    {26,  S_ID4,  INTEL_ICE, 0,  7,     0,   0x79,     0x08, "Cach uops"  }, // uops from uop cache. (DSB = Decoded Stream Buffer)
-    {100, S_ID4,  INTEL_ICE, 0,  7,     0,   0xc2,     0x01, "Uops"       }, // uops retired, unfused domain
-    {104, S_ID4,  INTEL_ICE, 0,  7,     0,   0x0e,     0x01, "uops RAT"   }, // uops from RAT to RS
-    {111, S_ID4,  INTEL_ICE, 0,  7,     0,   0xa2,     0x08, "res.stl."   }, // resource stall
-    {131, S_ID4,  INTEL_ICE, 0,  7,     0,   0xC1,     0x07, "uc asist"   }, // microcode assist
-    {150, S_ID4,  INTEL_ICE, 0,  7,     0,   0xa1,     0x01, "uop p0"     }, // uops port 0.
-    {151, S_ID4,  INTEL_ICE, 0,  7,     0,   0xa1,     0x02, "uop p1"     }, // uops port 1.
-    {152, S_ID4,  INTEL_ICE, 0,  7,     0,   0xa1,     0x04, "uop p23"    }, // uops port 2&3.
-    {154, S_ID4,  INTEL_ICE, 0,  7,     0,   0xa1,     0x10, "uop p49"    }, // uops port 4&9.
-    {155, S_ID4,  INTEL_ICE, 0,  7,     0,   0xa1,     0x20, "uop p5"     }, // uops port 5.
-    {156, S_ID4,  INTEL_ICE, 0,  7,     0,   0xa1,     0x40, "uop p6"     }, // uops port 6.
-    {157, S_ID4,  INTEL_ICE, 0,  7,     0,   0xa1,     0x80, "uop p78"    }, // uops port 7&8.
-    {201, S_ID4,  INTEL_ICE, 0,  7,     0,   0xC4,     0x20, "BrTaken"    }, // branches taken
-    {207, S_ID4,  INTEL_ICE, 0,  7,     0,   0xC5,     0x00, "BrMispred"  }, // mispredicted branches
-    {310, S_ID4,  INTEL_ICE, 0,  7,     0,   0x80,     0x04, "CodeMiss"   }, // code cache misses
-    {311, S_ID4,  INTEL_ICE, 0,  7,     0,   0x24,     0xe1, "L1D Miss"   }, // level 1 data cache miss
-    {320, S_ID4,  INTEL_ICE, 0,  7,     0,   0x24,     0x21, "L2 Miss"    }, // level 2 cache misses
-
-    // Also Tiger lake
-    // id   scheme  cpu       countregs eventreg event  mask   name
-    {1,   S_ID5,  INTEL_ICE, 0x40000001,  0,0,   0,     0,   "Core cyc"   }, // core clock cycles
-    {2,   S_ID5,  INTEL_ICE, 0x40000002,  0,0,   0,     0,   "Ref cyc"    }, // Reference clock cycles
-    {9,   S_ID5,  INTEL_ICE, 0x40000000,  0,0,   0,     0,   "Instruct"   }, // Instructions (reference counter)
-    {10,  S_ID5,  INTEL_ICE, 0,  7,     0,   0xc0,     0x00, "Instruct"   }, // Instructions
-    {22,  S_ID5,  INTEL_ICE, 0,  7,     0,   0x87,     0x01, "ILenStal"   }, // instruction length decoder stall due to length changing prefix
-    {24,  S_ID5,  INTEL_ICE, 0,  7,     0,   0xA8,     0x01, "Loop uops"  }, // uops from loop stream detector
-    {25,  S_ID5,  INTEL_ICE, 0,  7,     0,   0x79,     0x04, "Dec uops"   }, // uops from decoders. (MITE = Micro-instruction Translation Engine)
-    {26,  S_ID5,  INTEL_ICE, 0,  7,     0,   0x79,     0x08, "Cach uops"  }, // uops from uop cache. (DSB = Decoded Stream Buffer)
-    {100, S_ID5,  INTEL_ICE, 0,  7,     0,   0xc2,     0x01, "Uops"       }, // uops retired, unfused domain
-    {104, S_ID5,  INTEL_ICE, 0,  7,     0,   0x0e,     0x01, "uops RAT"   }, // uops from RAT to RS
-    {111, S_ID5,  INTEL_ICE, 0,  7,     0,   0xa2,     0x08, "res.stl."   }, // resource stall
-    {131, S_ID5,  INTEL_ICE, 0,  7,     0,   0xC1,     0x07, "uc asist"   }, // microcode assist
-    {150, S_ID5,  INTEL_ICE, 0,  7,     0,   0xa1,     0x01, "uop p0"     }, // uops port 0.
-    {151, S_ID5,  INTEL_ICE, 0,  7,     0,   0xa1,     0x02, "uop p1"     }, // uops port 1.
-    {152, S_ID5,  INTEL_ICE, 0,  7,     0,   0xa1,     0x04, "uop p23"    }, // uops port 2&3.
-    {154, S_ID5,  INTEL_ICE, 0,  7,     0,   0xa1,     0x10, "uop p49"    }, // uops port 4&9.
-    {155, S_ID5,  INTEL_ICE, 0,  7,     0,   0xa1,     0x20, "uop p5"     }, // uops port 5.
-    {156, S_ID5,  INTEL_ICE, 0,  7,     0,   0xa1,     0x40, "uop p6"     }, // uops port 6.
-    {157, S_ID5,  INTEL_ICE, 0,  7,     0,   0xa1,     0x80, "uop p78"    }, // uops port 7&8.
-    {201, S_ID5,  INTEL_ICE, 0,  7,     0,   0xC4,     0x20, "BrTaken"    }, // branches taken
-    {207, S_ID5,  INTEL_ICE, 0,  7,     0,   0xC5,     0x00, "BrMispred"  }, // mispredicted branches
-    {310, S_ID5,  INTEL_ICE, 0,  7,     0,   0x80,     0x04, "CodeMiss"   }, // code cache misses
-    {311, S_ID5,  INTEL_ICE, 0,  7,     0,   0x24,     0xe1, "L1D Miss"   }, // level 1 data cache miss
-    {320, S_ID5,  INTEL_ICE, 0,  7,     0,   0x24,     0x21, "L2 Miss"    }, // level 2 cache misses
-
-    // Alder Lake and Golden Cove
-    // The first three counters are fixed-function counters having their own register,
-    // The rest of the counters are competing for the same four counter registers.
-    // id   scheme  cpu       countregs eventreg event  mask   name
-    {1,   S_ID5,  INTEL_GOLDCV, 0x40000001,  0,0,   0,     0,   "Core cyc"   }, // core clock cycles
-    {2,   S_ID5,  INTEL_GOLDCV, 0x40000002,  0,0,   0,     0,   "Ref cyc"    }, // Reference clock cycles
-    {9,   S_ID5,  INTEL_GOLDCV, 0x40000000,  0,0,   0,     0,   "Instruct"   }, // Instructions (reference counter)
-    {10,  S_ID5,  INTEL_GOLDCV, 0,  7,     0,   0xc0,     0x00, "Instruct"   }, // Instructions
-    {22,  S_ID5,  INTEL_GOLDCV, 0,  7,     0,   0x87,     0x01, "ILenStal"   }, // instruction length decoder stall due to length changing prefix
-    {24,  S_ID5,  INTEL_GOLDCV, 0,  7,     0,   0xA8,     0x01, "Loop uops"  }, // uops from loop stream detector
-    {25,  S_ID5,  INTEL_GOLDCV, 0,  7,     0,   0x79,     0x04, "Dec uops"   }, // uops from decoders. (MITE = Micro-instruction Translation Engine)
-    {26,  S_ID5,  INTEL_GOLDCV, 0,  7,     0,   0x79,     0x08, "Cach uops"  }, // uops from uop cache. (DSB = Decoded Stream Buffer)
-    {100, S_ID5,  INTEL_GOLDCV, 0,  7,     0,   0xc2,     0x01, "Uops"       }, // uops retired, unfused domain
-    {111, S_ID5,  INTEL_GOLDCV, 0,  7,     0,   0xa2,     0x08, "res.stl."   }, // resource stall due to serializing events
-    {131, S_ID5,  INTEL_GOLDCV, 0,  7,     0,   0xC1,     0x02, "uc asist"   }, // fp microcode assist
-    {150, S_ID5,  INTEL_GOLDCV, 0,  7,     0,   0xb2,     0x01, "uop p0"     }, // uops port 0.
-    {151, S_ID5,  INTEL_GOLDCV, 0,  7,     0,   0xb2,     0x02, "uop p1"     }, // uops port 1.
-    {152, S_ID5,  INTEL_GOLDCV, 0,  7,     0,   0xb2,     0x04, "uop p23A"   }, // uops port 2, 3, 10.
-    {154, S_ID5,  INTEL_GOLDCV, 0,  7,     0,   0xb2,     0x10, "uop p49"    }, // uops port 4&9.
-    {155, S_ID5,  INTEL_GOLDCV, 0,  7,     0,   0xb2,     0x20, "uop p5B"    }, // uops port 5, 11.
-    {156, S_ID5,  INTEL_GOLDCV, 0,  7,     0,   0xb2,     0x40, "uop p6"     }, // uops port 6.
-    {157, S_ID5,  INTEL_GOLDCV, 0,  7,     0,   0xb2,     0x80, "uop p78"    }, // uops port 7&8.
-    {201, S_ID5,  INTEL_GOLDCV, 0,  7,     0,   0xC4,     0x01, "BrTaken"    }, // branches taken
-    {207, S_ID5,  INTEL_GOLDCV, 0,  7,     0,   0xC5,     0x00, "BrMispred"  }, // mispredicted branches
-    {310, S_ID5,  INTEL_GOLDCV, 0,  7,     0,   0x80,     0x04, "CodeMiss"   }, // code cache misses
-    {311, S_ID5,  INTEL_GOLDCV, 0,  7,     0,   0x24,     0xe1, "L1D Miss"   }, // level 1 data cache miss
-    {320, S_ID5,  INTEL_GOLDCV, 0,  7,     0,   0x24,     0x21, "L2 Miss"    }, // level 2 cache misses
-
-
-    // Intel Atom:
-    // The first counter is fixed-function counter having its own register,
-    // The rest of the counters are competing for the same two counter registers.
-    //  id   scheme  cpu         countregs eventreg event  mask   name
-    {9,   S_ID3, INTEL_ATOM,  0x40000000, 0,0,    0,      0,   "Instruct"   }, // Instructions (reference counter)
-    {10,  S_ID3, INTEL_ATOM,  0,   1,     0,   0xc0,     0x00, "Instr"      }, // Instructions retired
-    {20,  S_ID3, INTEL_ATOM,  0,   1,     0,   0x80,     0x03, "Insfetch"   }, // instruction fetches
-    {21,  S_ID3, INTEL_ATOM,  0,   1,     0,   0x80,     0x02, "I miss"     }, // instruction cache miss
-    {30,  S_ID3, INTEL_ATOM,  0,   1,     0,   0x40,     0x21, "L1 read"    }, // L1 data cache read
-    {31,  S_ID3, INTEL_ATOM,  0,   1,     0,   0x40,     0x22, "L1 write"   }, // L1 data cache write
-    {100, S_ID3, INTEL_ATOM,  0,   1,     0,   0xc2,     0x10, "Uops"       }, // uops retired
-    {200, S_ID3, INTEL_ATOM,  0,   1,     0,   0xc4,     0x00, "Branch"     }, // branches
-    {201, S_ID3, INTEL_ATOM,  0,   1,     0,   0xc4,     0x0c, "BrTaken"    }, // branches taken. (Mask: 1=pred.not taken, 2=mispred not taken, 4=pred.taken, 8=mispred taken)
-    {204, S_ID3, INTEL_ATOM,  0,   1,     0,   0xc4,     0x0a, "BrMispred"  }, // mispredicted branches
-    {205, S_ID3, INTEL_ATOM,  0,   1,     0,   0xe6,     0x01, "BTBMiss"    }, // Baclear
-    {310, S_ID3, INTEL_ATOM,  0,   1,     0,   0x28,     0x4f, "CodeMiss"   }, // level 2 cache code fetch
-    {311, S_ID3, INTEL_ATOM,  0,   1,     0,   0x29,     0x4f, "L1D Miss"   }, // level 2 cache data fetch
-    {320, S_ID3, INTEL_ATOM,  0,   1,     0,   0x24,     0x00, "L2 Miss"    }, // level 2 cache miss
-    {501, S_ID3, INTEL_ATOM,  0,   1,     0,   0xC0,     0x00, "inst re"    }, // instructions retired
-    {505, S_ID3, INTEL_ATOM,  0,   1,     0,   0xAA,     0x02, "CISC"       }, // CISC macro instructions decoded
-    {506, S_ID3, INTEL_ATOM,  0,   1,     0,   0xAA,     0x03, "decoded"    }, // all instructions decoded
-    {601, S_ID3, INTEL_ATOM,  0,   1,     0,   0x02,     0x81, "st.forw"    }, // Successful store forwards
-    {640, S_ID3, INTEL_ATOM,  0,   1,     0,   0x12,     0x81, "mul"        }, // Int and FP multiply operations
-    {641, S_ID3, INTEL_ATOM,  0,   1,     0,   0x13,     0x81, "div"        }, // Int and FP divide and sqrt operations
-    {651, S_ID3, INTEL_ATOM,  0,   1,     0,   0x10,     0x81, "fp uop"     }, // Floating point uops
-
-    // Silvermont
-    // The first three counters are fixed-function counters having their own register,
-    // The rest of the counters are competing for the same two counter registers.
-    //id  scheme  cpu       countregs eventreg event  mask   name
-    {1,   S_ID3,  INTEL_SILV, 0x40000001,  0,0,   0,     0,   "Core cyc"   }, // core clock cycles
-    {2,   S_ID3,  INTEL_SILV, 0x40000002,  0,0,   0,     0,   "Ref cyc"    }, // Reference clock cycles
-    {9,   S_ID3,  INTEL_SILV, 0x40000000,  0,0,   0,     0,   "Instruct"   }, // Instructions (reference counter)
-    {100, S_ID3,  INTEL_SILV, 0,  1,     0,   0xc2,     0x10, "Uops"       }, // uops retired
-    {103, S_ID3,  INTEL_SILV, 0,  1,     0,   0xc2,     0x01, "Uop micr"   }, // uops from microcode rom
-    {111, S_ID3,  INTEL_SILV, 0,  1,     0,   0xc3,     0x08, "stall"      }, // any stall
-    {150, S_ID3,  INTEL_SILV, 0,  1,     0,   0xCB,     0x02, "p0i full"   }, // port 0 integer pipe full
-    {151, S_ID3,  INTEL_SILV, 0,  1,     0,   0xCB,     0x04, "p1i full"   }, // port 1 integer pipe full
-    {152, S_ID3,  INTEL_SILV, 0,  1,     0,   0xCB,     0x08, "p0f full"   }, // port 0 f.p. pipe full
-    {153, S_ID3,  INTEL_SILV, 0,  1,     0,   0xCB,     0x10, "p1f full"   }, // port 1 f.p. pipe full
-    {158, S_ID3,  INTEL_SILV, 0,  1,     0,   0xCB,     0x01, "mec full"   }, // memory execution cluster pipe full
-    {201, S_ID3,  INTEL_SILV, 0,  1,     0,   0xC4,     0xFE, "BrPrTak"    }, // branches predicted taken
-    {202, S_ID3,  INTEL_SILV, 0,  1,     0,   0xC5,     0xFE, "BrMprNT"    }, // branches not taken mispredicted
-    {207, S_ID3,  INTEL_SILV, 0,  1,     0,   0xc5,     0x00, "BrMispred"  }, // mispredicted branches
-    {209, S_ID3,  INTEL_SILV, 0,  1,     0,   0xe6,     0x01, "BACLEAR"    }, // early prediction corrected by later prediction
-    {310, S_ID2,  INTEL_SILV, 0,  1,     0,   0x80,     0x02, "CodeMiss"   }, // code cache misses
-    {311, S_ID3,  INTEL_SILV, 0,  1,     0,   0x04,     0x01, "L1D LMis"   }, // level 1 data cache load miss
-    {320, S_ID3,  INTEL_SILV, 0,  1,     0,   0x2E,     0x41, "L2 Miss"    }, // level 2 cache misses
-
-    // Goldmont
-    //id  scheme  cpu          countregs    eventreg event  mask   name
-    {1,   S_ID4,  INTEL_GOLDM, 0x40000001,  0,0,     0,     0,     "Core cyc"   }, // core clock cycles
-    {2,   S_ID4,  INTEL_GOLDM, 0x40000002,  0,0,     0,     0,     "Ref cyc"    }, // Reference clock cycles
-    {9,   S_ID4,  INTEL_GOLDM, 0x40000000,  0,0,     0,     0,     "Instruct"   }, // Instructions (reference counter)
-    {10,  S_ID4,  INTEL_GOLDM, 0,  3,       0,      0xC0,  0x00,   "Instruct"   }, // Instructions retired
-    {100, S_ID4,  INTEL_GOLDM, 0,  3,       0,      0xC2,  0x00,   "Uops"       }, // uops retired
-    {150, S_ID4,  INTEL_GOLDM, 0,  3,       0,      0x0E,  0x00,   "Uops i"     }, // uops issued, Goldmont only
-    {201, S_ID4,  INTEL_GOLDM, 0,  3,       0,      0xC4,  0x80,   "BrTaken"    }, // branches taken (Goldmont)
-    {207, S_ID4,  INTEL_GOLDM, 0,  3,       0,      0xC5,  0x7E,   "BrMispred"  }, // mispredicted conditional branches
-    {208, S_ID4,  INTEL_GOLDM, 0,  3,       0,      0xC5,  0xF7,   "RetMispr"   }, // mispredicted return
-    {311, S_ID4,  INTEL_GOLDM, 0,  3,       0,      0xD1,  0x08,   "L1D LMis"   }, // level 1 data cache load miss
-    {320, S_ID4,  INTEL_GOLDM, 0,  3,       0,      0xD1,  0x10,   "L2 Miss"    }, // level 2 cache misses
-
-    // Tremont
-    //id  scheme  cpu          countregs    eventreg event  mask   name
-    {1,   S_ID5,  INTEL_GOLDM, 0x40000001,  0,0,     0,     0,     "Core cyc"   }, // core clock cycles
-    {2,   S_ID5,  INTEL_GOLDM, 0x40000002,  0,0,     0,     0,     "Ref cyc"    }, // Reference clock cycles
-    {9,   S_ID5,  INTEL_GOLDM, 0x40000000,  0,0,     0,     0,     "Instruct"   }, // Instructions (reference counter)
-    {10,  S_ID5,  INTEL_GOLDM, 0,  3,       0,      0xC0,  0x00,   "Instruct"   }, // Instructions retired
-    {22,  S_ID5,  INTEL_GOLDM, 0,  3,       0,      0xE9,  0x01,   "ILenStal"   }, // Instructions length mispredicted
-    {100, S_ID5,  INTEL_GOLDM, 0,  3,       0,      0xC2,  0x00,   "Uops"       }, // uops retired
-    {150, S_ID5,  INTEL_GOLDM, 0,  3,       0,      0xC2,  0x01,   "Ucode"      }, // uops from micro-sequencer
-    {151, S_ID5,  INTEL_GOLDM, 0,  3,       0,      0xC2,  0x08,   "Fdiv"       }, // uops fp divide and square root
-    {201, S_ID5,  INTEL_GOLDM, 0,  3,       0,      0xC4,  0xFE,   "BrTaken"    }, // branches taken
-    {204, S_ID5,  INTEL_GOLDM, 0,  3,       0,      0xC5,  0x7E,   "BrMispred"  }, // mispredicted conditional branches
-    {205, S_ID5,  INTEL_GOLDM, 0,  3,       0,      0xC5,  0xF7,   "RetMispr"   }, // mispredicted return
-    {206, S_ID5,  INTEL_GOLDM, 0,  3,       0,      0x43,  0x04,   "MisprSlot"  }, // number of issue slots every cycle that were not consumed due to branch misprecidt
-    {311, S_ID5,  INTEL_GOLDM, 0,  3,       0,      0xD1,  0x08,   "L1D LMis"   }, // level 1 data cache load miss
-    {320, S_ID5,  INTEL_GOLDM, 0,  3,       0,      0xD1,  0x10,   "L2 Miss"    }, // level 2 cache misses
-
-    // Intel Knights Landing:
-    // The first counter is fixed-function counter having its own register,
-    // The rest of the counters are competing for the same two counter registers.
-    //id  scheme cpu      countregs    eventreg event     mask  name
-    {1,   S_ID3,  INTEL_KNIGHT, 0x40000001,0,0,   0,     0,    "Core cyc"   }, // core clock cycles
-    {2,   S_ID3,  INTEL_KNIGHT, 0x40000002,0,0,   0,     0,    "Ref cyc"    }, // Reference clock cycles
-    {9,   S_ID3,  INTEL_KNIGHT, 0x40000000,0,0,   0,     0,    "Instruct"   }, // Instructions (reference counter)
-    {100, S_ID3,  INTEL_KNIGHT, 0,  1,    0,   0xc2,     0x10, "Uops"       }, // uops retired
-    {103, S_ID3,  INTEL_KNIGHT, 0,  1,    0,   0xc2,     0x01, "Uop micr"   }, // uops from microcode rom
-    {105, S_ID3,  INTEL_KNIGHT, 0,  1,    0,   0xc2,     0x20, "UopScalar"  }, // uops scalar SIMD
-    {106, S_ID3,  INTEL_KNIGHT, 0,  1,    0,   0xc2,     0x20, "UopVector"  }, // uops vector SIMD, except for loads, packed byte and word multiplies
-    {111, S_ID3,  INTEL_KNIGHT, 0,  1,    0,   0xc3,     0x08, "stall"      }, // any stall
-    {150, S_ID3,  INTEL_KNIGHT, 0,  1,    0,   0xCB,     0x02, "p0i full"   }, // port 0 integer pipe full
-    {151, S_ID3,  INTEL_KNIGHT, 0,  1,    0,   0xCB,     0x04, "p1i full"   }, // port 1 integer pipe full
-    {152, S_ID3,  INTEL_KNIGHT, 0,  1,    0,   0xCB,     0x08, "p0f full"   }, // port 0 f.p. pipe full
-    {153, S_ID3,  INTEL_KNIGHT, 0,  1,    0,   0xCB,     0x10, "p1f full"   }, // port 1 f.p. pipe full
-    {158, S_ID3,  INTEL_KNIGHT, 0,  1,    0,   0xCB,     0x01, "mec full"   }, // memory execution cluster pipe full
-    {201, S_ID3,  INTEL_KNIGHT, 0,  1,    0,   0xC4,     0xFE, "BrPrTak"    }, // branches predicted taken
-    {202, S_ID3,  INTEL_KNIGHT, 0,  1,    0,   0xC5,     0xFE, "BrMprNT"    }, // branches not taken mispredicted
-    {207, S_ID3,  INTEL_KNIGHT, 0,  1,    0,   0xc5,     0x00, "BrMispred"  }, // mispredicted branches
-    {209, S_ID3,  INTEL_KNIGHT, 0,  1,    0,   0xe6,     0x01, "BACLEAR"    }, // early prediction corrected by later prediction
-    {310, S_ID2,  INTEL_KNIGHT, 0,  1,    0,   0x80,     0x02, "CodeMiss"   }, // code cache misses
-    {311, S_ID3,  INTEL_KNIGHT, 0,  1,    0,   0x04,     0x01, "L1D LMis"   }, // level 1 data cache load miss
-    {320, S_ID3,  INTEL_KNIGHT, 0,  1,    0,   0x2E,     0x41, "L2 Miss"    }, // level 2 cache misses
-
-    //  id   scheme  cpu         countregs eventreg event  mask   name
-    {  9, S_AMD, AMD_ALL,      0,   3,     0,   0xc0,      0,  "Instruct" }, // x86 instructions executed
-    {100, S_AMD, AMD_ALL,      0,   3,     0,   0xc1,      0,  "Uops"     }, // microoperations
-    {204, S_AMD, AMD_ALL,      0,   3,     0,   0xc3,      0,  "BrMispred"}, // mispredicted branches
-    {201, S_AMD, AMD_BULLD,    0,   3,     0,   0xc4,   0x00,  "BrTaken"  }, // branches taken
-    {209, S_AMD, AMD_BULLD,    0,   3,     0,   0xc2,   0x00,  "RSBovfl"  }, // return stack buffer overflow
-    {310, S_AMD, AMD_ALL,      0,   3,     0,   0x81,      0,  "CodeMiss" }, // instruction cache misses
-    {311, S_AMD, AMD_ALL,      0,   3,     0,   0x41,      0,  "L1D Miss" }, // L1 data cache misses
-    {320, S_AMD, AMD_ALL,      0,   3,     0,   0x43,   0x1f,  "L2 Miss"  }, // L2 cache misses
-    {150, S_AMD, AMD_ATHLON64, 0,   3,     0,   0x00,   0x3f,  "UopsFP"   }, // microoperations in FP pipe
-    {151, S_AMD, AMD_ATHLON64, 0,   3,     0,   0x00,   0x09,  "FPADD"    }, // microoperations in FP ADD unit
-    {152, S_AMD, AMD_ATHLON64, 0,   3,     0,   0x00,   0x12,  "FPMUL"    }, // microoperations in FP MUL unit
-    {153, S_AMD, AMD_ATHLON64, 0,   3,     0,   0x00,   0x24,  "FPMISC"   }, // microoperations in FP Store unit
-    {150, S_AMD, AMD_BULLD,    3,   3,     0,   0x00,   0x01,  "UopsFP0"  }, // microoperations in FP pipe 0
-    {151, S_AMD, AMD_BULLD,    3,   3,     0,   0x00,   0x02,  "UopsFP1"  }, // microoperations in FP pipe 1
-    {152, S_AMD, AMD_BULLD,    3,   3,     0,   0x00,   0x04,  "UopsFP2"  }, // microoperations in FP pipe 2
-    {153, S_AMD, AMD_BULLD,    3,   3,     0,   0x00,   0x08,  "UopsFP3"  }, // microoperations in FP pipe 3
-    {110, S_AMD, AMD_BULLD,    0,   3,     0,   0x04,   0x0a,  "UopsElim" }, // move eliminations and scalar op optimizations
-    {120, S_AMD, AMD_BULLD,    0,   3,     0,   0x2A,   0x01,  "Forwfail" }, // load-to-store forwarding failed
-    {160, S_AMD, AMD_BULLD,    0,   3,     0,   0xCB,   0x01,  "x87"      }, // FP x87 instructions
-    {161, S_AMD, AMD_BULLD,    0,   3,     0,   0xCB,   0x02,  "MMX"      }, // MMX instructions
-    {162, S_AMD, AMD_BULLD,    0,   3,     0,   0xCB,   0x04,  "XMM"      }, // XMM and YMM instructions
-
-//  id    scheme  cpu         countregs eventreg event  mask   name
-    {  9, S_AMD2, AMD_ZEN,     0,   5,     0,   0xc0,      1,  "Instruct" }, // x86 instructions executed
-    {100, S_AMD2, AMD_ZEN,     0,   5,     0,   0xc1,      0,  "Uops"     }, // microoperations
-    {110, S_AMD2, AMD_ZEN,     0,   5,     0,   0x04,   0x0a,  "UopsElim" }, // move eliminations and scalar op optimizations
-    {150, S_AMD2, AMD_ZEN,     0,   5,     0,   0x00,   0x01,  "UopsFP0"  }, // microoperations in FP pipe 0
-    {151, S_AMD2, AMD_ZEN,     0,   5,     0,   0x00,   0x02,  "UopsFP1"  }, // microoperations in FP pipe 1
-    {152, S_AMD2, AMD_ZEN,     0,   5,     0,   0x00,   0x04,  "UopsFP2"  }, // microoperations in FP pipe 2
-    {153, S_AMD2, AMD_ZEN,     0,   5,     0,   0x00,   0x08,  "UopsFP3"  }, // microoperations in FP pipe 3
-    {158, S_AMD2, AMD_ZEN,     0,   5,     0,   0x00,   0xF0,  "UMultiP"  }, // microoperations using multiple FP pipes
-    {159, S_AMD2, AMD_ZEN,     0,   5,     0,   0x00,   0x0F,  "UopsFP"   }, // microoperations in FP
-    {120, S_AMD2, AMD_ZEN,     0,   5,     0,   0x35,   0x01,  "Forw"     }, // load-to-store forwards
-    {160, S_AMD2, AMD_ZEN,     0,   5,     0,   0x02,   0x07,  "x87"      }, // FP x87 instructions
-    {162, S_AMD2, AMD_ZEN,     0,   5,     0,   0x03,   0xFF,  "Vect"     }, // XMM and YMM instructions
-    {204, S_AMD2, AMD_ZEN,     0,   5,     0,   0xc3,      0,  "BrMispred"}, // mispredicted branches
-    {201, S_AMD2, AMD_ZEN,     0,   5,     0,   0xc4,   0x00,  "BrTaken"  }, // branches taken
-    {310, S_AMD2, AMD_ZEN,     0,   5,     0,   0x81,      0,  "CodeMiss" }, // instruction cache misses
-    {320, S_AMD2, AMD_ZEN,     0,   5,     0,   0x60,   0xFF,  "L2 req."  }, // L2 cache requests
-
-    // VIA Nano counters are undocumented
-    // These are the ones I have found that counts. Most have unknown purpose
-    //  id      scheme cpu    countregs eventreg event  mask   name
-    {0x1000, S_VIA, PRALL,   0,   1,     0,   0x000,    0,  "Instr" }, // Instructions
-    {0x0001, S_VIA, PRALL,   0,   1,     0,   0x001,    0,  "uops"  }, // micro-ops?
-    {0x0002, S_VIA, PRALL,   0,   1,     0,   0x002,    0,  "2"     }, //
-    {0x0003, S_VIA, PRALL,   0,   1,     0,   0x003,    0,  "3"     }, //
-    {0x0004, S_VIA, PRALL,   0,   1,     0,   0x004,    0,  "bubble"}, // Branch bubble clock cycles?
-    {0x0005, S_VIA, PRALL,   0,   1,     0,   0x005,    0,  "5"     }, //
-    {0x0006, S_VIA, PRALL,   0,   1,     0,   0x006,    0,  "6"     }, //
-    {0x0007, S_VIA, PRALL,   0,   1,     0,   0x007,    0,  "7"     }, //
-    {0x0008, S_VIA, PRALL,   0,   1,     0,   0x008,    0,  "8"     }, //
-    {0x0009, S_VIA, PRALL,   0,   1,     0,   0x000,    0,  "Instr" }, // Instructions
-    {0x0010, S_VIA, PRALL,   0,   1,     0,   0x010,    0,  "10"    }, //
-    {0x0014, S_VIA, PRALL,   0,   1,     0,   0x014,    0,  "14"    }, //
-    {0x0020, S_VIA, PRALL,   0,   1,     0,   0x020,    0,  "Br NT" }, // Branch not taken
-    {0x0021, S_VIA, PRALL,   0,   1,     0,   0x021,    0,  "Br NT Pr"}, // Branch not taken, predicted
-    {0x0022, S_VIA, PRALL,   0,   1,     0,   0x022,    0,  "Br Tk"   }, // Branch taken
-    {0x0023, S_VIA, PRALL,   0,   1,     0,   0x023,    0,  "Br Tk Pr"}, // Branch taken, predicted
-    {0x0024, S_VIA, PRALL,   0,   1,     0,   0x024,    0,  "Jmp"    }, // Jump or call
-    {0x0025, S_VIA, PRALL,   0,   1,     0,   0x025,    0,  "Jmp"    }, // Jump or call, predicted
-    {0x0026, S_VIA, PRALL,   0,   1,     0,   0x026,    0,  "Ind.Jmp"}, // Indirect jump or return
-    {0x0027, S_VIA, PRALL,   0,   1,     0,   0x027,    0,  "Ind.J. Pr"}, // Indirect jump or return, predicted
-    {0x0034, S_VIA, PRALL,   0,   1,     0,   0x034,    0,  "34"    }, //
-    {0x0040, S_VIA, PRALL,   0,   1,     0,   0x040,    0,  "40"    }, //
-    {0x0041, S_VIA, PRALL,   0,   1,     0,   0x040,    0,  "41"    }, //
-    {0x0042, S_VIA, PRALL,   0,   1,     0,   0x040,    0,  "42"    }, //
-    {0x0043, S_VIA, PRALL,   0,   1,     0,   0x040,    0,  "43"    }, //
-    {0x0044, S_VIA, PRALL,   0,   1,     0,   0x040,    0,  "44"    }, //
-    {0x0046, S_VIA, PRALL,   0,   1,     0,   0x040,    0,  "46"    }, //
-    {0x0048, S_VIA, PRALL,   0,   1,     0,   0x040,    0,  "48"    }, //
-    {0x0082, S_VIA, PRALL,   0,   1,     0,   0x082,    0,  "82"    }, //
-    {0x0083, S_VIA, PRALL,   0,   1,     0,   0x083,    0,  "83"    }, //
-    {0x0084, S_VIA, PRALL,   0,   1,     0,   0x084,    0,  "84"    }, //
-    {0x00B4, S_VIA, PRALL,   0,   1,     0,   0x0B4,    0,  "B4"    }, //
-    {0x00C0, S_VIA, PRALL,   0,   1,     0,   0x0C0,    0,  "C0"    }, //
-    {0x00C4, S_VIA, PRALL,   0,   1,     0,   0x0C4,    0,  "C4"    }, //
-    {0x0104, S_VIA, PRALL,   0,   1,     0,   0x104,    0, "104"    }, //
-    {0x0105, S_VIA, PRALL,   0,   1,     0,   0x105,    0, "105"    }, //
-    {0x0106, S_VIA, PRALL,   0,   1,     0,   0x106,    0, "106"    }, //
-    {0x0107, S_VIA, PRALL,   0,   1,     0,   0x107,    0, "107"    }, //
-    {0x0109, S_VIA, PRALL,   0,   1,     0,   0x109,    0, "109"    }, //
-    {0x010A, S_VIA, PRALL,   0,   1,     0,   0x10A,    0, "10A"    }, //
-    {0x010B, S_VIA, PRALL,   0,   1,     0,   0x10B,    0, "10B"    }, //
-    {0x010C, S_VIA, PRALL,   0,   1,     0,   0x10C,    0, "10C"    }, //
-    {0x0110, S_VIA, PRALL,   0,   1,     0,   0x110,    0, "110"    }, //
-    {0x0111, S_VIA, PRALL,   0,   1,     0,   0x111,    0, "111"    }, //
-    {0x0116, S_VIA, PRALL,   0,   1,     0,   0x116,    0, "116"    }, //
-    {0x0120, S_VIA, PRALL,   0,   1,     0,   0x120,    0, "120"    }, //
-    {0x0121, S_VIA, PRALL,   0,   1,     0,   0x121,    0, "121"    }, //
-    {0x013C, S_VIA, PRALL,   0,   1,     0,   0x13C,    0, "13C"    }, //
-    {0x0200, S_VIA, PRALL,   0,   1,     0,   0x200,    0, "200"    }, //
-    {0x0201, S_VIA, PRALL,   0,   1,     0,   0x201,    0, "201"    }, //
-    {0x0206, S_VIA, PRALL,   0,   1,     0,   0x206,    0, "206"    }, //
-    {0x0207, S_VIA, PRALL,   0,   1,     0,   0x207,    0, "207"    }, //
-    {0x0301, S_VIA, PRALL,   0,   1,     0,   0x301,    0, "301"    }, //
-    {0x0302, S_VIA, PRALL,   0,   1,     0,   0x302,    0, "302"    }, //
-    {0x0303, S_VIA, PRALL,   0,   1,     0,   0x303,    0, "303"    }, //
-    {0x0304, S_VIA, PRALL,   0,   1,     0,   0x304,    0, "304"    }, //
-    {0x0305, S_VIA, PRALL,   0,   1,     0,   0x305,    0, "305"    }, //
-    {0x0306, S_VIA, PRALL,   0,   1,     0,   0x306,    0, "306"    }, //
-    {0x0502, S_VIA, PRALL,   0,   1,     0,   0x502,    0, "502"    }, //
-    {0x0507, S_VIA, PRALL,   0,   1,     0,   0x507,    0, "507"    }, //
-    {0x0508, S_VIA, PRALL,   0,   1,     0,   0x508,    0, "508"    }, //
-    {0x050D, S_VIA, PRALL,   0,   1,     0,   0x50D,    0, "50D"    }, //
-    {0x0600, S_VIA, PRALL,   0,   1,     0,   0x600,    0, "600"    }, //
-    {0x0605, S_VIA, PRALL,   0,   1,     0,   0x605,    0, "605"    }, //
-    {0x0607, S_VIA, PRALL,   0,   1,     0,   0x607,    0, "607"    }, //
-
-    //  end of list
-    {0, S_UNKNOWN, PRUNKNOWN, 0,  0,     0,      0,     0,    0     }  // list must end with a record of all 0
-};
+#else // Linux
+
+typedef uint64_t ProcMaskType; // Type for processor mask
+
+// Affinity mask of the calling thread
+static ProcMaskType GetThreadMask()
+{
+    ProcMaskType ProcessAffMask = 0;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+    {
+        for (int p = 0; p < 64; p++)
+        {
+            if (CPU_ISSET(p, &set))
+                ProcessAffMask |= (ProcMaskType)1 << p;
+        }
+    }
+    return ProcessAffMask;
+}
+
+// Affinity mask of the main thread at startup, before any thread is locked to a processor.
+// Linux has no process mask, and threads inherit the mask of the thread that creates them
+static const ProcMaskType StartupProcessMask = GetThreadMask();
+
+// Get mask of possible CPU cores
+static inline ProcMaskType GetProcessMask()
+{
+    return StartupProcessMask;
+}
+
+// Set CPU to run on specified CPU core number (0-based). Returns false if failed
+static inline bool SetProcessMask(int p)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(p, &set);
+    if (sched_setaffinity(0, sizeof(set), &set))
+    {
+        printf("\nFailed to lock thread to processor %i. Error = %i\n", p, errno);
+        return false;
+    }
+    return true;
+}
+
+// Test if specified CPU core is available
+static inline int TestProcessMask(int p, ProcMaskType* m)
+{
+    if (p < 0 || p >= (int)sizeof(ProcMaskType) * 8)
+        return 0; // not in mask
+    return ((ProcMaskType)1 << p) & *m ? 1 : 0;
+}
+
+static inline void Sleep0() // Sleep for the rest of current timeslice
+{
+    sched_yield();
+}
+
+// Set process to high priority. Requires CAP_SYS_NICE, ignored otherwise
+static inline void SetProcessPriorityHigh()
+{
+    setpriority(PRIO_PROCESS, 0, -20);
+}
+
+// Set process to normal priority
+static inline void SetProcessPriorityNormal()
+{
+    setpriority(PRIO_PROCESS, 0, 0);
+}
+#endif
+
+// Counter definitions loaded by CCounters::loadEvents. They take precedence over CounterDefinitions
+static CEventDatabase LoadedEvents;
+
+// Index of the table CounterDefinitions, made the first time it is needed
+static const CEventDatabase& CompiledEvents()
+{
+    struct SCompiledEvents : CEventDatabase
+    {
+        SCompiledEvents()
+        {
+            int n = 0;
+            while (CounterDefinitions[n].ProcessorFamily || CounterDefinitions[n].CounterType)
+                n++;
+            add(CounterDefinitions, n);
+        }
+    };
+    static const SCompiledEvents events;
+    return events;
+}
 
 CMSRInOutQue::CMSRInOutQue()
 {
-    n = 0;
-    for (int i = 0; i < MAX_QUE_ENTRIES + 1; i++)
+    overflow = false;
+    queue.reserve(64);
+}
+
+void CMSRInOutQue::clear()
+{
+    queue.clear();
+    overflow = false;
+}
+
+// Make room for count records at end of queue
+SMSRInOut* CMSRInOutQue::grow(int count)
+{
+    int n = GetSize();
+    if (count < 0 || n + count > MAX_QUE_ENTRIES)
     {
-        queue[i].msr_command = MSR_STOP;
+        overflow = true;
+        return NULL;
     }
+    queue.resize(n + count);
+    return &queue[n];
 }
 
 // Put data record in queue
 int CMSRInOutQue::put(
     EMSR_COMMAND msr_command, unsigned int register_number, unsigned int value_lo, unsigned int value_hi)
 {
-    assert(n < MAX_QUE_ENTRIES);
-    if (n >= MAX_QUE_ENTRIES)
+    SMSRInOut* p = grow(1);
+    if (!p)
+        return -10;
+
+    p->msr_command = msr_command;
+    p->register_number = register_number;
+    p->val[0] = value_lo;
+    p->val[1] = value_hi;
+    return 0;
+}
+
+// Put read-modify-write record in queue
+int CMSRInOutQue::putMasked(unsigned int register_number, long long value, long long mask)
+{
+    SMSRInOut* p = grow(2);
+    if (!p)
         return -10;
 
-    queue[n].msr_command = msr_command;
-    queue[n].register_number = register_number;
-    queue[n].val[0] = value_lo;
-    queue[n].val[1] = value_hi;
-    n++;
+    p[0].msr_command = MSR_WRITE_MASKED;
+    p[0].register_number = register_number;
+    p[0].value = value;
+    // the mask goes in the next record
+    p[1].msr_command = MSR_IGNORE;
+    p[1].register_number = register_number;
+    p[1].value = mask;
+    return 0;
+}
+
+// Put record for reading consecutive registers in queue, followed by one record for each result
+int CMSRInOutQue::putReadRange(unsigned int register_number, int count)
+{
+    SMSRInOut* p = grow(1 + count);
+    if (!p)
+        return -10;
+
+    p[0].msr_command = MSR_READ_RANGE;
+    p[0].register_number = register_number;
+    p[0].value = count;
+    for (int i = 1; i <= count; i++)
+    {
+        p[i].msr_command = MSR_IGNORE;
+        p[i].register_number = register_number + i - 1;
+        p[i].value = 0;
+    }
     return 0;
 }
 
@@ -682,14 +258,23 @@ CCounters::CCounters()
 
 CCounters::~CCounters()
 {
+    if (Active)
+        deinit();
 }
 
+// Number of active CCounters instances. The process priority is a process wide
+// setting, so it is raised by the first instance and restored by the last
+static std::atomic<int> ActiveInstances(0);
+
 bool CCounters::init(const int counters[], int count)
 {
-    assert(count <= MAXCOUNTERS);
+    if (Active)
+        deinit();
+    Reset();
 
     // Make program and driver use the same processor number
-    LockProcessor();
+    if (!LockProcessor())
+        return false;
 
     // Find counter definitions and put them in queue for driver
     QueueCounters(counters, count);
@@ -697,6 +282,51 @@ bool CCounters::init(const int counters[], int count)
     // only diagnostics info, don't run test
     // printf("%s\n", MSRCounters.getDiagnostic().c_str()); return 0;
 
+    return Start();
+}
+
+bool CCounters::init(const SEventSetProgram programs[], int numPrograms)
+{
+    if (Active)
+        deinit();
+    Reset();
+
+    // Find the program for the processor that the thread is locked to
+    if (!LockProcessor())
+        return false;
+    DetectProcessor();
+    const SEventSetProgram* program = NULL;
+    for (int i = 0; i < numPrograms; i++)
+    {
+        if (programs[i].scheme == MScheme && programs[i].family == MFamily && programs[i].status == EVENTSET_OK)
+            program = &programs[i];
+    }
+    const char* err = NULL;
+    if (Backend != BACKEND_DRIVER)
+        err = "Event sets require the MSR driver backend";
+    else if (!program)
+        err = "Event set not defined for present microprocessor family";
+    else
+        err = QueueEventSet(*program);
+    if (err)
+    {
+        printf("\nCannot start event set. %s\n", err);
+        return false;
+    }
+    Start();
+    if (!UsePMC)
+    {
+        // Start continues without the driver, but then the event set does not count
+        printf("\nCannot start event set. Failed to load driver\n");
+        deinit();
+        return false;
+    }
+    return true;
+}
+
+// Load driver, raise priority and start the counters in the queues
+bool CCounters::Start()
+{
     bool requirePMC = false; // continue without PMC is failed to load driver
     int err = StartDriver(); // Install and load driver
     if (err && requirePMC)
@@ -704,49 +334,131 @@ bool CCounters::init(const int counters[], int count)
         printf("Error: failed to load driver\n");
         return false;
     }
+    // The driver is needed for checking if the processor has PERF_METRICS
+    SetupTopdown();
+    SetupNoise();
+    if (!UsePMC && ClockSource != CLOCK_RDPRU)
+        ClockSource = CLOCK_NONE; // the clocks need the counters or the driver
     // Set high priority to minimize risk of interrupts during test
-    SetProcessPriorityHigh();
+    if (ActiveInstances++ == 0)
+        SetProcessPriorityHigh();
+#ifndef _WIN32
+    if (LowNoiseOptions.enabled)
+        lowNoise.enter(LowNoiseOptions);
+#endif
+    Active = true;
     StartCounters(); // Start MSR counters
+#ifndef _WIN32
+    if (ClockSource == CLOCK_PERF && !clockPerf.running())
+    {
+        // not enough counters for the clock group next to the counters of the test
+        printf("\nCore clock and reference clock not available. No counters left for them");
+        clockPerf.close();
+        ClockSource = CLOCK_NONE;
+    }
+#endif
     Sleep0(); // Wait for rest of timeslice
     return true;
 }
 
 void CCounters::deinit()
 {
+    if (!Active)
+        return;
     Sleep0(); // Wait for rest of timeslice
     StopCounters(); // Stop MSR counters
-    SetProcessPriorityNormal();
+    Active = false;
+#ifndef _WIN32
+    lowNoise.leave();
+#endif
+    if (--ActiveInstances == 0)
+        SetProcessPriorityNormal();
     CleanUp();
 }
 
-void CCounters::QueueCounters(const int counters[], int count)
+void CCounters::Reset()
 {
-    // Put counter definitions in queue
-    int n = 0, CounterType;
-    const char* err;
-    while (CounterDefinitions[n].ProcessorFamily || CounterDefinitions[n].CounterType)
-        n++;
-    NumCounterDefinitions = n;
+    // Forget the counters and queued commands of a previous init()
+    queue1.clear();
+    queue2.clear();
+    for (int i = 0; i < MAXCOUNTERS; i++)
+    {
+        CounterNames[i] = NULL;
+        CounterTypes[i] = 0;
+        Counters[i] = 0;
+        CounterMasks[i] = 0;
+        EventRegistersUsed[i] = 0;
+    }
+    NumCounters = 0;
+    UsePMC = 1;
+    CountersEnabled = false;
+    FixedCountersEnabled = false;
+    clockFactor = 1.0;
+    ClockSource = CLOCK_NONE;
+    Topdown = false;
+    NoiseMSRs = 0;
+#ifndef _WIN32
+    perf.close();
+    clockPerf.close();
+#endif
+}
 
+void CCounters::DetectProcessor()
+{
     // Get processor information
     GetProcessorVendor(); // get microprocessor vendor
     GetProcessorFamily(); // get microprocessor family
     GetPMCScheme();       // get PMC scheme
+}
+
+void CCounters::QueueCounters(const int counters[], int count)
+{
+    // Put counter definitions in queue
+    int CounterType;
+    const char* err;
+
+    DetectProcessor();
+
+    if (count > MAXCOUNTERS)
+    {
+        // the counters beyond MAXCOUNTERS are left out
+        for (int i = MAXCOUNTERS; i < count; i++)
+            printf("\nCannot make counter %i. Too many counters\n", i + 1);
+        count = MAXCOUNTERS;
+    }
 
     if (UsePMC)
     {
+        // Assign registers to all counters at once
+        const SCounterDefinition* defs[MAXCOUNTERS] = {};
+        int assigned[MAXCOUNTERS];
+        for (int i = 0; i < count; i++)
+            defs[i] = counters[i] ? FindCounterDefinition(counters[i]) : NULL;
+        AssignCounters(defs, count, assigned);
+
         // Get all counter requests
         for (int i = 0; i < count; i++)
         {
             CounterType = counters[i];
-            err = DefineCounter(CounterType);
+            if (Backend == BACKEND_PERF)
+                err = DefinePerfCounter(CounterType);
+            else if (!CounterType)
+                err = NULL;
+            else if (!defs[i])
+                err = "No matching counter definition found";
+            else if (assigned[i] < 0)
+                err = "Counter registers are already in use";
+            else
+                err = DefineCounter(*defs[i], assigned[i]);
             if (err)
             {
                 printf("\nCannot make counter %i. %s\n", i + 1, err);
             }
         }
 
-        if (MScheme == S_AMD2)
+        SetupClockProbe();
+
+        if (MScheme == S_AMD2 && Backend == BACKEND_DRIVER)
         {
             // AMD Zen processor has a core clock counter called APERF
             // which is only accessible in the driver.
@@ -759,12 +471,60 @@ void CCounters::QueueCounters(const int counters[], int count)
             queue2.put(MSR_READ, rCoreCounter, 0);
             // queue2.put(MSR_READ, rMPERF, 0);
         }
+
+        if (queue1.Overflow() || queue2.Overflow())
+        {
+            printf("\nMSR command queue is full. Max %i entries\n", MAX_QUE_ENTRIES);
+        }
+    }
+}
+
+// Put the MSR writes of an event set program in the queues (return value is error message)
+const char* CCounters::QueueEventSet(const SEventSetProgram& program)
+{
+    for (int i = 0; i < program.numCounters; i++)
+    {
+        const SEventSetCounter& c = program.counters[i];
+        bool fixed = c.selectMSR == 0;
+        if (fixed ? (c.rdpmc & 0xFF) >= NumFixedPMCs : c.rdpmc >= NumPMCs)
+            return "Event set needs more counters than available";
+        if (!fixed)
+        {
+            Put1(MSR_WRITE, c.selectMSR, (unsigned int)c.selectValue, (unsigned int)(c.selectValue >> 32));
+            Put2(MSR_WRITE, c.selectMSR, 0);
+        }
+        Put1(MSR_WRITE, c.counterMSR, 0);
+        Put2(MSR_WRITE, c.counterMSR, 0);
+        int width = fixed ? FixedPMCWidth : PMCWidth;
+        CounterNames[i] = c.name;
+        CounterTypes[i] = c.type;
+        CounterMasks[i] = width >= 64 ? ~0ULL : (1ULL << width) - 1;
+        Counters[i] = c.rdpmc;
+    }
+    NumCounters = program.numCounters;
+    if (program.fixedMask)
+    {
+        // Set MSR_PERF_FIXED_CTR_CTRL. Fields of other fixed counters are not changed
+        queue1.putMasked(0x38D, program.fixedControl, program.fixedMask);
+        queue2.putMasked(0x38D, 0, program.fixedMask);
+        FixedCountersEnabled = true;
+    }
+    if (program.globalEnable)
+    {
+        // set MSR_PERF_GLOBAL_CTRL. Bits of other counters are not changed
+        queue1.putMasked(0x38F, program.globalEnable, program.globalEnable);
+        queue2.putMasked(0x38F, 0, program.globalEnable);
+        CountersEnabled = true;
     }
+    if (queue1.Overflow() || queue2.Overflow())
+        return "MSR command queue is full";
+    return NULL;
 }
 
-void CCounters::LockProcessor()
+bool CCounters::LockProcessor()
 {
-    setDesiredCpu();
+    if (!setDesiredCpu())
+        return false; // don't program the counters of a processor the thread does not run on
 
     // Make program and driver use the same processor number if multiple processors
     // Enable RDMSR instruction
@@ -782,6 +542,7 @@ void CCounters::LockProcessor()
         queue2.put(PMC_DISABLE, 0, 0); // This causes segmentation fault on AMD when thread hopping. Why is
                                        // the processor not properly locked?
     }
+    return true;
 }
 
 int CCounters::StartDriver()
@@ -792,8 +553,16 @@ int CCounters::StartDriver()
 
     if (UsePMC)
     {
-        // Load driver
-        ErrNo = msr.LoadDriver();
+        if (Backend == BACKEND_PERF)
+        {
+            // perf_event counters were opened by DefinePerfCounter
+            ErrNo = NumCounters ? 0 : 1;
+        }
+        else
+        {
+            // Load driver
+            ErrNo = msr.LoadDriver();
+        }
         if (ErrNo)
             UsePMC = 0;
     }
@@ -806,7 +575,7 @@ void CCounters::CleanUp()
     // Things to do after measuring
 
     // Calculate clock correction factors for AMD Zen
-    if (MScheme == S_AMD2)
+    if (MScheme == S_AMD2 && Backend == BACKEND_DRIVER)
     {
         long long tscount, corecount;
         tscount = read2(rTSCounter) - read1(rTSCounter);
@@ -818,6 +587,14 @@ void CCounters::CleanUp()
         clockFactor = 1.0;
     }
 
+#ifndef _WIN32
+    perf.close();
+    clockPerf.close();
+#endif
+    ClockSource = CLOCK_NONE;
+    Topdown = false;
+    NoiseMSRs = 0;
+
     // Any required cleanup of driver etc
     // Optionally unload driver
     // msr.UnloadDriver();
@@ -840,6 +617,14 @@ static long long readImpl(const CMSRInOutQue& queue, unsigned int register_numbe
     {
         if (queue.queue[i].msr_command == MSR_READ && queue.queue[i].register_number == register_number)
             return queue.queue[i].value;
+        if (queue.queue[i].msr_command == MSR_READ_RANGE)
+        {
+            // results are in the following records
+            unsigned int k = register_number - queue.queue[i].register_number;
+            if (k < (unsigned int)queue.queue[i].value && i + 1 + (int)k < queue.GetSize())
+                return queue.queue[i + 1 + k].value;
+            i += (int)queue.queue[i].value;
+        }
     }
     return 0; // not found
 }
@@ -854,12 +639,64 @@ long long CCounters::read2(unsigned int register_number)
     return readImpl(queue2, register_number);
 }
 
+const char* CCounters::checkCommands()
+{
+    SMSRMemoryAccess access;
+    access.WriteMSR(0x38F, 0xF000000F0LL);
+    access.WriteMSR(0x309, 100);
+    access.WriteMSR(0x30A, 200);
+    access.WriteMSR(0x30B, 300);
+    access.WriteMSR(0xC1, 5); // PMC_READ of the memory backend reads the register
+
+    // records 0-1: masked write, 2-5: range of 3 registers, 6: TSC, 7: PMC, 8: TSC
+    CMSRInOutQue q;
+    q.putMasked(0x38F, 3, 0xF);
+    q.putReadRange(0x309, 3);
+    q.put(TSC_READ, 0, 0);
+    q.put(PMC_READ, 0xC1, 0);
+    q.put(TSC_READ, 0, 0);
+    int n = q.GetSize();
+    if (ExecuteMSRCommands(access, q.queue.data(), n, q.queue.data(), n))
+        return "Command queue failed";
+    long long v;
+    access.ReadMSR(0x38F, v);
+    if (v != 0xF000000F3LL || q.queue[0].value != 0xF000000F0LL || q.queue[1].value != v)
+        return "MSR_WRITE_MASKED gives wrong result";
+    if (q.queue[2].value != 3 || readImpl(q, 0x309) != 100 || readImpl(q, 0x30A) != 200 || readImpl(q, 0x30B) != 300)
+        return "MSR_READ_RANGE gives wrong result";
+    if (q.queue[6].value != 1 || q.queue[8].value != 2)
+        return "TSC_READ gives wrong result";
+    if (q.queue[7].value != 5)
+        return "PMC_READ gives wrong result";
+
+    // a range that exceeds the output
+    q.clear();
+    q.putReadRange(0x309, 3);
+    if (ExecuteMSRCommands(access, q.queue.data(), q.GetSize(), q.queue.data(), 2) != MSR_STATUS_BUFFER_TOO_SMALL)
+        return "MSR_READ_RANGE does not detect too small output";
+
+    // unknown command
+    SMSRInOut bad = {};
+    bad.msr_command = EMSR_COMMAND(99);
+    if (ExecuteMSRCommands(access, &bad, 1, &bad, 1) != MSR_STATUS_INVALID_COMMAND)
+        return "Unknown command not detected";
+    return NULL;
+}
+
 // Start counting
 void CCounters::StartCounters()
 {
     if (UsePMC)
     {
-        msr.AccessRegisters(queue1);
+#ifndef _WIN32
+        if (Backend == BACKEND_PERF)
+        {
+            perf.enable();
+            clockPerf.enable();
+            return;
+        }
+#endif
+        AccessQueue(queue1);
     }
 }
 
@@ -868,10 +705,50 @@ void CCounters::StopCounters()
 {
     if (UsePMC)
     {
-        msr.AccessRegisters(queue2);
+#ifndef _WIN32
+        if (Backend == BACKEND_PERF)
+        {
+            perf.disable();
+            clockPerf.disable();
+            return;
+        }
+#endif
+        AccessQueue(queue2);
     }
 }
 
+// Execute queue q on the test processor and on the processors of CpuSet. The results of
+// the test processor go to q
+void CCounters::AccessQueue(CMSRInOutQue& q)
+{
+    if (CpuSet.empty())
+    {
+        msr.AccessRegisters(q);
+        return;
+    }
+#ifdef _WIN32
+    // The driver works on one processor per call, selected by PROC_SET
+    for (int cpu : CpuSet)
+    {
+        CMSRInOutQue other = q;
+        for (SMSRInOut& r : other.queue)
+        {
+            if (r.msr_command == PROC_SET)
+                r.val[0] = cpu;
+        }
+        msr.AccessRegisters(other);
+    }
+    msr.AccessRegisters(q);
+#else
+    // all processors at once from the worker threads of the driver
+    std::vector<int> cpus(1, ProcNum0);
+    cpus.insert(cpus.end(), CpuSet.begin(), CpuSet.end());
+    std::vector<CMSRInOutQue> results;
+    if (msr.AccessRegisters(q, cpus.data(), (int)cpus.size(), results) == 0)
+        q = results[0];
+#endif
+}
+
 void CCounters::GetProcessorVendor()
 {
     // get microprocessor vendor
@@ -1049,12 +926,14 @@ void CCounters::GetPMCScheme()
     MScheme = S_UNKNOWN;
     NumPMCs = 2;
     NumFixedPMCs = 0;
+    PMCWidth = FixedPMCWidth = 40;
 
     if (MVendor == AMD)
     {
         // AMD processor
         MScheme = S_AMD;
         NumPMCs = 4;
+        PMCWidth = 48;
         int CpuIdOutput[4];
         Cpuid(CpuIdOutput, 6); // Call cpuid function 6
         if (CpuIdOutput[2] & 1)
@@ -1094,6 +973,9 @@ void CCounters::GetPMCScheme()
                 NumPMCs = (CpuIdOutput[0] >> 8) & 0xFF;
                 // NumFixedPMCs = CpuIdOutput[0] & 0x1F;
                 NumFixedPMCs = CpuIdOutput[3] & 0x1F;
+                PMCWidth = (CpuIdOutput[0] >> 16) & 0xFF;
+                if (CpuIdOutput[0] & 0xFE)
+                    FixedPMCWidth = (CpuIdOutput[3] >> 5) & 0xFF; // version 2 and later
                 // printf("\nCounters:\nMScheme = 0x%X, NumPMCs = %i, NumFixedPMCs = %i\n\n", MScheme, NumPMCs,
                 // NumFixedPMCs);
             }
@@ -1130,21 +1012,166 @@ void CCounters::GetPMCScheme()
     }
 }
 
+// Search for matching counter definition (return NULL if not found)
+const SCounterDefinition* CCounters::FindCounterDefinition(int CounterType) const
+{
+    const SCounterDefinition* p = LoadedEvents.find(CounterType, MScheme, MFamily);
+    if (!p)
+        p = CompiledEvents().find(CounterType, MScheme, MFamily);
+    return p;
+}
+
+// Load counter definitions from a JSON file (return value is error message)
+const char* CCounters::loadEvents(const char* filename)
+{
+    return LoadedEvents.load(filename);
+}
+
+// Counter type of the event with this name on the present processor (0 if not found)
+int CCounters::findCounterType(const char* name)
+{
+    DetectProcessor();
+    const SCounterDefinition* p = LoadedEvents.find(name, MScheme, MFamily);
+    if (!p)
+        p = CompiledEvents().find(name, MScheme, MFamily);
+    if (p)
+        return p->CounterType;
+    if (!strchr(name, '='))
+        return 0;
+
+    // raw event specification. Add it to the loaded events, named by the specification
+    SCounterDefinition def;
+    const char* err = ParseEventSpec(name, def);
+    if (err)
+    {
+        printf("\n%s: %s", name, err);
+        return 0;
+    }
+    return LoadedEvents.add(def, name);
+}
+
+// Name of a counter type on the present processor (NULL if not available)
+const char* CCounters::findCounterName(int CounterType)
+{
+    DetectProcessor();
+    const SCounterDefinition* p = FindCounterDefinition(CounterType);
+    return p ? p->Description : NULL;
+}
+
+// Search for matching metric definition (return NULL if not found)
+const SMetricDefinition* CCounters::findMetric(int MetricType)
+{
+    DetectProcessor();
+    for (const SMetricDefinition& m : MetricDefinitions)
+    {
+        if (m.MetricType == MetricType && (m.PMCScheme & MScheme) && (m.ProcessorFamily & MFamily))
+            return &m;
+    }
+    return NULL;
+}
+
+// compare names, not case sensitive
+static bool SameName(const char* a, const char* b)
+{
+    for (; *a && toupper((unsigned char)*a) == toupper((unsigned char)*b); a++, b++)
+        ;
+    return *a == *b;
+}
+
+const SMetricDefinition* CCounters::findMetric(const char* name)
+{
+    DetectProcessor();
+    for (const SMetricDefinition& m : MetricDefinitions)
+    {
+        if (SameName(m.Description, name) && (m.PMCScheme & MScheme) && (m.ProcessorFamily & MFamily))
+            return &m;
+    }
+    return NULL;
+}
+
+// Read raw event specification like "event=0xa3,umask=0x14,cmask=20,edge,usr,os"
+// for the present processor (return value is error message)
+const char* CCounters::ParseEventSpec(const char* spec, SCounterDefinition& def) const
+{
+    bool intel = (MScheme & (S_P2 | S_ID1 | S_ID2 | S_ID3 | S_ID4 | S_ID5)) != 0;
+    bool amd = (MScheme & (S_AMD | S_AMD2)) != 0;
+    if (!intel && !amd)
+        return "Raw events not supported on present microprocessor family";
+
+    def.CounterType = 0;
+    def.PMCScheme = MScheme;
+    def.ProcessorFamily = MFamily;
+    def.CounterFirst = 0;
+    def.CounterLast = (NumPMCs > 0 ? NumPMCs : 2) - 1;
+    def.EventSelectReg = 0;
+    def.Event = -1;
+    def.EventMask = 0;
+    def.Description = spec;
+    def.Modifiers = 0;
+
+    std::string term;
+    for (const char* s = spec; *s; )
+    {
+        size_t n = strcspn(s, ",");
+        term.assign(s, n);
+        s += n;
+        if (*s)
+            s++;
+        size_t eq = term.find('=');
+        std::string key = term.substr(0, eq);
+        long value = 0;
+        if (eq != std::string::npos)
+        {
+            char* e;
+            value = strtol(term.c_str() + eq + 1, &e, 0);
+            if (*e || e == term.c_str() + eq + 1 || value < 0)
+                return "Invalid number in event specification";
+        }
+        if (key == "event")
+            def.Event = (int)value;
+        else if (key == "umask")
+            def.EventMask = (int)value;
+        else if (key == "cmask")
+        {
+            if (value > 0xFF)
+                return "cmask must be less than 256";
+            def.Modifiers = (def.Modifiers & ~MOD_CMASK) | (unsigned int)value << 24;
+        }
+        else if (eq != std::string::npos)
+            return "Unknown term in event specification";
+        else if (key == "edge")
+            def.Modifiers |= MOD_EDGE;
+        else if (key == "inv")
+            def.Modifiers |= MOD_INV;
+        else if (key == "any")
+            def.Modifiers |= MOD_ANY;
+        else if (key == "usr")
+            def.Modifiers |= MOD_USR;
+        else if (key == "os")
+            def.Modifiers |= MOD_OS;
+        else if (!key.empty())
+            return "Unknown term in event specification";
+    }
+
+    if (def.Event < 0)
+        return "Event specification has no event";
+    if (def.Event > (amd ? 0xFFF : 0xFF))
+        return amd ? "AMD event number must be less than 0x1000" : "Intel event number must be less than 0x100";
+    if (def.EventMask > 0xFF)
+        return "umask must be less than 256";
+    if ((def.Modifiers & MOD_ANY) && !(MScheme & (S_ID3 | S_ID4)))
+        return "any is not supported on present microprocessor family";
+    return NULL;
+}
+
 // Request a counter setup (return value is error message)
 const char* CCounters::DefineCounter(int CounterType)
 {
     if (CounterType == 0)
         return NULL;
-    int i;
-    const SCounterDefinition* p;
 
-    // Search for matching counter definition
-    for (i = 0, p = CounterDefinitions; i < NumCounterDefinitions; i++, p++)
-    {
-        if (p->CounterType == CounterType && (p->PMCScheme & MScheme) && (p->ProcessorFamily & MFamily))
-            break; // Match found
-    }
-    if (i >= NumCounterDefinitions)
+    const SCounterDefinition* p = FindCounterDefinition(CounterType);
+    if (!p)
     {
         // printf("\nCounterType = %X, MScheme = %X, MFamily = %X\n", CounterType, MScheme, MFamily);
         return "No matching counter definition found"; // not found in list
@@ -1152,70 +1179,494 @@ const char* CCounters::DefineCounter(int CounterType)
     return DefineCounter(*p);
 }
 
-// Request a counter setup (return value is error message)
-const char* CCounters::DefineCounter(const SCounterDefinition& CDef)
+// Request a perf_event counter setup (return value is error message)
+const char* CCounters::DefinePerfCounter(int CounterType)
 {
-    int counternr, a, b, reg, eventreg, tag;
-    static int CountersEnabled = 0, FixedCountersEnabled = 0;
+#ifdef _WIN32
+    (void)CounterType;
+    return "perf_event counters are only available on Linux";
+#else
+    if (CounterType == 0)
+        return NULL;
+    if (NumCounters >= MAXCOUNTERS)
+        return "Too many counters";
 
-    if (!(CDef.ProcessorFamily & MFamily))
+    uint32_t type = PERF_TYPE_HARDWARE;
+    uint64_t config;
+    const char* name;
+    bool user = true, kernel = false;
+    const SCounterDefinition* p = FindCounterDefinition(CounterType);
+
+    // Intel fixed function counters and their equivalents are generic perf events,
+    // the kernel knows how to count them on any processor
+    int fixed = -1;
+    if (p && (p->CounterFirst & 0x40000000))
+        fixed = p->CounterFirst & 0xFF;
+    else if (CounterType == 9 || CounterType == 1 || CounterType == 2)
+        fixed = CounterType == 9 ? 0 : CounterType;
+
+    switch (fixed)
     {
-        return "Counter not defined for present microprocessor family";
+    case 0:
+        config = PERF_COUNT_HW_INSTRUCTIONS;
+        name = "Instruct";
+        break;
+    case 1:
+        config = PERF_COUNT_HW_CPU_CYCLES;
+        name = "Core cyc";
+        break;
+    case 2:
+        config = PERF_COUNT_HW_REF_CPU_CYCLES;
+        name = "Ref cyc";
+        break;
+    default:
+        if (fixed >= 0)
+            return "Fixed counter not available as perf_event";
+        if (!p)
+            return "No matching counter definition found";
+        if (MScheme & (S_ID1 | S_ID23 | S_P2))
+        {
+            // Intel PERFEVTSEL layout without enable and privilege bits
+            type = PERF_TYPE_RAW;
+            config = (p->Event & 0xFF) | (uint64_t)(p->EventMask & 0xFF) << 8;
+        }
+        else if (MScheme & (S_AMD | S_AMD2))
+        {
+            // AMD event select bits 8-11 go to bits 32-35
+            type = PERF_TYPE_RAW;
+            config = (p->Event & 0xFF) | (uint64_t)(p->EventMask & 0xFF) << 8 | (uint64_t)(p->Event >> 8 & 0xF) << 32;
+        }
+        else
+        {
+            return "Counter not supported by perf_event on present microprocessor family";
+        }
+        // edge, any, inv and cmask have the same bits in the raw config. User and kernel
+        // mode are selected with exclude_user and exclude_kernel
+        config |= p->Modifiers & (MOD_EDGE | MOD_ANY | MOD_INV | MOD_CMASK);
+        if (p->Modifiers & (MOD_USR | MOD_OS))
+        {
+            user = (p->Modifiers & MOD_USR) != 0;
+            kernel = (p->Modifiers & MOD_OS) != 0;
+        }
+        name = p->Description;
+    }
+
+    int err = perf.open(type, config, user, kernel);
+    if (err && type == PERF_TYPE_HARDWARE && config == PERF_COUNT_HW_CPU_CYCLES)
+    {
+        // No hardware PMU, e.g. in a container or virtual machine.
+        // Fall back to the software clock, in nanoseconds
+        err = perf.open(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK);
+        name = "Task ns";
+    }
+    if (err)
+    {
+        printf("\nperf_event_open error %i: %s", err, strerror(err));
+        return "Cannot open perf_event";
     }
-    if (NumCounters >= MAXCOUNTERS)
-        return "Too many counters";
 
+    // Save name and event number. The perf_event count is always 64 bits
+    CounterNames[NumCounters] = name;
+    CounterTypes[NumCounters] = CounterType;
+    CounterMasks[NumCounters] = ~0ULL;
+    Counters[NumCounters++] = perf.count() - 1;
+    return NULL;
+#endif
+}
+
+// Find a counter register for CDef that is not in used[0..numUsed-1] and, on P4, whose
+// event select register ESCR is not in usedEventRegs[]. Returns -1 if none is vacant
+int CCounters::FindVacantCounter(const SCounterDefinition& CDef, const int used[], const int usedEventRegs[], int numUsed) const
+{
     if (CDef.CounterFirst & 0x40000000)
     {
         // Fixed function counter
-        counternr = CDef.CounterFirst;
+        return CDef.CounterFirst;
     }
-    else
-    {
-        // check CounterLast
-        int CounterLast = CDef.CounterLast < CDef.CounterFirst ? CDef.CounterFirst : CDef.CounterLast;
 
-        // Find vacant counter
-        for (counternr = CDef.CounterFirst; counternr <= CounterLast; counternr++)
+    // check CounterLast
+    int CounterLast = CDef.CounterLast < CDef.CounterFirst ? CDef.CounterFirst : CDef.CounterLast;
+
+    // Find vacant counter
+    for (int counternr = CDef.CounterFirst; counternr <= CounterLast; counternr++)
+    {
+        // Check if this counter register is already in use
+        for (int i = 0; i < numUsed; i++)
+        {
+            if (counternr == used[i])
+            {
+                // This counter is already in use, find another
+                goto USED;
+            }
+        }
+        if (MFamily == INTEL_P4)
         {
-            // Check if this counter register is already in use
-            for (int i = 0; i < NumCounters; i++)
+            // Check if the corresponding event register ESCR is already in use
+            int eventreg = GetP4EventSelectRegAddress(counternr, CDef.EventSelectReg);
+            for (int i = 0; i < numUsed; i++)
             {
-                if (counternr == Counters[i])
+                if (usedEventRegs[i] == eventreg)
                 {
-                    // This counter is already in use, find another
                     goto USED;
                 }
             }
-            if (MFamily == INTEL_P4)
+        }
+
+        // Vacant counter found
+        return counternr;
+
+    USED:;
+        // This counter is occupied. keep searching
+    }
+    return -1;
+}
+
+// Candidate registers for a counter definition, in order of preference
+static void CandidateCounters(const SCounterDefinition& CDef, std::vector<int>& candidates)
+{
+    candidates.clear();
+    if (CDef.CounterFirst & 0x40000000)
+    {
+        // Fixed function counter
+        candidates.push_back(CDef.CounterFirst);
+        return;
+    }
+    int CounterLast = CDef.CounterLast < CDef.CounterFirst ? CDef.CounterFirst : CDef.CounterLast;
+    for (int counternr = CDef.CounterFirst; counternr <= CounterLast; counternr++)
+        candidates.push_back(counternr);
+}
+
+// Augmenting path search for bipartite matching of counter definitions to registers.
+// Give definition e a register, moving other definitions to other registers if necessary.
+// A vacant register is taken first, so the result is the first-fit assignment when that works
+static bool AugmentCounter(int e, const std::vector<std::vector<int>>& candidates, std::map<int, int>& owner,
+    int assigned[], std::vector<int>& visited)
+{
+    for (int r : candidates[e])
+    {
+        if (!owner.count(r))
+        {
+            owner[r] = e;
+            assigned[e] = r;
+            return true;
+        }
+    }
+    for (int r : candidates[e])
+    {
+        if (std::find(visited.begin(), visited.end(), r) != visited.end())
+            continue;
+        visited.push_back(r);
+        if (AugmentCounter(owner[r], candidates, owner, assigned, visited))
+        {
+            owner[r] = e;
+            assigned[e] = r;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Backtracking search for P4, where the counters and their ESCR event select registers must
+// all be different. Assigns defs[active[k..]] given the assignments of active[0..k-1]
+bool CCounters::AssignP4Counters(const SCounterDefinition* const defs[], const std::vector<int>& active, int k,
+    int assigned[], int eventRegs[]) const
+{
+    if (k == (int)active.size())
+        return true;
+    int e = active[k];
+    std::vector<int> candidates;
+    CandidateCounters(*defs[e], candidates);
+    for (int r : candidates)
+    {
+        int eventreg = GetP4EventSelectRegAddress(r, defs[e]->EventSelectReg);
+        bool vacant = true;
+        for (int j = 0; j < k; j++)
+        {
+            if (assigned[active[j]] == r || eventRegs[active[j]] == eventreg)
+                vacant = false;
+        }
+        if (!vacant)
+            continue;
+        assigned[e] = r;
+        eventRegs[e] = eventreg;
+        if (AssignP4Counters(defs, active, k + 1, assigned, eventRegs))
+            return true;
+    }
+    assigned[e] = -1;
+    return false;
+}
+
+// Assign counter registers to the counter definitions defs[0..n-1]. NULL entries are skipped.
+// Each definition in turn gets a register if it can be counted together with the definitions
+// before it, moving those to other registers if necessary. The result depends only on the
+// list, and it is the same as the first-fit search of FindVacantCounter whenever that works.
+// assigned[i] receives the register number for defs[i], or -1
+void CCounters::AssignCounters(const SCounterDefinition* const defs[], int n, int assigned[]) const
+{
+    for (int i = 0; i < n; i++)
+        assigned[i] = -1;
+
+    if (MScheme == S_P4)
+    {
+        std::vector<int> active; // definitions that fit together
+        std::vector<int> eventRegs(n, 0);
+        for (int i = 0; i < n; i++)
+        {
+            if (!defs[i])
+                continue;
+            active.push_back(i);
+            if (!AssignP4Counters(defs, active, 0, assigned, eventRegs.data()))
+                active.pop_back();
+        }
+        for (int i = 0; i < n; i++)
+            assigned[i] = -1;
+        AssignP4Counters(defs, active, 0, assigned, eventRegs.data());
+        return;
+    }
+
+    std::vector<std::vector<int>> candidates(n);
+    std::map<int, int> owner; // definition using each register
+    std::vector<int> visited;
+    for (int i = 0; i < n; i++)
+    {
+        if (!defs[i])
+            continue;
+        CandidateCounters(*defs[i], candidates[i]);
+        visited.clear();
+        AugmentCounter(i, candidates, owner, assigned, visited);
+    }
+}
+
+// Check if the counter types can be counted at the same time. *available is set
+// to false if a counter type is not defined for this processor
+bool CCounters::CountersFit(const int counters[], int count, bool* available) const
+{
+    const SCounterDefinition* defs[MAXCOUNTERS] = {};
+    int assigned[MAXCOUNTERS];
+    int numGeneral = 0;
+    if (available)
+        *available = true;
+    if (count > MAXCOUNTERS)
+        return false;
+
+    for (int i = 0; i < count; i++)
+    {
+        defs[i] = NULL;
+        if (counters[i] == 0)
+            continue;
+        const SCounterDefinition* p = FindCounterDefinition(counters[i]);
+        if (Backend == BACKEND_PERF)
+        {
+            // The kernel assigns the registers. Cycles and instructions go to fixed
+            // counters in Intel, all other events need a general counter
+            bool generic = counters[i] == 1 || counters[i] == 2 || counters[i] == 9;
+            if (!p && !generic)
             {
-                // Check if the corresponding event register ESCR is already in use
-                eventreg = GetP4EventSelectRegAddress(counternr, CDef.EventSelectReg);
-                for (int i = 0; i < NumCounters; i++)
-                {
-                    if (EventRegistersUsed[i] == eventreg)
-                    {
-                        goto USED;
-                    }
-                }
+                if (available)
+                    *available = false;
+                return false;
             }
+            bool fixed = (p && (p->CounterFirst & 0x40000000)) || generic;
+            if (!(fixed && MVendor == INTEL) && ++numGeneral > NumPMCs && NumPMCs > 0)
+                return false;
+            continue;
+        }
+        if (!p)
+        {
+            if (available)
+                *available = false;
+            return false;
+        }
+        defs[i] = p;
+    }
+    if (Backend == BACKEND_PERF)
+        return true;
 
-            // Vacant counter found. stop searching
-            break;
+    AssignCounters(defs, count, assigned);
+    for (int i = 0; i < count; i++)
+    {
+        if (defs[i] && assigned[i] < 0)
+            return false;
+    }
+    return true;
+}
+
+// Maximum number of steps in the search for a division into fewer passes
+static const long PLAN_SEARCH_LIMIT = 100000;
 
-        USED:;
-            // This counter is occupied. keep searching
+// Search for a division of events[k..] into at most maxPasses passes, each of which fits
+// together with the anchors. pass[i] receives the pass number of events[i]. Returns 1 if
+// found, 0 if not, -1 if the search limit was reached
+int CCounters::SearchPasses(const std::vector<int>& events, const std::vector<int>& anchors, int k, int maxPasses,
+    int usedPasses, std::vector<int>& pass, long& nodes) const
+{
+    if (k == (int)events.size())
+        return 1;
+    if (--nodes < 0)
+        return -1;
+    // Put event k into one of the passes in use or into the next new pass. Passes are
+    // numbered in order of first use, so each division is only tried once
+    for (int p = 0; p < usedPasses + 1 && p < maxPasses; p++)
+    {
+        std::vector<int> group = anchors;
+        for (int i = 0; i < k; i++)
+        {
+            if (pass[i] == p)
+                group.push_back(events[i]);
         }
+        group.push_back(events[k]);
+        if (!CountersFit(group.data(), (int)group.size()))
+            continue;
+        pass[k] = p;
+        int r = SearchPasses(events, anchors, k + 1, maxPasses, p == usedPasses ? usedPasses + 1 : usedPasses, pass, nodes);
+        if (r)
+            return r;
+    }
+    return 0;
+}
+
+int CCounters::planPasses(const int counters[], int count, const int anchors[], int numAnchors,
+    std::vector<std::vector<int>>& passes)
+{
+    DetectProcessor();
+    passes.clear();
 
-        if (counternr > CounterLast)
+    // anchors that are available on this processor, without duplicates
+    std::vector<int> anchorList;
+    for (int i = 0; i < numAnchors; i++)
+    {
+        if (!anchors[i] || std::find(anchorList.begin(), anchorList.end(), anchors[i]) != anchorList.end())
+            continue;
+        anchorList.push_back(anchors[i]);
+        if (!CountersFit(anchorList.data(), (int)anchorList.size()))
+            anchorList.pop_back();
+    }
+
+    // counters that can be counted together with the anchors. The rest get a pass of their own
+    std::vector<int> events, alone;
+    for (int i = 0; i < count; i++)
+    {
+        int type = counters[i];
+        if (!type || std::find(anchorList.begin(), anchorList.end(), type) != anchorList.end() ||
+            std::find(events.begin(), events.end(), type) != events.end() ||
+            std::find(alone.begin(), alone.end(), type) != alone.end())
+            continue;
+        std::vector<int> group = anchorList;
+        group.push_back(type);
+        bool available = true;
+        if (CountersFit(group.data(), (int)group.size(), &available))
+            events.push_back(type);
+        else if (CountersFit(&type, 1, &available))
+            alone.push_back(type);
+        else
+            printf("\nCannot make counter type %i. %s\n", type,
+                available ? "Counter registers are already in use" : "No matching counter definition found");
+    }
+
+    // Place the most constrained counters first: those with the fewest candidate registers.
+    // The sort is stable, so the order of the list decides between equals
+    std::vector<int> restrictedness(events.size(), MAXCOUNTERS);
+    for (size_t i = 0; i < events.size(); i++)
+    {
+        const SCounterDefinition* p = FindCounterDefinition(events[i]);
+        if (p && Backend == BACKEND_DRIVER)
         {
-            // No vacant counter found
-            return "Counter registers are already in use";
+            std::vector<int> candidates;
+            CandidateCounters(*p, candidates);
+            restrictedness[i] = (int)candidates.size();
         }
     }
+    std::vector<int> order(events.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = (int)i;
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return restrictedness[a] < restrictedness[b]; });
+    std::vector<int> sorted;
+    for (int i : order)
+        sorted.push_back(events[i]);
+
+    // First-fit division into passes
+    std::vector<int> pass(sorted.size(), 0);
+    int numPasses = 0;
+    for (size_t k = 0; k < sorted.size(); k++)
+    {
+        int p;
+        for (p = 0; p < numPasses; p++)
+        {
+            std::vector<int> group = anchorList;
+            for (size_t i = 0; i < k; i++)
+            {
+                if (pass[i] == p)
+                    group.push_back(sorted[i]);
+            }
+            group.push_back(sorted[k]);
+            if (CountersFit(group.data(), (int)group.size()))
+                break;
+        }
+        pass[k] = p;
+        if (p == numPasses)
+            numPasses++;
+    }
+
+    // Look for a division into fewer passes. The search is limited, so a very long list
+    // may keep the first-fit division
+    for (int maxPasses = 1; maxPasses < numPasses; maxPasses++)
+    {
+        std::vector<int> trial(sorted.size(), 0);
+        long nodes = PLAN_SEARCH_LIMIT;
+        int r = SearchPasses(sorted, anchorList, 0, maxPasses, 0, trial, nodes);
+        if (r == 1)
+        {
+            pass = trial;
+            numPasses = maxPasses;
+            break;
+        }
+        if (r < 0)
+            break;
+    }
+
+    // Make the passes. Counters keep their order from the list within each pass
+    for (int p = 0; p < numPasses; p++)
+    {
+        std::vector<int> group = anchorList;
+        for (int type : events)
+        {
+            size_t k = std::find(sorted.begin(), sorted.end(), type) - sorted.begin();
+            if (pass[k] == p)
+                group.push_back(type);
+        }
+        passes.push_back(group);
+    }
+    for (int type : alone)
+        passes.push_back(std::vector<int>(1, type));
+    if (passes.empty() && !anchorList.empty())
+        passes.push_back(anchorList);
+    return (int)passes.size();
+}
+
+// Request a counter setup (return value is error message)
+const char* CCounters::DefineCounter(const SCounterDefinition& CDef, int counternr)
+{
+    int a, b, reg, eventreg, tag;
+    int width = CDef.CounterFirst & 0x40000000 ? FixedPMCWidth : PMCWidth; // bits read by RDPMC
+
+    if (!(CDef.ProcessorFamily & MFamily))
+    {
+        return "Counter not defined for present microprocessor family";
+    }
+    if (NumCounters >= MAXCOUNTERS)
+        return "Too many counters";
+
+    if (counternr < 0)
+        counternr = FindVacantCounter(CDef, Counters, EventRegistersUsed, NumCounters);
+    if (counternr < 0)
+    {
+        // No vacant counter found
+        return "Counter registers are already in use";
+    }
 
     // Vacant counter found. Save name
     CounterNames[NumCounters] = CDef.Description;
+    CounterTypes[NumCounters] = CDef.CounterType;
 
     // Put MSR commands for this counter in queues
     switch (MScheme)
@@ -1241,36 +1692,17 @@ const char* CCounters::DefineCounter(const SCounterDefinition& CDef)
         if (counternr & 0x40000000)
         {
             // This is a fixed function counter
-            if (!(FixedCountersEnabled++))
-            {
-                // Enable fixed function counters
-                for (int i = a = 0; i < NumFixedPMCs; i++)
-                {
-                    b = 2; // 1=privileged level, 2=user level, 4=any thread
-                    a |= b << (4 * i);
-                }
-                // Set MSR_PERF_FIXED_CTR_CTRL
-                Put1(MSR_WRITE, 0x38D, a);
-                Put2(MSR_WRITE, 0x38D, 0);
-            }
+            EnableFixedCounters();
             break;
         }
-        if (!(CountersEnabled++))
-        {
-            // Enable counters
-            a = (1 << NumPMCs) - 1;      // one bit for each pmc counter
-            b = (1 << NumFixedPMCs) - 1; // one bit for each fixed counter
-            // set MSR_PERF_GLOBAL_CTRL
-            Put1(MSR_WRITE, 0x38F, a, b);
-            Put2(MSR_WRITE, 0x38F, 0);
-        }
+        EnableGlobalCounters();
         // All other counters continue in next case:
 
     case S_P2:
     case S_ID1:
         // Pentium Pro, Pentium II, Pentium III, Pentium M, Core 1, (Core 2 continued):
 
-        a = CDef.Event | (CDef.EventMask << 8) | (1 << 16) | (1 << 22);
+        a = CDef.Event | (CDef.EventMask << 8) | EventSelectModifiers(CDef.Modifiers) | (1 << 22);
         if (MScheme == S_ID1)
             a |= (1 << 14); // Means this core only
         // if (MScheme == S_ID3) a |= (1 << 22);  // Means any thread in this core!
@@ -1302,16 +1734,18 @@ const char* CCounters::DefineCounter(const SCounterDefinition& CDef)
         reg = counternr + 0x300;
         Put1(MSR_WRITE, reg, 0);
         Put2(MSR_WRITE, reg, 0);
-        // Set high bit for fast readpmc
+        // Set high bit for fast readpmc. This reads only the low 32 bits
         counternr |= 0x80000000;
+        width = 32;
         break;
 
     case S_AMD:
         // AMD
-        a = CDef.Event | (CDef.EventMask << 8) | (1 << 16) | (1 << 22);
+        a = (CDef.Event & 0xFF) | (CDef.EventMask << 8) | EventSelectModifiers(CDef.Modifiers) | (1 << 22);
+        b = CDef.Event >> 8 & 0xF; // event select bits 8-11 go to bits 32-35
         eventreg = 0xc0010000 + counternr;
         reg = 0xc0010004 + counternr;
-        Put1(MSR_WRITE, eventreg, a);
+        Put1(MSR_WRITE, eventreg, a, b);
         Put2(MSR_WRITE, eventreg, 0);
         Put1(MSR_WRITE, reg, 0);
         Put2(MSR_WRITE, reg, 0);
@@ -1320,8 +1754,9 @@ const char* CCounters::DefineCounter(const SCounterDefinition& CDef)
     case S_AMD2:
         // AMD Zen
         reg = 0xC0010200 + counternr * 2;
-        b = CDef.Event | (CDef.EventMask << 8) | (1 << 16) | (1 << 22);
-        Put1(MSR_WRITE, reg, b);
+        a = (CDef.Event & 0xFF) | (CDef.EventMask << 8) | EventSelectModifiers(CDef.Modifiers) | (1 << 22);
+        b = CDef.Event >> 8 & 0xF; // event select bits 8-11 go to bits 32-35
+        Put1(MSR_WRITE, reg, a, b);
         Put2(MSR_WRITE, reg, 0);
         break;
 
@@ -1340,7 +1775,11 @@ const char* CCounters::DefineCounter(const SCounterDefinition& CDef)
         return "No counters defined for present microprocessor family";
     }
 
-    // Save counter register number in Counters list
+    if (queue1.Overflow() || queue2.Overflow())
+        return "MSR command queue is full";
+
+    // Save counter register number and width in Counters list
+    CounterMasks[NumCounters] = width >= 64 ? ~0ULL : (1ULL << width) - 1;
     Counters[NumCounters++] = counternr;
 
     return NULL; // NULL = success
@@ -1399,15 +1838,314 @@ std::string CCounters::getDiagnostic() const
     return buf;
 }
 
-void CCounters::setDesiredCpu()
+// Enable fixed function counters in Intel Core 2 and later, once for each init()
+void CCounters::EnableFixedCounters()
+{
+    if (FixedCountersEnabled)
+        return;
+    FixedCountersEnabled = true;
+    long long a = 0, mask = 0;
+    for (int i = 0; i < NumFixedPMCs; i++)
+    {
+        int b = 2; // 1=privileged level, 2=user level, 4=any thread
+        a |= (long long)b << (4 * i);
+        mask |= 0xFLL << (4 * i);
+    }
+    // Set MSR_PERF_FIXED_CTR_CTRL. Fields of other fixed counters are not changed
+    queue1.putMasked(0x38D, a, mask);
+    queue2.putMasked(0x38D, 0, mask);
+}
+
+// Enable all counters in MSR_PERF_GLOBAL_CTRL in Intel Core 2 and later, once for each init()
+void CCounters::EnableGlobalCounters()
+{
+    if (CountersEnabled)
+        return;
+    CountersEnabled = true;
+    int a = (1 << NumPMCs) - 1;      // one bit for each pmc counter
+    int b = (1 << NumFixedPMCs) - 1; // one bit for each fixed counter
+    // set MSR_PERF_GLOBAL_CTRL. Bits of other counters are not changed
+    long long enable = (unsigned int)a | (long long)b << 32;
+    queue1.putMasked(0x38F, enable, enable);
+    queue2.putMasked(0x38F, 0, enable);
+}
+
+// true if the processor has the RDPRU instruction for reading APERF and MPERF in user mode
+static bool HasRdpru()
+{
+#ifdef _MSC_VER
+    return false; // Readpru is not implemented
+#else
+    int abcd[4];
+    Cpuid(abcd, 0x80000000);
+    if ((unsigned int)abcd[0] < 0x80000008)
+        return false;
+    Cpuid(abcd, 0x80000008);
+    return (abcd[1] >> 4 & 1) != 0; // EBX bit 4
+#endif
+}
+
+// Set up the counters used by readClocks
+void CCounters::SetupClockProbe()
+{
+    ClockSource = CLOCK_NONE;
+    if (MScheme == S_AMD2 && HasRdpru())
+    {
+        // APERF and MPERF in user mode, with any backend
+        ClockSource = CLOCK_RDPRU;
+        return;
+    }
+    if (Backend == BACKEND_PERF)
+    {
+#ifndef _WIN32
+        if (clockPerf.open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES) == 0 &&
+            clockPerf.open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_REF_CPU_CYCLES) == 0)
+            ClockSource = CLOCK_PERF;
+        else
+            clockPerf.close();
+#endif
+        return;
+    }
+    switch (MScheme)
+    {
+    case S_ID2:
+    case S_ID3:
+    case S_ID4:
+    case S_ID5:
+        // fixed counter 1 = core clock cycles, fixed counter 2 = reference cycles
+        if (NumFixedPMCs >= 3)
+        {
+            EnableFixedCounters();
+            EnableGlobalCounters();
+            ClockSource = CLOCK_FIXED;
+        }
+        break;
+    case S_AMD2:
+        // APERF and MPERF are read through the driver
+        ClockSource = CLOCK_DRIVER;
+        break;
+    default:
+        break;
+    }
+}
+
+// Bits of topdown slots (fixed counter 3) and PERF_METRICS in MSR_PERF_GLOBAL_CTRL
+static const long long TopdownGlobalEnable = 1LL << 35 | 1LL << 48;
+
+// Enable topdown slots and PERF_METRICS in Intel Ice Lake and later if requested by setTopdown
+void CCounters::SetupTopdown()
+{
+    Topdown = false;
+    if (!TopdownRequested || !UsePMC || Backend != BACKEND_DRIVER || MScheme != S_ID5 ||
+        !(MFamily & (INTEL_ICE | INTEL_GOLDCV)) || NumFixedPMCs < 4)
+        return;
+
+    // IA32_PERF_CAPABILITIES bit 15 tells if PERF_METRICS is available. It is not in
+    // the efficiency cores of hybrid processors, so it is read on the processor used
+    CMSRInOutQue q;
+    q.put(PROC_SET, 0, ProcNum0);
+    q.put(MSR_READ, 0x345, 0);
+    msr.AccessRegisters(q);
+    if (!(readImpl(q, 0x345) >> 15 & 1))
+        return;
+
+    // count slots in user mode. Reset slots and PERF_METRICS together
+    queue1.putMasked(0x38D, 2LL << 12, 0xFLL << 12);
+    queue1.put(MSR_WRITE, 0x30C, 0);
+    queue1.put(MSR_WRITE, 0x329, 0);
+    queue1.putMasked(0x38F, TopdownGlobalEnable, TopdownGlobalEnable);
+    queue2.putMasked(0x38F, 0, TopdownGlobalEnable);
+    queue2.putMasked(0x38D, 0, 0xFLL << 12);
+    Topdown = true;
+}
+
+void CCounters::topdownReset()
+{
+    if (!Topdown)
+        return;
+    // PERF_METRICS can only be written while the counting is stopped
+    CMSRInOutQue q;
+    q.put(PROC_SET, 0, ProcNum0);
+    q.putMasked(0x38F, 0, TopdownGlobalEnable);
+    q.put(MSR_WRITE, 0x30C, 0);
+    q.put(MSR_WRITE, 0x329, 0);
+    q.putMasked(0x38F, TopdownGlobalEnable, TopdownGlobalEnable);
+    msr.AccessRegisters(q);
+}
+
+// readClocks for the sources that need a system call
+bool CCounters::ReadClocksSystem(uint64_t& core, uint64_t& ref)
+{
+#ifndef _WIN32
+    if (ClockSource == CLOCK_PERF)
+    {
+        core = clockPerf.read(0);
+        ref = clockPerf.read(1);
+        return true;
+    }
+#endif
+    if (ClockSource == CLOCK_DRIVER)
+    {
+        core = msr.MSRRead(0xC00000E8); // read-only copy of APERF
+        ref = msr.MSRRead(0xC00000E7);  // read-only copy of MPERF
+        return true;
+    }
+    return false;
+}
+
+// MSRs read by readNoise
+enum ENoiseMSR
+{
+    NOISE_MSR_SMI = 1,          // MSR_SMI_COUNT
+    NOISE_MSR_THERM = 2,        // IA32_THERM_STATUS
+    NOISE_MSR_PACKAGE_THERM = 4 // IA32_PACKAGE_THERM_STATUS
+};
+
+// Bits of IA32_THERM_STATUS and IA32_PACKAGE_THERM_STATUS: thermal status and log,
+// PROCHOT status and log, power limitation status and log. The log bits are sticky
+static const long long ThrottleBits = 0x1 | 0x2 | 0x4 | 0x8 | 0x400 | 0x800;
+static const long long ThrottleLogBits = 0x2 | 0x8 | 0x800;
+
+// Find the MSRs that readNoise can read, if noise tagging is requested
+void CCounters::SetupNoise()
+{
+    NoiseMSRs = 0;
+    if (!NoiseTagging || !UsePMC || Backend != BACKEND_DRIVER || MVendor != INTEL ||
+        !(MScheme & (S_ID3 | S_ID4 | S_ID5)))
+        return;
+    int abcd[4];
+    Cpuid(abcd, 0);
+    int maxLeaf = abcd[0];
+    NoiseMSRs = NOISE_MSR_SMI; // Nehalem and later
+    if (maxLeaf >= 6)
+    {
+        // digital thermal sensor and package thermal management
+        Cpuid(abcd, 6);
+        if (abcd[0] & 1)
+            NoiseMSRs |= NOISE_MSR_THERM;
+        if (abcd[0] & 0x40)
+            NoiseMSRs |= NOISE_MSR_PACKAGE_THERM;
+    }
+    // start with clear logs
+    uint64_t smiCount;
+    bool throttled;
+    readNoise(smiCount, throttled);
+}
+
+bool CCounters::readNoise(uint64_t& smiCount, bool& throttled)
+{
+    if (!NoiseMSRs)
+        return false;
+    CMSRInOutQue q;
+    q.put(PROC_SET, 0, ProcNum0);
+    if (NoiseMSRs & NOISE_MSR_SMI)
+        q.put(MSR_READ, 0x34, 0);
+    if (NoiseMSRs & NOISE_MSR_THERM)
+    {
+        q.put(MSR_READ, 0x19C, 0);
+        q.putMasked(0x19C, 0, ThrottleLogBits);
+    }
+    if (NoiseMSRs & NOISE_MSR_PACKAGE_THERM)
+    {
+        q.put(MSR_READ, 0x1B1, 0);
+        q.putMasked(0x1B1, 0, ThrottleLogBits);
+    }
+    msr.AccessRegisters(q);
+    smiCount = (uint64_t)readImpl(q, 0x34);
+    throttled = ((readImpl(q, 0x19C) | readImpl(q, 0x1B1)) & ThrottleBits) != 0;
+    return true;
+}
+
+bool CCounters::writeBackInvalidate()
+{
+#ifdef _WIN32
+    if (!UsePMC || Backend != BACKEND_DRIVER)
+        return false;
+    CMSRInOutQue q;
+    q.put(PROC_SET, 0, ProcNum0);
+    q.put(CACHE_WBINVD, 0, 0);
+    return msr.AccessRegisters(q) == 0;
+#else
+    return false; // WBINVD is privileged, and /dev/cpu/N/msr cannot execute it
+#endif
+}
+
+// Time for measuring the time stamp counter frequency, in seconds
+static const double TSC_CALIBRATION_TIME = 0.02;
+
+// Frequency of time stamp counter from cpuid, in Hz. 0 if not given
+static double TscFrequencyCpuid(const char** source)
+{
+    int abcd[4];
+    Cpuid(abcd, 0);
+    int maxLeaf = abcd[0];
+    if (maxLeaf >= 0x15)
+    {
+        // TSC frequency = crystal frequency * EBX / EAX
+        Cpuid(abcd, 0x15);
+        if (abcd[0] && abcd[1] && abcd[2])
+        {
+            *source = "cpuid 0x15";
+            return double(abcd[2]) * abcd[1] / abcd[0];
+        }
+    }
+    if (maxLeaf >= 0x16)
+    {
+        // The time stamp counter runs at the base frequency in MHz
+        Cpuid(abcd, 0x16);
+        if (abcd[0] & 0xFFFF)
+        {
+            *source = "cpuid 0x16";
+            return (abcd[0] & 0xFFFF) * 1E6;
+        }
+    }
+    return 0;
+}
+
+// Frequency of time stamp counter from cpuid, or measured, in Hz
+static double FindTscFrequency(const char** source)
+{
+    double frequency = TscFrequencyCpuid(source);
+    if (frequency)
+        return frequency;
+
+    // count ticks during a short time of the monotonic clock
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    uint64_t tscStart = Readtsc();
+    std::chrono::duration<double> elapsed;
+    do
+    {
+        elapsed = Clock::now() - start;
+    } while (elapsed.count() < TSC_CALIBRATION_TIME);
+    uint64_t tscEnd = Readtsc();
+    *source = "measured";
+    return double(tscEnd - tscStart) / elapsed.count();
+}
+
+double CCounters::tscFrequency(const char** source)
+{
+    // found on first use. The initialization of a static is thread safe
+    static const char* foundBy = NULL;
+    static const double frequency = FindTscFrequency(&foundBy);
+    if (source)
+        *source = foundBy;
+    return frequency;
+}
+
+bool CCounters::setDesiredCpu()
 {
     // Get mask of possible CPU cores
     ProcMaskType ProcessAffMask = GetProcessMask();
 
     // Fix a processor number
-    int proc0 = 0;
-    while (!TestProcessMask(proc0, &ProcessAffMask))
-        proc0++; // check if proc0 is available
+    int proc0 = DesiredCpu;
+    if (proc0 < 0)
+    {
+        proc0 = 0;
+        while (proc0 < 64 && !TestProcessMask(proc0, &ProcessAffMask))
+            proc0++; // check if proc0 is available
+    }
 
     ProcNum0 = proc0;
 
@@ -1421,9 +2159,9 @@ void CCounters::setDesiredCpu()
                 printf("%i  ", p);
         }
         printf("\n");
-        return;
+        return false;
     }
 
     // Lock process to the desired processor number
-    SetProcessMask(ProcNum0);
+    return SetProcessMask(ProcNum0);
 }
@@ -1,14 +1,21 @@
 #pragma once
 #include "MSRDriver.h"
-#include "DriverWrapper.h"
 #include <string>
+#include <vector>
 #include <stdint.h>
 #include <stdio.h>
 #include <assert.h>
 #ifdef _MSC_VER
 #include <intrin.h>
 #endif
+#ifdef _WIN32
 #include <windows.h>
+#include "DriverWrapper.h"
+#else
+#include "LowNoise.h"
+#include "MSRDevice.h"
+#include "PerfEvents.h"
+#endif
 
 // maximum number of performance counters used
 const int MAXCOUNTERS = 8;
@@ -26,6 +33,43 @@ static inline void Serialize()
 #define Readtsc __rdtsc
 #define Readpmc __readpmc
 
+static inline void Lfence()
+{
+    _mm_lfence();
+}
+
+static inline void Mfence()
+{
+    _mm_mfence();
+}
+
+static inline void CompilerBarrier()
+{
+    // no instruction, but the compiler cannot remove or merge the code around it
+    _ReadWriteBarrier();
+}
+
+static inline uint64_t Readtscp()
+{
+    // read time stamp counter after all previous instructions have executed
+    unsigned int aux;
+    return __rdtscp(&aux);
+}
+
+static inline unsigned int ReadTscAux()
+{
+    // read TSC_AUX, which the operating system sets to the processor number
+    unsigned int aux;
+    __rdtscp(&aux);
+    return aux;
+}
+
+static inline uint64_t Readpru(int)
+{
+    // RDPRU has no intrinsic. CCounters doesn't use it with this compiler
+    return 0;
+}
+
 #else // This version is for gas/AT&T syntax
 
 static inline void Serialize()
@@ -34,23 +78,91 @@ static inline void Serialize()
     __asm__ __volatile__("xorl %%eax, %%eax \n cpuid " : : : "%eax", "%ebx", "%ecx", "%edx");
 }
 
-static inline int Readtsc()
+static inline uint64_t Readtsc()
 {
     // read time stamp counter
-    int r;
-    __asm__ __volatile__("rdtsc" : "=a"(r) : : "%edx");
-    return r;
+    unsigned int lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return (uint64_t)hi << 32 | lo;
 }
 
-static inline int Readpmc(int nPerfCtr)
+static inline uint64_t Readpmc(int nPerfCtr)
 {
     // read performance monitor counter number nPerfCtr
-    int r;
-    __asm__ __volatile__("rdpmc" : "=a"(r) : "c"(nPerfCtr) : "%edx");
-    return r;
+    unsigned int lo, hi;
+    __asm__ __volatile__("rdpmc" : "=a"(lo), "=d"(hi) : "c"(nPerfCtr));
+    return (uint64_t)hi << 32 | lo;
+}
+
+static inline void Lfence()
+{
+    __asm__ __volatile__("lfence" : : : "memory");
+}
+
+static inline void Mfence()
+{
+    __asm__ __volatile__("mfence" : : : "memory");
+}
+
+static inline void CompilerBarrier()
+{
+    // no instruction, but the compiler cannot remove or merge the code around it
+    __asm__ __volatile__("" : : : "memory");
+}
+
+static inline uint64_t Readtscp()
+{
+    // read time stamp counter after all previous instructions have executed
+    unsigned int lo, hi, aux;
+    __asm__ __volatile__("rdtscp" : "=a"(lo), "=d"(hi), "=c"(aux));
+    return (uint64_t)hi << 32 | lo;
+}
+
+static inline unsigned int ReadTscAux()
+{
+    // read TSC_AUX, which the operating system sets to the processor number
+    unsigned int lo, hi, aux;
+    __asm__ __volatile__("rdtscp" : "=a"(lo), "=d"(hi), "=c"(aux));
+    return aux;
+}
+
+static inline uint64_t Readpru(int reg)
+{
+    // read AMD processor register in user mode. 0 = MPERF, 1 = APERF
+    unsigned int lo, hi;
+    __asm__ __volatile__(".byte 0x0f, 0x01, 0xfd" : "=a"(lo), "=d"(hi) : "c"(reg));
+    return (uint64_t)hi << 32 | lo;
 }
 #endif
 
+// Methods for keeping counter reads in order with the code to test
+enum ESerialize
+{
+    SERIALIZE_CPUID = 0,  // CPUID. Fully serializing, but slow and trapped by hypervisors
+    SERIALIZE_LFENCE = 1, // LFENCE. Later instructions wait until earlier instructions have executed
+    SERIALIZE_RDTSCP = 2, // LFENCE, with RDTSCP for the final time stamp read
+    SERIALIZE_MFENCE = 3, // MFENCE + LFENCE. Also waits for earlier stores to be globally visible
+    SERIALIZE_NONE = 4,   // no fence. Lowest overhead, counts may leak across the boundaries
+    SERIALIZE_METHODS = 5 // number of methods
+};
+
+static const char* const SerializeNames[SERIALIZE_METHODS] = {"cpuid", "lfence", "rdtscp", "mfence", "none"};
+
+// Fence between counter reads and code to test
+template <ESerialize S>
+static inline void SerializeWith()
+{
+    if (S == SERIALIZE_CPUID)
+        Serialize();
+    if (S == SERIALIZE_LFENCE || S == SERIALIZE_RDTSCP)
+        Lfence();
+    if (S == SERIALIZE_MFENCE)
+    {
+        Mfence();
+        Lfence();
+    }
+}
+
 
 // codes for processor vendor
 enum EProcVendor
@@ -112,10 +224,102 @@ enum EPMCScheme
     S_VIA = 0x100000 // VIA Nano processor and later
 };
 
-struct SCounterDefinition;
+// interface used for setting up and reading the counters
+enum ECounterBackend
+{
+    BACKEND_DRIVER = 0, // counters programmed through MSR driver or /dev/cpu/N/msr, read with RDPMC
+    BACKEND_PERF = 1    // Linux perf_event_open, read with RDPMC through mmap'ed control page
+};
+
+// how readClocks gets core clock cycles and reference cycles
+enum EClockSource
+{
+    CLOCK_NONE = 0,  // not available
+    CLOCK_FIXED = 1, // Intel fixed counters 1 and 2, read with RDPMC
+    CLOCK_RDPRU = 2, // AMD APERF and MPERF, read with RDPRU in user mode
+    CLOCK_PERF = 3,  // perf_event cycles and ref-cycles
+    CLOCK_DRIVER = 4 // AMD APERF and MPERF, read through the driver. A system call for each read
+};
+
+// Event modifiers of general counters in Intel and AMD. The bits have the same
+// positions as in the event select registers
+enum ECounterModifier : unsigned int
+{
+    MOD_USR = 1 << 16,      // count in user mode
+    MOD_OS = 1 << 17,       // count in kernel mode
+    MOD_EDGE = 1 << 18,     // edge detect: count changes from no event to event
+    MOD_ANY = 1 << 21,      // count events of all threads in the core. Intel only
+    MOD_INV = 1 << 23,      // invert counter mask: count cycles with fewer events than cmask
+    MOD_CMASK = 0xFFu << 24 // counter mask: count cycles with at least cmask events
+};
+
+// Event select register bits for the modifiers of a counter definition. User mode is
+// counted if neither user mode nor kernel mode is specified
+static constexpr inline unsigned int EventSelectModifiers(unsigned int Modifiers)
+{
+    if (!(Modifiers & (MOD_USR | MOD_OS)))
+        Modifiers |= MOD_USR;
+    return Modifiers;
+}
+
+// record specifying how to count a particular event on a particular CPU family
+struct SCounterDefinition
+{
+    int CounterType;                  // ID identifying what to count
+    EPMCScheme PMCScheme;             // PMC scheme. values may be OR'ed
+    EProcFamily ProcessorFamily;      // processor family. values may be OR'ed
+    int CounterFirst, CounterLast;    // counter number or a range of possible alternative counter numbers
+    int EventSelectReg;               // event select register
+    int Event;                        // event code
+    int EventMask;                    // event mask
+    const char* Description;          // name of counter.
+    unsigned int Modifiers = 0;       // ECounterModifier bits. Without MOD_USR and MOD_OS, user mode is counted
+};
+
+// record specifying how to compute a derived metric on a particular CPU family
+struct SMetricDefinition
+{
+    int MetricType;                   // ID identifying the metric
+    EPMCScheme PMCScheme;             // PMC scheme. values may be OR'ed
+    EProcFamily ProcessorFamily;      // processor family. values may be OR'ed
+    const char* Formula;              // formula over counter types, see Metrics.h
+    const char* Description;          // name of metric
+};
+
+// Fields of the Intel PERF_METRICS register (MSR 0x329) for top-down microarchitecture
+// analysis. Each field is the fraction of the topdown slots times 255. Ice Lake has the
+// four level 1 fields, Golden Cove also has the level 2 fields
+enum ETopdownMetric
+{
+    TD_RETIRING = 0,           // slots used by uops that retire
+    TD_BAD_SPECULATION = 1,    // slots wasted on uops that don't retire and recovery
+    TD_FRONTEND_BOUND = 2,     // slots not filled because the front end delivered no uops
+    TD_BACKEND_BOUND = 3,      // slots not filled because the back end was not ready
+    TD_HEAVY_OPERATIONS = 4,   // part of retiring: microcode and instructions with more than one uop
+    TD_BRANCH_MISPREDICTS = 5, // part of bad speculation
+    TD_FETCH_LATENCY = 6,      // part of frontend bound
+    TD_MEMORY_BOUND = 7,       // part of backend bound
+    TD_METRICS = 8             // number of fields
+};
+
+// Topdown slots (fixed counter 3) and PERF_METRICS, counted since the last reset
+struct STopdown
+{
+    uint64_t slots = 0;   // issue slots
+    uint64_t metrics = 0; // PERF_METRICS
+
+    // number of slots in category k of ETopdownMetric
+    double metric(int k) const
+    {
+        return double(slots) * double(metrics >> (8 * k) & 0xFF) / 255.;
+    }
+};
+
+struct SEventSetProgram;
 
-// list of input/output data structures for MSR driver
-#define MAX_QUE_ENTRIES 11 // maximum number of entries in queue
+// list of input/output data structures for MSR driver.
+// The queue grows as needed and is sent to the driver in one call
+#define MAX_QUE_ENTRIES 4096 // maximum number of entries in queue
 
 class CMSRInOutQue
 {
@@ -124,19 +328,33 @@ public:
 
     // put record in queue
     int put(EMSR_COMMAND msr_command, unsigned int register_number, unsigned int value_lo, unsigned int value_hi = 0);
+    // put read-modify-write record in queue. Only the register bits set in mask are changed
+    int putMasked(unsigned int register_number, long long value, long long mask);
+    // put record in queue for reading count consecutive registers
+    int putReadRange(unsigned int register_number, int count);
+    // remove all records
+    void clear();
     // list of entries
-    SMSRInOut queue[MAX_QUE_ENTRIES + 1];
+    std::vector<SMSRInOut> queue;
     // get size of queue
     int GetSize() const
     {
-        return n;
+        return (int)queue.size();
+    }
+    // true if a put failed because the queue is full
+    bool Overflow() const
+    {
+        return overflow;
     }
 
 protected:
-    // number of entries
-    int n;
+    // add count records at end of queue. return NULL if full
+    SMSRInOut* grow(int count);
+    // a put failed
+    bool overflow;
 };
 
+#ifdef _WIN32
 //////////////////////////////////////////////////////////////////////
 //
 //                         class CMSRDriver
@@ -218,7 +436,7 @@ public:
         int n = q.GetSize();
         if (n <= 0)
             return 0;
-        return AccessRegisters(q.queue, n, q.queue, n);
+        return AccessRegisters(q.queue.data(), n, q.queue.data(), n);
     }
 
     // read performance monitor counter
@@ -268,17 +486,74 @@ public:
         return AccessRegisters(a);
     }
 };
+#endif
 
-// defines, starts and stops MSR counters
+// defines, starts and stops MSR counters.
+// An instance can be initialized again with a different set of counters
+// after deinit(). Several instances can be used at the same time, one for
+// each thread, when each thread is locked to its own processor by setCpu()
 class CCounters
 {
 public:
     CCounters();
     ~CCounters();
 
+    // lock the calling thread to the processor and start counters.
+    // Calls deinit() first if the counters are already started
     bool init(const int counters[], int count);
+    // start the counters of a compile-time event set with the program for the present
+    // processor, see EventSets.h. Requires BACKEND_DRIVER
+    bool init(const SEventSetProgram programs[], int numPrograms);
     void deinit();
 
+    // Split a list of any number of counter types into passes, each of which can be
+    // counted at the same time and passed to init(). Each pass begins with the anchor
+    // counter types that are available on this processor. A counter type that doesn't
+    // fit together with the anchors gets a pass of its own. Counter types that are not
+    // available are left out. The division uses as few passes as a limited search can
+    // find, and is the same every time for the same list. Returns the number of passes
+    int planPasses(const int counters[], int count, const int anchors[], int numAnchors,
+        std::vector<std::vector<int>>& passes);
+
+    // Load counter definitions from a JSON file, see EventDatabase.h. They take precedence
+    // over the table CounterDefinitions in CounterDefinitions.h. Must be called before any instance
+    // is used. Returns error message or NULL
+    static const char* loadEvents(const char* filename);
+
+    // counter type of the event with this name on the present processor, e.g.
+    // "INST_RETIRED.ANY" or "Instruct". Not case sensitive. The name can also be a raw
+    // event specification for Intel and AMD like "event=0xa3,umask=0x14,cmask=20,edge,usr,os",
+    // with the terms event, umask, cmask, edge, inv, any, usr and os. 0 if not found
+    int findCounterType(const char* name);
+
+    // name of a counter type on the present processor. NULL if not available
+    const char* findCounterName(int CounterType);
+
+    // definition of a metric in MetricDefinitions for the present processor, by metric type
+    // or by name (not case sensitive). NULL if not found
+    const SMetricDefinition* findMetric(int MetricType);
+    const SMetricDefinition* findMetric(const char* name);
+
+    // select processor to lock the calling thread to in init(). -1 = first available processor
+    void setCpu(int cpu)
+    {
+        DesiredCpu = cpu;
+    }
+
+    // processor that the counters are set up on
+    int getCpu() const
+    {
+        return ProcNum0;
+    }
+
+    // Also set up the counters on these processors, for test code that runs threads on them.
+    // With the Linux MSR backend, the counters of all the processors are started and stopped
+    // in one parallel batch. Must be called before init(). Requires BACKEND_DRIVER
+    void setCpuSet(const int cpus[], int numCpus)
+    {
+        CpuSet.assign(cpus, cpus + numCpus);
+    }
+
     int countersCount() const
     {
         return NumCounters;
@@ -287,14 +562,42 @@ public:
     uint64_t counterRead(int counterNum) const
     {
         assert(counterNum < NumCounters);
+#ifndef _WIN32
+        if (Backend == BACKEND_PERF)
+            return perf.read(Counters[counterNum]);
+#endif
         return Readpmc(Counters[counterNum]);
     }
 
+    // RDPMC register number of counter. Only valid with BACKEND_DRIVER
+    int counterRegister(int counterNum) const
+    {
+        return Counters[counterNum];
+    }
+
     const char* counterName(int counterNum) const
     {
         return CounterNames[counterNum];
     }
 
+    // counter type of counter, 0 if not known
+    int counterType(int counterNum) const
+    {
+        return CounterTypes[counterNum];
+    }
+
+    // mask of the bits read by counterRead. The counter wraps around at this width
+    uint64_t counterMask(int counterNum) const
+    {
+        return CounterMasks[counterNum];
+    }
+
+    // number of counts between two reads of the same counter, taking wrap-around into account
+    uint64_t counterDelta(int counterNum, uint64_t start, uint64_t end) const
+    {
+        return (end - start) & CounterMasks[counterNum];
+    }
+
     bool usePMC() const
     {
         return UsePMC;
@@ -305,6 +608,124 @@ public:
         return clockFactor;
     }
 
+    // Read core clock cycles and reference cycles at nominal frequency for finding the
+    // actual clock frequency: fixed counters 1 and 2 in Intel, APERF and MPERF in AMD Zen
+    // with RDPRU or through the driver, cycles and ref-cycles with perf_event. The reference
+    // cycles count at the rate of the time stamp counter. Only differences between two reads
+    // are meaningful. Returns false if not available
+    bool readClocks(uint64_t& core, uint64_t& ref)
+    {
+        switch (ClockSource)
+        {
+        case CLOCK_FIXED:
+            core = Readpmc(0x40000001);
+            ref = Readpmc(0x40000002);
+            return true;
+        case CLOCK_RDPRU:
+            core = Readpru(1); // APERF
+            ref = Readpru(0);  // MPERF
+            return true;
+        case CLOCK_NONE:
+            return false;
+        default:
+            return ReadClocksSystem(core, ref);
+        }
+    }
+
+    // how readClocks reads the clocks
+    EClockSource clockSource() const
+    {
+        return ClockSource;
+    }
+
+#ifndef _WIN32
+    // Low-noise mode for Linux: SCHED_FIFO, locked memory and huge page control from init()
+    // to deinit(), in addition to the high priority. See LowNoise.h. Must be called before init()
+    void setLowNoise(const SLowNoiseOptions& options)
+    {
+        LowNoiseOptions = options;
+    }
+#endif
+
+    // Tag repetitions that are disturbed by the environment: processor migrations detected
+    // with TSC_AUX, and SMIs and thermal or power throttling read through the driver in Intel.
+    // Must be called before init()
+    void setNoiseTagging(bool on)
+    {
+        NoiseTagging = on;
+    }
+
+    bool noiseTagging() const
+    {
+        return NoiseTagging;
+    }
+
+    // true if readNoise can read the SMI count and the throttle logs
+    bool noiseAvailable() const
+    {
+        return NoiseMSRs != 0;
+    }
+
+    // Read MSR_SMI_COUNT and check if the thermal, PROCHOT or power limit status or log bits
+    // of the core or the package are set. Clears the log bits, so throttled tells if there was
+    // throttling since the last call. This is a driver call. Returns false if not available
+    bool readNoise(uint64_t& smiCount, bool& throttled);
+
+    // Write back and invalidate all caches with WBINVD through the driver. This is a driver
+    // call. Returns false if not available. Only the Windows driver can do it
+    bool writeBackInvalidate();
+
+    // Frequency of the time stamp counter in Hz, from cpuid leaf 0x15 or 0x16 in Intel, or
+    // measured against the clock of the operating system. It is found once. source is set
+    // to a description of how it was found
+    static double tscFrequency(const char** source = NULL);
+
+    // Check the MSR command interpreter by running a queue with MSR_WRITE_MASKED,
+    // MSR_READ_RANGE, TSC_READ and PMC_READ on the in-memory register file of
+    // SMSRMemoryAccess. Returns NULL if the results are right, otherwise an error message
+    static const char* checkCommands();
+
+    // select interface for counters. Must be called before init()
+    void setBackend(ECounterBackend backend)
+    {
+        Backend = backend;
+    }
+
+    ECounterBackend getBackend() const
+    {
+        return Backend;
+    }
+
+    // Enable the topdown slots and PERF_METRICS of Intel Ice Lake and later for top-down
+    // analysis, in addition to the counters. Must be called before init(). Requires BACKEND_DRIVER
+    void setTopdown(bool on)
+    {
+        TopdownRequested = on;
+    }
+
+    // true if init() has enabled topdown slots and PERF_METRICS
+    bool topdownAvailable() const
+    {
+        return Topdown;
+    }
+
+    // true if PERF_METRICS has the level 2 fields
+    bool topdownLevel2() const
+    {
+        return Topdown && MFamily == INTEL_GOLDCV;
+    }
+
+    // Set topdown slots and PERF_METRICS to zero. This is a driver call. The fractions in
+    // PERF_METRICS have 8 bits, so they are most precise when counting starts near the region
+    void topdownReset();
+
+    // read topdown slots and PERF_METRICS with RDPMC
+    void topdownRead(STopdown& t) const
+    {
+        t.slots = Readpmc(0x40000003);
+        t.metrics = Readpmc(0x20000000);
+    }
+
     std::string getDiagnostic() const;
 
     EProcVendor MVendor; // microprocessor vendor
@@ -313,10 +734,33 @@ public:
 
 protected:
     const char* DefineCounter(int CounterType);                // request a counter setup
-    const char* DefineCounter(const SCounterDefinition& CounterDef);
-
-    void LockProcessor();                                      // Make program and driver use the same processor number
+    // request a counter setup on register counternr, or the first vacant register if -1
+    const char* DefineCounter(const SCounterDefinition& CounterDef, int counternr = -1);
+    const char* DefinePerfCounter(int CounterType);            // request a perf_event counter
+    const SCounterDefinition* FindCounterDefinition(int CounterType) const; // find counter for present processor
+    const char* ParseEventSpec(const char* spec, SCounterDefinition& def) const; // read raw event specification
+    // find counter register not in used[]. -1 if none
+    int FindVacantCounter(const SCounterDefinition& CDef, const int used[], const int usedEventRegs[], int numUsed) const;
+    // assign registers to a set of counters. assigned[i] = register or -1
+    void AssignCounters(const SCounterDefinition* const defs[], int n, int assigned[]) const;
+    bool AssignP4Counters(const SCounterDefinition* const defs[], const std::vector<int>& active, int k, int assigned[],
+        int eventRegs[]) const;
+    bool CountersFit(const int counters[], int count, bool* available = NULL) const; // check if counters can be used together
+    int SearchPasses(const std::vector<int>& events, const std::vector<int>& anchors, int k, int maxPasses,
+        int usedPasses, std::vector<int>& pass, long& nodes) const; // search for division into passes
+    void DetectProcessor();                                    // get processor information and size of counter table
+
+    void Reset();                                              // Forget the counters of a previous init()
+    void EnableFixedCounters();                                // Queue enable of Intel fixed counters
+    void EnableGlobalCounters();                               // Queue enable of Intel counters in global control
+    void SetupClockProbe();                                    // Set up counters for readClocks
+    bool ReadClocksSystem(uint64_t& core, uint64_t& ref);      // readClocks through perf_event or driver
+    void SetupTopdown();                                       // Queue enable of topdown slots and PERF_METRICS
+    void SetupNoise();                                         // Find the MSRs that readNoise can read
+    bool LockProcessor();                                      // Make program and driver use the same processor number. false if not available
     void QueueCounters(const int counters[], int count);       // Put counter definitions in queue
+    const char* QueueEventSet(const SEventSetProgram& program); // Put event set program in queue
+    bool Start();                                              // Load driver and start the queued counters
     int StartDriver();                                         // Install and load driver
     void StartCounters();                                      // start counting
     void StopCounters();                                       // stop and reset counters
@@ -337,28 +781,56 @@ protected:
     int NumCounters = 0; // Number of valid PMC counters in Counters[]
 
     const char* CounterNames[MAXCOUNTERS] = {}; // name of each counter
+    int CounterTypes[MAXCOUNTERS] = {};         // counter type of each counter
     int Counters[MAXCOUNTERS] = {};             // counter register numbers used
+    uint64_t CounterMasks[MAXCOUNTERS] = {};    // mask for the width of each counter
     int EventRegistersUsed[MAXCOUNTERS] = {};   // index of counter registers used
 
     int Family = -1, Model = -1; // these are used for diagnostic output
     int ProcNum0 = 0;            // desired processor number
+    int DesiredCpu = -1;         // processor number requested by setCpu, -1 if any
+    std::vector<int> CpuSet;     // other processors to set up counters on, from setCpuSet
     int UsePMC = 1;              // 0 if no PMC counters used
+    bool Active = false;         // init() has been called without deinit()
+    bool CountersEnabled = false;      // global enable of general counters is in queues
+    bool FixedCountersEnabled = false; // fixed counter control is in queues
+    EClockSource ClockSource = CLOCK_NONE; // how readClocks reads the clocks
+    bool TopdownRequested = false;     // setTopdown(true) has been called
+    bool Topdown = false;              // topdown slots and PERF_METRICS are enabled
+    bool NoiseTagging = false;         // setNoiseTagging(true) has been called
+    int NoiseMSRs = 0;                 // MSRs read by readNoise, bits of ENoiseMSR in CCounters.cpp
+#ifdef _WIN32
+    ECounterBackend Backend = BACKEND_DRIVER; // interface for setting up counters
+#else
+    ECounterBackend Backend = BACKEND_PERF;
+#endif
 
     double clockFactor = 1.0;    // clock correction factor for AMD Zen processor
 
-    void setDesiredCpu();
+    bool setDesiredCpu();              // lock thread to DesiredCpu or the first available processor. false if not available
+    void AccessQueue(CMSRInOutQue& q); // execute queue on ProcNum0 and the processors of CpuSet
 
 protected:
     CMSRInOutQue queue1; // queue of MSR commands to do by StartCounters()
     CMSRInOutQue queue2; // queue of MSR commands to do by StopCounters()
     // translate event select number to register address for P4 processor:
     static int GetP4EventSelectRegAddress(int CounterNr, int EventSelectNo);
-    int NumCounterDefinitions = 0; // number of possible counter definitions in table CounterDefinitions
     int NumPMCs = 0;               // Number of general PMCs
     int NumFixedPMCs = 0;          // Number of fixed function PMCs
+    int PMCWidth = 40;             // Number of bits in general PMCs
+    int FixedPMCWidth = 40;        // Number of bits in fixed function PMCs
     unsigned int rTSCounter = 0;   // PMC register number of time stamp counter in S_AMD2 scheme
     unsigned int rCoreCounter = 0; // PMC register number of core clock counter in S_AMD2 scheme
 
 private:
     CMSRDriver msr; // interface to MSR access driver
+#ifndef _WIN32
+    CPerfEvents perf; // interface to perf_event counters. Counters[] holds event numbers
+    CPerfEvents clockPerf; // cycles and ref-cycles for readClocks
+    SLowNoiseOptions LowNoiseOptions; // low-noise mode requested by setLowNoise
+    CLowNoise lowNoise;    // scheduling and memory settings of low-noise mode
+#endif
+
+    CCounters& operator=(const CCounters&) = delete;
+    CCounters(const CCounters&) = delete;
 };
@@ -0,0 +1,220 @@
+#include "CacheControl.h"
+#include <new>
+#include <stdio.h>
+#include <string.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+// Cache line size for flushing and eviction
+#define CACHE_LINE 64
+
+// Eviction buffer size when the last level cache size is not known
+#define DEFAULT_EVICTION_SIZE (64 << 20)
+
+// The sum of the eviction reads goes here, so the compiler cannot omit them
+static volatile char EvictionSink;
+
+#ifdef _MSC_VER
+static void Cpuid(int Output[4], int leaf, int subleaf = 0)
+{
+    __cpuidex(Output, leaf, subleaf);
+}
+
+static inline void FlushLine(const void* p)
+{
+    _mm_clflush(p);
+}
+
+static inline void FlushLineOpt(const void* p)
+{
+    _mm_clflushopt((void*)p);
+}
+
+static inline void Mfence()
+{
+    _mm_mfence();
+}
+#else
+static void Cpuid(int Output[4], int leaf, int subleaf = 0)
+{
+    int a, b, c, d;
+    __asm("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "a"(leaf), "c"(subleaf) :);
+    Output[0] = a;
+    Output[1] = b;
+    Output[2] = c;
+    Output[3] = d;
+}
+
+static inline void FlushLine(const void* p)
+{
+    __asm__ __volatile__("clflush %0" : "+m"(*(volatile char*)p));
+}
+
+static inline void FlushLineOpt(const void* p)
+{
+    // CLFLUSHOPT is CLFLUSH with a 66 prefix. Written as bytes for assemblers without it
+    __asm__ __volatile__(".byte 0x66; clflush %0" : "+m"(*(volatile char*)p));
+}
+
+static inline void Mfence()
+{
+    __asm__ __volatile__("mfence" : : : "memory");
+}
+#endif
+
+// Largest cache of the deterministic cache parameters in cpuid leaf 4 (Intel) or
+// 0x8000001D (AMD). 0 if none
+static size_t LargestCache(int leaf)
+{
+    size_t largest = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        int abcd[4];
+        Cpuid(abcd, leaf, i);
+        int type = abcd[0] & 0x1F;
+        if (type == 0)
+            break; // no more caches
+        if (type == 2)
+            continue; // instruction cache
+        size_t ways = ((unsigned)abcd[1] >> 22) + 1;
+        size_t partitions = ((abcd[1] >> 12) & 0x3FF) + 1;
+        size_t line = (abcd[1] & 0xFFF) + 1;
+        size_t sets = (size_t)(unsigned)abcd[2] + 1;
+        size_t size = ways * partitions * line * sets;
+        if (size > largest)
+            largest = size;
+    }
+    return largest;
+}
+
+size_t CCacheControl::lastLevelCacheSize()
+{
+    int abcd[4];
+    Cpuid(abcd, 0);
+    int maxLeaf = abcd[0];
+    char vendor[13];
+    memcpy(vendor, &abcd[1], 4);
+    memcpy(vendor + 4, &abcd[3], 4);
+    memcpy(vendor + 8, &abcd[2], 4);
+    vendor[12] = 0;
+    if (strcmp(vendor, "GenuineIntel") == 0 && maxLeaf >= 4)
+        return LargestCache(4);
+    if (strcmp(vendor, "AuthenticAMD") == 0 || strcmp(vendor, "HygonGenuine") == 0)
+    {
+        Cpuid(abcd, 0x80000000);
+        unsigned int maxExtended = (unsigned int)abcd[0];
+        if (maxExtended >= 0x8000001D)
+        {
+            Cpuid(abcd, 0x80000001);
+            if (abcd[2] & (1 << 22)) // topology extensions
+                return LargestCache(0x8000001D);
+        }
+        if (maxExtended >= 0x80000006)
+        {
+            // L3 size in units of 512 kB
+            Cpuid(abcd, 0x80000006);
+            return (size_t)((unsigned int)abcd[3] >> 18) * (512 << 10);
+        }
+    }
+    return 0;
+}
+
+CCacheControl::CCacheControl()
+    : Mode(CACHE_ASIS)
+    , Eviction(NULL)
+    , EvictionSize(0)
+    , Clflushopt(false)
+{
+    int abcd[4];
+    Cpuid(abcd, 0);
+    if (abcd[0] >= 7)
+    {
+        Cpuid(abcd, 7);
+        Clflushopt = (abcd[1] >> 23 & 1) != 0;
+    }
+}
+
+CCacheControl::~CCacheControl()
+{
+    free();
+}
+
+int CCacheControl::init(ECacheMode mode)
+{
+    free();
+    Mode = mode;
+    if (mode != CACHE_COLD_ALL)
+        return 0;
+
+    size_t llc = lastLevelCacheSize();
+    size_t size = llc ? llc * 2 : DEFAULT_EVICTION_SIZE;
+    Eviction = (char*)operator new[](size, std::align_val_t(CACHE_LINE), std::nothrow);
+    if (!Eviction)
+    {
+        printf("\nCannot allocate %zu bytes for cache eviction", size);
+        return 1;
+    }
+    // write all pages now, so the operating system maps them before the test
+    memset(Eviction, 0, size);
+    EvictionSize = size;
+    return 0;
+}
+
+void CCacheControl::free()
+{
+    if (Eviction)
+        operator delete[](Eviction, std::align_val_t(CACHE_LINE));
+    Eviction = NULL;
+    EvictionSize = 0;
+}
+
+void CCacheControl::addBuffer(const void* p, size_t size)
+{
+    if (p && size)
+        Buffers.push_back(SBuffer{(const char*)p, size});
+}
+
+void CCacheControl::evict()
+{
+    if (Mode == CACHE_COLD_DATA)
+        FlushBuffers();
+    else if (Mode == CACHE_COLD_ALL)
+        StreamEviction();
+}
+
+// Flush each cache line of the registered buffers. CLFLUSHOPT flushes the lines in
+// parallel, and MFENCE waits until they are all written back
+void CCacheControl::FlushBuffers()
+{
+    for (const SBuffer& b : Buffers)
+    {
+        const char* first = (const char*)((uintptr_t)b.p & ~(uintptr_t)(CACHE_LINE - 1));
+        const char* end = b.p + b.size;
+        if (Clflushopt)
+        {
+            for (const char* p = first; p < end; p += CACHE_LINE)
+                FlushLineOpt(p);
+        }
+        else
+        {
+            for (const char* p = first; p < end; p += CACHE_LINE)
+                FlushLine(p);
+        }
+    }
+    Mfence();
+}
+
+// Read one byte of each cache line of the eviction buffer. The dirty lines of the test
+// are written back when they are evicted, and the eviction buffer leaves only clean lines,
+// so the test does not pay for write-backs of lines it did not write
+void CCacheControl::StreamEviction()
+{
+    const volatile char* p = Eviction;
+    char sum = 0;
+    for (size_t i = 0; i < EvictionSize; i += CACHE_LINE)
+        sum += p[i];
+    EvictionSink = sum;
+    Mfence();
+}
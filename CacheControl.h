@@ -0,0 +1,92 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//
+//                         class CCacheControl
+//
+// Puts the caches in a known state before each repetition of a test,
+// outside the timed region:
+//
+//   CACHE_ASIS       nothing. Each repetition sees the cache state that
+//                    the previous one left
+//   CACHE_WARM       the test code runs once untimed before each repetition
+//   CACHE_COLD_DATA  the registered data buffers are flushed from all
+//                    cache levels with CLFLUSHOPT, or CLFLUSH
+//   CACHE_COLD_ALL   the caches are evicted by reading a buffer of twice
+//                    the size of the last level cache, optionally followed
+//                    by WBINVD through the driver
+//
+// The test runs CACHE_WARM itself. evict() does the cold modes.
+//
+//////////////////////////////////////////////////////////////////////
+
+enum ECacheMode
+{
+    CACHE_ASIS = 0,
+    CACHE_WARM = 1,
+    CACHE_COLD_DATA = 2,
+    CACHE_COLD_ALL = 3,
+    CACHE_MODES = 4 // number of modes
+};
+
+static const char* const CacheModeNames[CACHE_MODES] = {"asis", "warm", "cold-data", "cold-all"};
+
+class CCacheControl
+{
+public:
+    CCacheControl();
+    ~CCacheControl();
+
+    // Set mode. Allocates and writes the eviction buffer for CACHE_COLD_ALL.
+    // Return 0 if success, 1 if out of memory
+    int init(ECacheMode mode);
+
+    void free();
+
+    ECacheMode mode() const
+    {
+        return Mode;
+    }
+
+    // register a data buffer of the test code for CACHE_COLD_DATA
+    void addBuffer(const void* p, size_t size);
+
+    // do the eviction of the cold modes. Nothing in the other modes
+    void evict();
+
+    // size of the eviction buffer of CACHE_COLD_ALL
+    size_t evictionSize() const
+    {
+        return EvictionSize;
+    }
+
+    // true if the processor has CLFLUSHOPT
+    bool hasClflushopt() const
+    {
+        return Clflushopt;
+    }
+
+    // Size of the last level cache in bytes, from cpuid. 0 if not known
+    static size_t lastLevelCacheSize();
+
+private:
+    struct SBuffer
+    {
+        const char* p;
+        size_t size;
+    };
+    ECacheMode Mode;
+    std::vector<SBuffer> Buffers; // registered data buffers
+    char* Eviction;               // eviction buffer for CACHE_COLD_ALL
+    size_t EvictionSize;          // size of Eviction
+    bool Clflushopt;              // CLFLUSHOPT is supported
+
+    void FlushBuffers();
+    void StreamEviction();
+
+    CCacheControl& operator=(const CCacheControl&) = delete;
+    CCacheControl(const CCacheControl&) = delete;
+};
@@ -0,0 +1,512 @@
+#include "EventDatabase.h"
+#include <iterator>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Maximum nesting of arrays and objects in a JSON file
+static const int JSON_MAX_DEPTH = 64;
+
+// A value read from a JSON file
+struct SJson
+{
+    enum EType
+    {
+        J_NULL,
+        J_BOOL,
+        J_NUMBER,
+        J_STRING,
+        J_ARRAY,
+        J_OBJECT
+    };
+    EType type = J_NULL;
+    double number = 0;             // value of number or bool
+    std::string text;              // value of string
+    std::vector<std::string> keys; // names of object members
+    std::vector<SJson> items;      // array elements or object members
+
+    // member of object. NULL if not found
+    const SJson* member(const char* key) const
+    {
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            if (keys[i] == key)
+                return &items[i];
+        }
+        return NULL;
+    }
+};
+
+//////////////////////////////////////////////////////////////////////
+//
+// Minimal JSON reader. \u escapes of characters outside ASCII are
+// read as '?', which is good enough for event names and descriptions
+//
+//////////////////////////////////////////////////////////////////////
+
+class CJsonReader
+{
+public:
+    CJsonReader(const char* text)
+        : p(text)
+        , line(1)
+    {
+    }
+
+    // read the whole text as one value. Returns false on syntax error
+    bool read(SJson& v)
+    {
+        if (!value(v, 0))
+            return false;
+        space();
+        return *p == 0;
+    }
+
+    // line number of syntax error
+    int errorLine() const
+    {
+        return line;
+    }
+
+protected:
+    const char* p; // next character
+    int line;      // line number of p
+
+    void space();                       // skip white space
+    bool value(SJson& v, int depth);    // read any value
+    bool string(std::string& s);        // read string in quotes
+    bool word(const char* w);           // read literal word
+};
+
+void CJsonReader::space()
+{
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+    {
+        if (*p == '\n')
+            line++;
+        p++;
+    }
+}
+
+bool CJsonReader::word(const char* w)
+{
+    size_t n = strlen(w);
+    if (strncmp(p, w, n) != 0)
+        return false;
+    p += n;
+    return true;
+}
+
+bool CJsonReader::string(std::string& s)
+{
+    if (*p != '"')
+        return false;
+    p++;
+    s.clear();
+    while (*p != '"')
+    {
+        char c = *p++;
+        if (c == 0 || c == '\n')
+            return false;
+        if (c == '\\')
+        {
+            c = *p++;
+            switch (c)
+            {
+            case '"':
+            case '\\':
+            case '/':
+                break;
+            case 'b':
+                c = '\b';
+                break;
+            case 'f':
+                c = '\f';
+                break;
+            case 'n':
+                c = '\n';
+                break;
+            case 'r':
+                c = '\r';
+                break;
+            case 't':
+                c = '\t';
+                break;
+            case 'u':
+            {
+                int u = 0;
+                for (int i = 0; i < 4; i++, p++)
+                {
+                    if (!isxdigit((unsigned char)*p))
+                        return false;
+                    u = u << 4 | (isdigit((unsigned char)*p) ? *p - '0' : (tolower((unsigned char)*p) - 'a' + 10));
+                }
+                c = u < 0x80 ? (char)u : '?';
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        s += c;
+    }
+    p++;
+    return true;
+}
+
+bool CJsonReader::value(SJson& v, int depth)
+{
+    space();
+    if (depth > JSON_MAX_DEPTH)
+        return false;
+    if (*p == '"')
+    {
+        v.type = SJson::J_STRING;
+        return string(v.text);
+    }
+    if (*p == '[' || *p == '{')
+    {
+        bool object = *p++ == '{';
+        char end = object ? '}' : ']';
+        v.type = object ? SJson::J_OBJECT : SJson::J_ARRAY;
+        space();
+        if (*p == end)
+        {
+            p++;
+            return true;
+        }
+        for (;;)
+        {
+            if (object)
+            {
+                space();
+                v.keys.emplace_back();
+                if (!string(v.keys.back()))
+                    return false;
+                space();
+                if (*p++ != ':')
+                    return false;
+            }
+            v.items.emplace_back();
+            if (!value(v.items.back(), depth + 1))
+                return false;
+            space();
+            if (*p == end)
+            {
+                p++;
+                return true;
+            }
+            if (*p++ != ',')
+                return false;
+        }
+    }
+    if (*p == '-' || isdigit((unsigned char)*p))
+    {
+        char* e;
+        v.type = SJson::J_NUMBER;
+        v.number = strtod(p, &e);
+        if (e == p)
+            return false;
+        p = e;
+        return true;
+    }
+    if (word("true") || word("false"))
+    {
+        v.type = SJson::J_BOOL;
+        v.number = p[-2] == 'u'; // "true" ends in "ue", "false" in "se"
+        return true;
+    }
+    v.type = SJson::J_NULL;
+    return word("null");
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Fields of events in JSON files
+//
+//////////////////////////////////////////////////////////////////////
+
+struct SNamedValue
+{
+    const char* name;
+    unsigned int value;
+};
+
+static const SNamedValue SchemeNames[] = {
+    {"S_P1", S_P1},     {"S_P4", S_P4},     {"S_P2", S_P2},     {"S_ID1", S_ID1},   {"S_ID2", S_ID2},
+    {"S_ID3", S_ID3},   {"S_ID4", S_ID4},   {"S_ID5", S_ID5},   {"S_P2MC", S_P2MC}, {"S_ID23", S_ID23},
+    {"S_INTL", S_INTL}, {"S_AMD", S_AMD},   {"S_AMD2", S_AMD2}, {"S_VIA", S_VIA}};
+
+static const SNamedValue FamilyNames[] = {
+    {"PRALL", PRALL},               {"INTEL_P1MMX", INTEL_P1MMX},   {"INTEL_P23", INTEL_P23},
+    {"INTEL_PM", INTEL_PM},         {"INTEL_P4", INTEL_P4},         {"INTEL_CORE", INTEL_CORE},
+    {"INTEL_P23M", INTEL_P23M},     {"INTEL_CORE2", INTEL_CORE2},   {"INTEL_7", INTEL_7},
+    {"INTEL_IVY", INTEL_IVY},       {"INTEL_7I", INTEL_7I},         {"INTEL_HASW", INTEL_HASW},
+    {"INTEL_SKYL", INTEL_SKYL},     {"INTEL_ICE", INTEL_ICE},       {"INTEL_GOLDCV", INTEL_GOLDCV},
+    {"INTEL_ATOM", INTEL_ATOM},     {"INTEL_SILV", INTEL_SILV},     {"INTEL_GOLDM", INTEL_GOLDM},
+    {"INTEL_KNIGHT", INTEL_KNIGHT}, {"AMD_ATHLON", AMD_ATHLON},     {"AMD_ATHLON64", AMD_ATHLON64},
+    {"AMD_BULLD", AMD_BULLD},       {"AMD_ZEN", AMD_ZEN},           {"AMD_ALL", AMD_ALL},
+    {"VIA_NANO", VIA_NANO}};
+
+// scheme of events that don't specify one
+static const unsigned int AllSchemes = S_P1 | S_P4 | S_INTL | S_AMD | S_AMD2 | S_VIA;
+
+// Integer value of a number or of a string like "0xC0". A list like "0xB7, 0xBB" gives
+// the first value. Returns false if v is missing or not a number
+static bool IntValue(const SJson* v, long long& value)
+{
+    if (!v)
+        return false;
+    if (v->type == SJson::J_NUMBER || v->type == SJson::J_BOOL)
+    {
+        value = (long long)v->number;
+        return true;
+    }
+    if (v->type != SJson::J_STRING)
+        return false;
+    char* e;
+    value = strtoll(v->text.c_str(), &e, 0);
+    return e != v->text.c_str();
+}
+
+// true if v is present and not zero
+static bool NonZero(const SJson* v)
+{
+    long long value;
+    return IntValue(v, value) && value != 0;
+}
+
+// Combination of names like "S_ID3|S_ID4", or a number. Returns false if a name is unknown
+static bool MaskValue(const SJson* v, const SNamedValue* names, int numNames, unsigned int& mask)
+{
+    long long value;
+    if (IntValue(v, value))
+    {
+        mask = (unsigned int)value;
+        return true;
+    }
+    if (!v || v->type != SJson::J_STRING)
+        return false;
+    mask = 0;
+    const char* s = v->text.c_str();
+    while (*s)
+    {
+        size_t n = strcspn(s, "|, ");
+        if (n)
+        {
+            int i = 0;
+            while (i < numNames && (strlen(names[i].name) != n || strncmp(names[i].name, s, n) != 0))
+                i++;
+            if (i == numNames)
+                return false;
+            mask |= names[i].value;
+        }
+        s += n;
+        if (*s)
+            s++;
+    }
+    return mask != 0;
+}
+
+// Counter numbers of "Fixed counter N" or of a list of general counters "0,1,2,3"
+static bool CounterRange(const SJson* v, int& first, int& last)
+{
+    if (!v || v->type != SJson::J_STRING)
+        return false;
+    const char* s = v->text.c_str();
+    if (strncmp(s, "Fixed counter", 13) == 0)
+    {
+        first = last = 0x40000000 + atoi(s + 13);
+        return true;
+    }
+    first = 0x7FFFFFFF;
+    last = -1;
+    while (*s)
+    {
+        char* e;
+        long n = strtol(s, &e, 10);
+        if (e == s)
+            return false;
+        if (n < first)
+            first = (int)n;
+        if (n > last)
+            last = (int)n;
+        s = e + strspn(e, ", ");
+    }
+    return last >= 0;
+}
+
+// upper case copy of name
+static std::string UpperCase(const char* name)
+{
+    std::string s(name);
+    for (char& c : s)
+        c = (char)toupper((unsigned char)c);
+    return s;
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+//                     class CEventDatabase
+//
+//////////////////////////////////////////////////////////////////////
+
+CEventDatabase::CEventDatabase()
+    : nextDynamicType(EVENT_TYPE_DYNAMIC)
+    , numSkipped(0)
+{
+}
+
+void CEventDatabase::insert(const SCounterDefinition& def)
+{
+    definitions.push_back(def);
+    const SCounterDefinition* d = &definitions.back();
+    byType[d->CounterType].push_back(d);
+    if (d->Description)
+        byName[UpperCase(d->Description)].push_back(d);
+}
+
+void CEventDatabase::add(const SCounterDefinition* defs, int n)
+{
+    for (int i = 0; i < n; i++)
+        insert(defs[i]);
+}
+
+int CEventDatabase::add(SCounterDefinition def, const char* name)
+{
+    names.push_back(name);
+    def.Description = names.back().c_str();
+    if (def.CounterType == 0)
+    {
+        // same counter type for all events with the same name
+        int& t = dynamicTypes[UpperCase(name)];
+        if (t == 0)
+            t = nextDynamicType++;
+        def.CounterType = t;
+    }
+    insert(def);
+    return def.CounterType;
+}
+
+const SCounterDefinition* CEventDatabase::find(int CounterType, EPMCScheme scheme, EProcFamily family) const
+{
+    auto t = byType.find(CounterType);
+    if (t == byType.end())
+        return NULL;
+    for (const SCounterDefinition* d : t->second)
+    {
+        if ((d->PMCScheme & scheme) && (d->ProcessorFamily & family))
+            return d;
+    }
+    return NULL;
+}
+
+const SCounterDefinition* CEventDatabase::find(const char* name, EPMCScheme scheme, EProcFamily family) const
+{
+    auto t = byName.find(UpperCase(name));
+    if (t == byName.end())
+        return NULL;
+    for (const SCounterDefinition* d : t->second)
+    {
+        if ((d->PMCScheme & scheme) && (d->ProcessorFamily & family))
+            return d;
+    }
+    return NULL;
+}
+
+const char* CEventDatabase::load(const char* filename)
+{
+    // read file
+    FILE* f = fopen(filename, "rb");
+    if (!f)
+    {
+        error = std::string("Can't open ") + filename;
+        return error.c_str();
+    }
+    std::string text;
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        text.append(buf, n);
+    fclose(f);
+
+    CJsonReader reader(text.c_str());
+    SJson root;
+    if (!reader.read(root))
+    {
+        error = std::string("Syntax error in ") + filename + " line " + std::to_string(reader.errorLine());
+        return error.c_str();
+    }
+
+    // perfmon files are a list of events or have the list in "Events"
+    const SJson* events = root.type == SJson::J_OBJECT ? root.member("Events") : &root;
+    if (!events || events->type != SJson::J_ARRAY)
+    {
+        error = std::string("No list of events in ") + filename;
+        return error.c_str();
+    }
+
+    for (const SJson& e : events->items)
+    {
+        const SJson* name = e.member("EventName");
+        if (!name)
+            name = e.member("Name");
+        long long id = 0, event, umask = 0, first, last, selectReg = 0, cmask = 0;
+        bool hasId = IntValue(e.member("Id"), id);
+        bool named = name && name->type == SJson::J_STRING && !name->text.empty();
+
+        // skip what can't be expressed in a counter definition
+        if (e.type != SJson::J_OBJECT || (!hasId && !named) || e.member("Unit") || NonZero(e.member("MSRIndex")) ||
+            !(IntValue(e.member("EventCode"), event) || IntValue(e.member("Event"), event)))
+        {
+            numSkipped++;
+            continue;
+        }
+        if (!IntValue(e.member("UMask"), umask))
+            IntValue(e.member("EventMask"), umask);
+        IntValue(e.member("EventSelectReg"), selectReg);
+
+        SCounterDefinition d;
+        d.CounterFirst = 0;
+        d.CounterLast = 3;
+        CounterRange(e.member("Counter"), d.CounterFirst, d.CounterLast);
+        if (IntValue(e.member("CounterFirst"), first))
+            d.CounterFirst = d.CounterLast = (int)first;
+        if (IntValue(e.member("CounterLast"), last))
+            d.CounterLast = (int)last;
+
+        IntValue(e.member("CounterMask"), cmask);
+        d.Modifiers = (unsigned int)(cmask & 0xFF) << 24;
+        if (NonZero(e.member("Invert")))
+            d.Modifiers |= MOD_INV;
+        if (NonZero(e.member("EdgeDetect")))
+            d.Modifiers |= MOD_EDGE;
+        if (NonZero(e.member("AnyThread")))
+            d.Modifiers |= MOD_ANY;
+        if (d.Modifiers && (d.CounterFirst & 0x40000000))
+        {
+            // the fixed counters have no counter mask, and the any thread bit is not set up
+            numSkipped++;
+            continue;
+        }
+
+        unsigned int scheme = AllSchemes, family = PRALL;
+        const SJson* s = e.member("Scheme");
+        const SJson* fam = e.member("Family");
+        if ((s && !MaskValue(s, SchemeNames, (int)std::size(SchemeNames), scheme)) ||
+            (fam && !MaskValue(fam, FamilyNames, (int)std::size(FamilyNames), family)))
+        {
+            error = std::string("Unknown scheme or family in ") + filename + " event " + (named ? name->text : std::to_string(id));
+            return error.c_str();
+        }
+
+        d.CounterType = (int)id;
+        d.PMCScheme = EPMCScheme(scheme);
+        d.ProcessorFamily = EProcFamily(family);
+        d.EventSelectReg = (int)selectReg;
+        d.Event = (int)event;
+        d.EventMask = (int)umask;
+        add(d, named ? name->text.c_str() : std::to_string(id).c_str());
+    }
+    return NULL;
+}
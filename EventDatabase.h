@@ -0,0 +1,91 @@
+#pragma once
+#include "CCounters.h"
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//
+// Database of counter definitions with hashed lookup by counter type
+// and by name.
+//
+// Definitions are added from a table compiled into the program or loaded
+// from a JSON file. A file can have the layout of the Intel perfmon event
+// files (github.com/intel/perfmon), the AMD event files of the Linux kernel
+// (tools/perf/pmu-events/arch/x86), or the same layout with the fields of
+// SCounterDefinition added:
+//
+//   [ { "Id": 9, "Scheme": "S_ID3|S_ID4", "Family": "PRALL",
+//       "Counter": "Fixed counter 0", "EventCode": "0x00", "UMask": "0x01",
+//       "EventName": "INST_RETIRED.ANY" }, ... ]
+//
+// "Counter" is "Fixed counter N" or a list of general counters "0,1,2,3".
+// It can be replaced by "CounterFirst" and "CounterLast". The general
+// counters 0 - 3 are used if it is missing. "CounterMask", "Invert",
+// "EdgeDetect" and "AnyThread" go to the Modifiers field. An event without
+// "Scheme" or "Family" is valid for all processors, so a perfmon file should
+// only be loaded on the processor it is made for. An event without "Id" gets
+// a counter type of its own, starting at EVENT_TYPE_DYNAMIC. Events that need
+// an extra MSR, uncore events and fixed counter events with modifiers are
+// skipped.
+//
+// Each counter type and each name maps to the short list of its
+// definitions for different schemes and processor families, in the order
+// they were added, so a lookup costs the same with a few events or
+// with thousands.
+//
+//////////////////////////////////////////////////////////////////////
+
+// first counter type given to events loaded without an id
+const int EVENT_TYPE_DYNAMIC = 0x10000;
+
+class CEventDatabase
+{
+public:
+    CEventDatabase();
+
+    // add the definitions of a table. The names are not copied
+    void add(const SCounterDefinition* defs, int n);
+
+    // add a definition with a copy of name. A definition with CounterType 0 gets the counter
+    // type of earlier definitions with the same name, or a new one. Returns the counter type
+    int add(SCounterDefinition def, const char* name);
+
+    // add the events of a JSON file. Returns error message or NULL
+    const char* load(const char* filename);
+
+    // first definition of CounterType that is valid for scheme and family. NULL if none
+    const SCounterDefinition* find(int CounterType, EPMCScheme scheme, EProcFamily family) const;
+
+    // first definition with this name that is valid for scheme and family.
+    // Not case sensitive. NULL if none
+    const SCounterDefinition* find(const char* name, EPMCScheme scheme, EProcFamily family) const;
+
+    // number of definitions
+    int size() const
+    {
+        return (int)definitions.size();
+    }
+
+    // number of events skipped by load() because they can't be counted
+    int skipped() const
+    {
+        return numSkipped;
+    }
+
+protected:
+    CEventDatabase(const CEventDatabase&) = delete; // the indexes point into definitions
+    CEventDatabase& operator=(const CEventDatabase&) = delete;
+    void insert(const SCounterDefinition& def); // add one definition to the indexes
+
+    typedef std::vector<const SCounterDefinition*> DefList;
+    std::deque<SCounterDefinition> definitions;     // all definitions. A deque keeps the addresses
+    std::deque<std::string> names;                  // storage for names of loaded events
+    std::unordered_map<int, DefList> byType;        // definitions of each counter type
+    std::unordered_map<std::string, DefList> byName; // definitions of each upper case name
+    std::unordered_map<std::string, int> dynamicTypes; // counter type of events loaded without id
+    int nextDynamicType;                            // next counter type for an event without id
+    int numSkipped;                                 // events skipped by load()
+    std::string error;                              // storage for error message
+};
@@ -0,0 +1,308 @@
+#pragma once
+#include "CounterDefinitions.h"
+#include <array>
+#include <iterator>
+#include <utility>
+
+//////////////////////////////////////////////////////////////////////
+//
+// Event sets that are known at compile time.
+//
+// EventSet<CoreCycles, Instructions, Uops, L1DMiss> looks up its events in
+// CounterDefinitions, assigns counter registers and computes the event
+// select values with constexpr code for every processor in
+// EventSetTargets. A target where one of the events has no definition is
+// left out. An event set that doesn't fit in the counters of a target where
+// all its events are defined, or that is defined for no target at all,
+// fails to compile.
+//
+// At run time, CCounters::init(Set::programs, Set::numPrograms) picks the
+// program of the present processor from the table and puts its MSR writes
+// in the queues without going through DefineCounter. Set::reader() gives
+// a function that reads the counters with constant RDPMC register numbers
+// and no branches:
+//
+//     typedef EventSet<CoreCycles, Instructions, Uops> Set;
+//     CCounters counters;
+//     counters.setBackend(BACKEND_DRIVER);
+//     if (counters.init(Set::programs, Set::numPrograms))
+//     {
+//         Set::ReadFunction read = Set::reader(counters.MScheme, counters.MFamily);
+//         uint64_t start[Set::size], end[Set::size];
+//         read(start);
+//         ...
+//         read(end);
+//     }
+//
+// Event sets need the driver backend, because perf_event assigns the
+// registers itself.
+//
+//////////////////////////////////////////////////////////////////////
+
+// Event of counter type Type in CounterDefinitions
+template <int Type>
+struct Event
+{
+    static constexpr int type = Type;
+};
+
+typedef Event<1> CoreCycles;    // core clock cycles
+typedef Event<2> RefCycles;     // reference clock cycles
+typedef Event<9> Instructions;  // instructions
+typedef Event<100> Uops;        // micro-operations
+typedef Event<201> BranchTaken; // branches taken
+typedef Event<311> L1DMiss;     // level 1 data cache misses
+typedef Event<320> L2Miss;      // level 2 cache misses
+
+// Processor that event sets are computed for
+struct SEventSetTarget
+{
+    EPMCScheme scheme;
+    EProcFamily family;
+};
+
+// The Intel schemes have the same register layout for all families. The family
+// decides which definitions are used
+inline constexpr SEventSetTarget EventSetTargets[] = {
+    {S_ID2, INTEL_CORE2},
+    {S_ID3, INTEL_7},
+    {S_ID3, INTEL_IVY},
+    {S_ID3, INTEL_HASW},
+    {S_ID3, INTEL_ATOM},
+    {S_ID3, INTEL_SILV},
+    {S_ID3, INTEL_KNIGHT},
+    {S_ID4, INTEL_SKYL},
+    {S_ID4, INTEL_ICE},
+    {S_ID4, INTEL_GOLDM},
+    {S_ID5, INTEL_ICE},
+    {S_ID5, INTEL_GOLDCV},
+    {S_ID5, INTEL_GOLDM},
+    {S_AMD2, AMD_ZEN}};
+
+const int NUM_EVENTSET_TARGETS = (int)std::size(EventSetTargets);
+
+enum EEventSetStatus
+{
+    EVENTSET_UNDEFINED = 0, // an event has no definition for the target
+    EVENTSET_OK = 1,        // program is valid
+    EVENTSET_NOFIT = 2      // the events don't fit in the counter registers at the same time
+};
+
+// One counter of an event set program
+struct SEventSetCounter
+{
+    int rdpmc;                      // RDPMC register number
+    unsigned int counterMSR;        // MSR of the counter. Reset before start
+    unsigned int selectMSR;         // event select MSR. 0 for fixed counters
+    unsigned long long selectValue; // value of event select MSR
+    const char* name;               // name of counter
+    int type;                       // counter type
+};
+
+// MSR programming of an event set for one target
+struct SEventSetProgram
+{
+    EPMCScheme scheme;
+    EProcFamily family;
+    EEventSetStatus status;
+    int numCounters;
+    SEventSetCounter counters[MAXCOUNTERS];
+    long long fixedControl; // bits of MSR_PERF_FIXED_CTR_CTRL for the fixed counters used. Intel only
+    long long fixedMask;    // fields of MSR_PERF_FIXED_CTR_CTRL for the fixed counters used
+    long long globalEnable; // bits of MSR_PERF_GLOBAL_CTRL for the counters used. Intel only
+};
+
+// Slots for the matching of events to registers: general counters, then fixed counters
+const int EVENTSET_GENERAL_SLOTS = 16;
+const int EVENTSET_SLOTS = EVENTSET_GENERAL_SLOTS + 8;
+
+// Definition of CounterType for target. NULL if none
+constexpr const SCounterDefinition* FindTargetDefinition(int CounterType, const SEventSetTarget& t)
+{
+    for (const SCounterDefinition& d : CounterDefinitions)
+    {
+        if (d.CounterType == CounterType && (d.PMCScheme & t.scheme) && (d.ProcessorFamily & t.family))
+            return &d;
+    }
+    return NULL;
+}
+
+// Give event e a register slot, moving events that own the candidate slots to other
+// slots if possible (augmenting path of bipartite matching)
+constexpr bool AugmentEventSet(const SCounterDefinition* const defs[], int e, int owner[], bool visited[])
+{
+    const SCounterDefinition& d = *defs[e];
+    bool fixed = (d.CounterFirst & 0x40000000) != 0;
+    int first = fixed ? EVENTSET_GENERAL_SLOTS + (d.CounterFirst & 7) : d.CounterFirst;
+    int last = fixed ? first : d.CounterLast;
+    for (int s = first; s <= last && s < EVENTSET_SLOTS && (fixed || s < EVENTSET_GENERAL_SLOTS); s++)
+    {
+        if (visited[s])
+            continue;
+        visited[s] = true;
+        if (owner[s] < 0 || AugmentEventSet(defs, owner[s], owner, visited))
+        {
+            owner[s] = e;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Register assignment and MSR values of events for target
+template <class... Events>
+constexpr SEventSetProgram PlanEventSet(const SEventSetTarget& t)
+{
+    const int n = sizeof...(Events);
+    const SCounterDefinition* defs[n] = {FindTargetDefinition(Events::type, t)...};
+    SEventSetProgram p = {};
+    p.scheme = t.scheme;
+    p.family = t.family;
+    p.numCounters = n;
+    p.status = EVENTSET_UNDEFINED;
+    for (int e = 0; e < n; e++)
+    {
+        if (!defs[e])
+            return p;
+    }
+
+    int owner[EVENTSET_SLOTS] = {};
+    for (int s = 0; s < EVENTSET_SLOTS; s++)
+        owner[s] = -1;
+    for (int e = 0; e < n; e++)
+    {
+        bool visited[EVENTSET_SLOTS] = {};
+        if (!AugmentEventSet(defs, e, owner, visited))
+        {
+            p.status = EVENTSET_NOFIT;
+            return p;
+        }
+    }
+
+    for (int s = 0; s < EVENTSET_SLOTS; s++)
+    {
+        if (owner[s] < 0)
+            continue;
+        const SCounterDefinition& d = *defs[owner[s]];
+        SEventSetCounter& c = p.counters[owner[s]];
+        c.name = d.Description;
+        c.type = d.CounterType;
+        unsigned long long select = (d.Event & 0xFF) | (d.EventMask & 0xFF) << 8 | EventSelectModifiers(d.Modifiers) | 1 << 22;
+        if (t.scheme == S_AMD2)
+        {
+            // event select bits 8-11 go to bits 32-35
+            c.rdpmc = s;
+            c.selectMSR = 0xC0010200 + s * 2;
+            c.counterMSR = c.selectMSR + 1;
+            c.selectValue = select | (unsigned long long)(d.Event >> 8 & 0xF) << 32;
+        }
+        else if (s >= EVENTSET_GENERAL_SLOTS)
+        {
+            // Intel fixed counter, counting user level
+            int f = s - EVENTSET_GENERAL_SLOTS;
+            c.rdpmc = 0x40000000 + f;
+            c.counterMSR = 0x309 + f;
+            p.fixedControl |= 2LL << (4 * f);
+            p.fixedMask |= 0xFLL << (4 * f);
+            p.globalEnable |= 1LL << (32 + f);
+        }
+        else
+        {
+            c.rdpmc = s;
+            c.selectMSR = 0x186 + s; // IA32_PERFEVTSEL0,1,..
+            c.counterMSR = 0xC1 + s; // IA32_PMC0,1,..
+            c.selectValue = select;
+            p.globalEnable |= 1LL << s;
+        }
+    }
+    p.status = EVENTSET_OK;
+    return p;
+}
+
+// Programs of events for all targets
+template <class... Events>
+constexpr std::array<SEventSetProgram, NUM_EVENTSET_TARGETS> PlanEventSets()
+{
+    std::array<SEventSetProgram, NUM_EVENTSET_TARGETS> a = {};
+    for (int t = 0; t < NUM_EVENTSET_TARGETS; t++)
+        a[t] = PlanEventSet<Events...>(EventSetTargets[t]);
+    return a;
+}
+
+// Number of programs with this status
+constexpr int CountEventSetStatus(const std::array<SEventSetProgram, NUM_EVENTSET_TARGETS>& a, EEventSetStatus status)
+{
+    int n = 0;
+    for (const SEventSetProgram& p : a)
+        n += p.status == status;
+    return n;
+}
+
+// true if no counter type occurs twice
+template <class... Events>
+constexpr bool EventSetUnique()
+{
+    const int types[] = {Events::type...};
+    for (size_t i = 0; i < std::size(types); i++)
+    {
+        for (size_t j = 0; j < i; j++)
+        {
+            if (types[i] == types[j])
+                return false;
+        }
+    }
+    return true;
+}
+
+template <class... Events>
+class EventSet
+{
+public:
+    static constexpr int size = sizeof...(Events);
+    static_assert(size > 0 && size <= MAXCOUNTERS, "An event set must have 1 to MAXCOUNTERS events");
+    static_assert(EventSetUnique<Events...>(), "An event occurs twice in the event set");
+
+    // programs for all targets, for CCounters::init
+    static constexpr std::array<SEventSetProgram, NUM_EVENTSET_TARGETS> table = PlanEventSets<Events...>();
+    static constexpr const SEventSetProgram* programs = table.data();
+    static constexpr int numPrograms = NUM_EVENTSET_TARGETS;
+    static_assert(CountEventSetStatus(table, EVENTSET_NOFIT) == 0,
+        "The events don't fit in the counter registers of a processor where they are all defined");
+    static_assert(CountEventSetStatus(table, EVENTSET_OK) > 0, "The event set is not defined for any processor");
+
+    // reads counts[0 .. size-1]
+    typedef void (*ReadFunction)(uint64_t counts[]);
+
+    // read the counters of target T
+    template <int T>
+    static void read(uint64_t counts[])
+    {
+        ReadRegisters<T>(counts, std::make_index_sequence<size>());
+    }
+
+    // read function for the present processor. NULL if the event set is not defined for it
+    static ReadFunction reader(EPMCScheme scheme, EProcFamily family)
+    {
+        constexpr std::array<ReadFunction, NUM_EVENTSET_TARGETS> readers =
+            MakeReaders(std::make_index_sequence<NUM_EVENTSET_TARGETS>());
+        for (int t = 0; t < NUM_EVENTSET_TARGETS; t++)
+        {
+            if (table[t].scheme == scheme && table[t].family == family && table[t].status == EVENTSET_OK)
+                return readers[t];
+        }
+        return NULL;
+    }
+
+protected:
+    template <int T, size_t... I>
+    static inline void ReadRegisters(uint64_t counts[], std::index_sequence<I...>)
+    {
+        ((counts[I] = Readpmc(table[T].counters[I].rdpmc)), ...);
+    }
+
+    template <size_t... T>
+    static constexpr std::array<ReadFunction, sizeof...(T)> MakeReaders(std::index_sequence<T...>)
+    {
+        return {{&read<(int)T>...}};
+    }
+};
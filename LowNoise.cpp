@@ -0,0 +1,291 @@
+#ifndef _WIN32
+#include "LowNoise.h"
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <stdint.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+
+// Number of instances that have memory locked. mlockall applies to the whole process
+static std::atomic<int> LockedInstances(0);
+
+// Time for sampling the load of hyperthread siblings, in milliseconds
+const int SIBLING_SAMPLE_MS = 100;
+
+// Report a sibling that is busy more than this fraction of the time
+#define SIBLING_BUSY_LIMIT 0.05
+
+// Size and alignment of a transparent huge page in x86-64
+#define HUGE_PAGE_SIZE ((uintptr_t)2 << 20)
+
+// Contents of a small text file. Empty if it cannot be read
+static std::string ReadTextFile(const char* path)
+{
+    std::string s;
+    FILE* f = fopen(path, "r");
+    if (!f)
+        return s;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        s.append(buf, n);
+    fclose(f);
+    return s;
+}
+
+// Processors in a list like "0-3,8,10-11", as used in sysfs and procfs
+static std::vector<int> CpuListMembers(const std::string& list)
+{
+    std::vector<int> cpus;
+    const char* p = list.c_str();
+    while (*p)
+    {
+        char* end;
+        long first = strtol(p, &end, 10);
+        if (end == p)
+        {
+            p++; // separator or newline
+            continue;
+        }
+        long last = first;
+        p = end;
+        if (*p == '-')
+        {
+            last = strtol(p + 1, &end, 10);
+            p = end;
+        }
+        for (long c = first; c <= last && c - first < 4096; c++)
+            cpus.push_back((int)c);
+    }
+    return cpus;
+}
+
+static bool CpuListContains(const std::string& list, int cpu)
+{
+    for (int c : CpuListMembers(list))
+    {
+        if (c == cpu)
+            return true;
+    }
+    return false;
+}
+
+// Busy and total time of processor cpu from /proc/stat, in clock ticks. false if not found
+static bool CpuTimes(int cpu, unsigned long long& busy, unsigned long long& total)
+{
+    std::string stat = ReadTextFile("/proc/stat");
+    char name[32];
+    snprintf(name, sizeof(name), "\ncpu%i ", cpu);
+    size_t pos = stat.find(name);
+    if (pos == std::string::npos)
+        return false;
+    // user nice system idle iowait irq softirq steal
+    unsigned long long t[8] = {0};
+    if (sscanf(stat.c_str() + pos + strlen(name), "%llu %llu %llu %llu %llu %llu %llu %llu", &t[0], &t[1], &t[2],
+            &t[3], &t[4], &t[5], &t[6], &t[7]) < 4)
+        return false;
+    total = 0;
+    for (unsigned long long v : t)
+        total += v;
+    busy = total - t[3] - t[4];
+    return true;
+}
+
+CLowNoise::CLowNoise()
+    : Entered(false)
+    , PolicySaved(false)
+    , OldPolicy(SCHED_OTHER)
+    , Locked(false)
+    , THPSaved(false)
+    , OldTHPDisable(0)
+{
+    memset(&OldParam, 0, sizeof(OldParam));
+}
+
+CLowNoise::~CLowNoise()
+{
+    leave();
+}
+
+void CLowNoise::enter(const SLowNoiseOptions& options)
+{
+    if (Entered)
+        return;
+    Entered = true;
+
+    // realtime scheduling of the calling thread
+    OldPolicy = sched_getscheduler(0);
+    if (options.fifoPriority > 0 && OldPolicy >= 0 && sched_getparam(0, &OldParam) == 0)
+    {
+        sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = options.fifoPriority;
+        if (sched_setscheduler(0, SCHED_FIFO, &param) == 0)
+            PolicySaved = true;
+        else
+            printf("\nCannot set SCHED_FIFO: %s. Needs CAP_SYS_NICE", strerror(errno));
+    }
+
+    // no huge pages. Must be done before the pages are faulted in by mlockall
+    if (options.thp == THP_OFF)
+    {
+        int old = prctl(PR_GET_THP_DISABLE, 0, 0, 0, 0);
+        if (old >= 0 && prctl(PR_SET_THP_DISABLE, 1, 0, 0, 0) == 0)
+        {
+            OldTHPDisable = old;
+            THPSaved = true;
+        }
+        else
+            printf("\nCannot disable transparent huge pages: %s", strerror(errno));
+    }
+
+    // lock and fault in all pages of code and data, and of later allocations
+    if (options.lockMemory)
+    {
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0)
+        {
+            Locked = true;
+            LockedInstances++;
+        }
+        else
+            printf("\nCannot lock memory: %s. Needs CAP_IPC_LOCK or a higher RLIMIT_MEMLOCK", strerror(errno));
+    }
+}
+
+void CLowNoise::leave()
+{
+    if (!Entered)
+        return;
+    if (Locked && --LockedInstances == 0)
+        munlockall();
+    if (THPSaved)
+        prctl(PR_SET_THP_DISABLE, OldTHPDisable, 0, 0, 0);
+    if (PolicySaved)
+        sched_setscheduler(0, OldPolicy, &OldParam);
+    Entered = PolicySaved = Locked = THPSaved = false;
+}
+
+int CLowNoise::preflight(int cpu)
+{
+    int warnings = 0;
+    printf("\nLow-noise preflight for processor %i:", cpu);
+
+    std::string isolated = ReadTextFile("/sys/devices/system/cpu/isolated");
+    if (!CpuListContains(isolated, cpu))
+    {
+        printf("\n  Warning: not in isolcpus. Other tasks can be scheduled on it");
+        warnings++;
+    }
+    std::string nohz = ReadTextFile("/sys/devices/system/cpu/nohz_full");
+    if (!CpuListContains(nohz, cpu))
+    {
+        printf("\n  Warning: not in nohz_full. The scheduler tick interrupts the test");
+        warnings++;
+    }
+
+    // interrupts that may be delivered to this processor
+    std::vector<int> irqs;
+    if (DIR* dir = opendir("/proc/irq"))
+    {
+        while (dirent* e = readdir(dir))
+        {
+            char* end;
+            long irq = strtol(e->d_name, &end, 10);
+            if (end == e->d_name || *end)
+                continue;
+            char path[128];
+            snprintf(path, sizeof(path), "/proc/irq/%ld/effective_affinity_list", irq);
+            std::string affinity = ReadTextFile(path);
+            if (affinity.empty())
+            {
+                snprintf(path, sizeof(path), "/proc/irq/%ld/smp_affinity_list", irq);
+                affinity = ReadTextFile(path);
+            }
+            if (CpuListContains(affinity, cpu))
+                irqs.push_back((int)irq);
+        }
+        closedir(dir);
+    }
+    if (!irqs.empty())
+    {
+        printf("\n  Warning: %i interrupts routed to it:", (int)irqs.size());
+        for (size_t i = 0; i < irqs.size() && i < 16; i++)
+            printf(" %i", irqs[i]);
+        if (irqs.size() > 16)
+            printf(" ...");
+        warnings++;
+    }
+
+    // hyperthread siblings that share the core
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%i/topology/thread_siblings_list", cpu);
+    std::vector<int> siblings;
+    for (int c : CpuListMembers(ReadTextFile(path)))
+    {
+        if (c != cpu)
+            siblings.push_back(c);
+    }
+    if (!siblings.empty())
+    {
+        std::vector<unsigned long long> busy0(siblings.size()), total0(siblings.size());
+        std::vector<bool> valid(siblings.size());
+        for (size_t i = 0; i < siblings.size(); i++)
+            valid[i] = CpuTimes(siblings[i], busy0[i], total0[i]);
+        std::this_thread::sleep_for(std::chrono::milliseconds(SIBLING_SAMPLE_MS));
+        for (size_t i = 0; i < siblings.size(); i++)
+        {
+            unsigned long long busy1, total1;
+            if (!valid[i] || !CpuTimes(siblings[i], busy1, total1) || total1 <= total0[i])
+                continue;
+            double load = double(busy1 - busy0[i]) / double(total1 - total0[i]);
+            if (load > SIBLING_BUSY_LIMIT)
+            {
+                printf("\n  Warning: hyperthread sibling %i is %.0f%% busy", siblings[i], load * 100.);
+                warnings++;
+            }
+        }
+    }
+
+    std::string thp = ReadTextFile("/sys/kernel/mm/transparent_hugepage/enabled");
+    if (!thp.empty())
+    {
+        thp.erase(thp.find_last_not_of("\n") + 1);
+        printf("\n  Transparent huge pages: %s", thp.c_str());
+    }
+    if (!warnings)
+        printf("\n  No warnings");
+    return warnings;
+}
+
+void CLowNoise::prepareBuffer(void* p, size_t size, ETHPMode thp)
+{
+    if (!p || !size)
+        return;
+    // madvise needs whole pages. The partial pages at the ends are left out
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t first = ((uintptr_t)p + page - 1) & ~(page - 1);
+    uintptr_t last = ((uintptr_t)p + size) & ~(page - 1);
+    if (thp != THP_DEFAULT && last > first)
+        madvise((void*)first, last - first, thp == THP_ON ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+    // a huge page can only map an aligned block of HUGE_PAGE_SIZE
+    uintptr_t firstHuge = ((uintptr_t)p + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    uintptr_t lastHuge = ((uintptr_t)p + size) & ~(HUGE_PAGE_SIZE - 1);
+    if (thp == THP_ON && lastHuge <= firstHuge)
+        printf("\nWarning: buffer of %zu bytes contains no aligned 2 MB block. It cannot use huge pages", size);
+
+    // write one byte of each page without changing the contents
+    volatile char* c = (volatile char*)p;
+    for (size_t i = 0; i < size; i += page)
+        c[i] = c[i];
+    c[size - 1] = c[size - 1];
+}
+#endif
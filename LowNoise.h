@@ -0,0 +1,81 @@
+#pragma once
+#ifndef _WIN32
+#include <sched.h>
+#include <stddef.h>
+
+//////////////////////////////////////////////////////////////////////
+//
+//                         class CLowNoise
+//
+// Low-noise execution for Linux, the counterpart of the realtime
+// priority class that CCounters uses in Windows. enter() gives the
+// calling thread the SCHED_FIFO policy, locks all pages of the process
+// in memory with mlockall, which also faults in the pages of the code
+// and data, and can disable transparent huge pages for the process.
+// leave() restores all of it. CCounters calls enter() and leave() in
+// init() and deinit() when low-noise mode is requested.
+//
+// preflight() reports the system settings that add noise on the
+// processor the test runs on: not in isolcpus or nohz_full, interrupts
+// routed to it, or a busy hyperthread sibling.
+//
+// SCHED_FIFO needs CAP_SYS_NICE and mlockall needs CAP_IPC_LOCK or a
+// sufficient RLIMIT_MEMLOCK. What cannot be done is reported, and the
+// test runs without it.
+//
+//////////////////////////////////////////////////////////////////////
+
+// Transparent huge pages for the test buffers
+enum ETHPMode
+{
+    THP_DEFAULT = 0, // system setting
+    THP_ON = 1,      // madvise(MADV_HUGEPAGE) on test buffers
+    THP_OFF = 2      // no huge pages in the process
+};
+
+struct SLowNoiseOptions
+{
+    bool enabled = false;      // enter low-noise mode in CCounters::init
+    int fifoPriority = 1;      // SCHED_FIFO priority. 1 is above all normal tasks, but below interrupt threads. 0 = off
+    bool lockMemory = true;    // mlockall
+    ETHPMode thp = THP_DEFAULT;
+};
+
+class CLowNoise
+{
+public:
+    CLowNoise();
+    ~CLowNoise();
+
+    // enter low-noise mode for the calling thread
+    void enter(const SLowNoiseOptions& options);
+    // restore scheduling policy, memory locking and huge page setting. Also done by destructor
+    void leave();
+
+    bool active() const
+    {
+        return Entered;
+    }
+
+    // Print the sources of noise on processor cpu. Samples the load of the hyperthread
+    // siblings for a short time. Returns number of warnings
+    static int preflight(int cpu);
+
+    // Apply THP mode to the pages of buffer p and write all of them, so they are mapped
+    // before the test. A huge page can only map an aligned 2 MB block, so THP_ON has no
+    // effect on a buffer that contains no such block. This is reported
+    static void prepareBuffer(void* p, size_t size, ETHPMode thp);
+
+private:
+    bool Entered;           // enter() called without leave()
+    bool PolicySaved;       // scheduling policy changed, OldPolicy and OldParam valid
+    int OldPolicy;          // scheduling policy before enter()
+    sched_param OldParam;   // scheduling parameters before enter()
+    bool Locked;            // mlockall done
+    bool THPSaved;          // PR_SET_THP_DISABLE changed, OldTHPDisable valid
+    int OldTHPDisable;      // PR_GET_THP_DISABLE before enter()
+
+    CLowNoise& operator=(const CLowNoise&) = delete;
+    CLowNoise(const CLowNoise&) = delete;
+};
+#endif
@@ -0,0 +1,299 @@
+// Interpreter for lists of SMSRInOut commands.
+// Shared by the Windows driver and the Linux /dev/cpu/N/msr implementation.
+// Must compile in kernel mode: no library headers, no exceptions.
+
+#pragma once
+#include "MSRDriver.h"
+
+// Error codes from ExecuteMSRCommands, in addition to errors from the register access class
+#define MSR_STATUS_INVALID_COMMAND (-1)  // unknown command, or multi-record command incomplete
+#define MSR_STATUS_BUFFER_TOO_SMALL (-2) // output buffer too small for the result of a read command
+
+//////////////////////////////////////////////////////////////////////
+//
+// Execute the commands in pnIn[0..nInLen-1] and put the results in pnOut.
+// Each output record is the input record with value replaced by the
+// result of the command. pnIn and pnOut may be the same buffer.
+//
+// TAccess is the interface to the registers. All members return 0 for
+// success or an error code:
+//     int ReadMSR(unsigned int reg, long long& value);
+//     int WriteMSR(unsigned int reg, long long value);
+//     int ReadControlReg(unsigned int reg, long long& value);
+//     int WriteControlReg(unsigned int reg, long long value);
+//     int EnablePMC(bool enable);            // allow RDPMC in user mode
+//     int GetProcessor(long long& proc);     // processor used by the following commands
+//     int SetProcessor(long long proc, long long& result); // result goes to output record
+//     int ReadTSC(long long& value);
+//     int ReadPMC(unsigned int counter, long long& value);
+//     int WriteBackInvalidate();             // WBINVD
+//
+// Multi-record commands:
+// MSR_WRITE_MASKED: the next record holds the mask in its value. The
+//    register bits that are 1 in the mask are replaced by the bits of value.
+//    Output: the old register value, and the new value in the next record.
+// MSR_READ_RANGE: value is the number of registers N to read, starting at
+//    register_number. The following N records receive the values.
+//    Output: N.
+//
+// Returns 0 or the first error. *pnDone receives the number of records processed.
+//
+//////////////////////////////////////////////////////////////////////
+
+template <class TAccess>
+int ExecuteMSRCommands(
+    TAccess& access, const SMSRInOut* pnIn, int nInLen, SMSRInOut* pnOut, int nOutLen, int* pnDone = 0)
+{
+    int status = 0;
+    int i, k;
+
+    // command loop
+    for (i = 0; i < nInLen; i++)
+    {
+        SMSRInOut rec = pnIn[i]; // copy, because pnOut may overwrite pnIn
+        long long OutValue = 0;
+        long long v = 0;
+        int err = 0;
+        int extra = 0; // number of operand records used
+        bool read = false;
+        bool stop = false;
+
+        // dispatch command
+        switch (rec.msr_command)
+        {
+        case MSR_IGNORE: // do nothing
+            break;
+
+        case MSR_STOP: // stop loop
+            stop = true;
+            break;
+
+        case MSR_READ: // read model-specific register
+            err = access.ReadMSR(rec.register_number, OutValue);
+            read = true;
+            break;
+
+        case MSR_WRITE: // write model-specific register
+            err = access.WriteMSR(rec.register_number, rec.value);
+            break;
+
+        case CR_READ: // read control register
+            err = access.ReadControlReg(rec.register_number, OutValue);
+            read = true;
+            break;
+
+        case CR_WRITE: // write control register
+            err = access.WriteControlReg(rec.register_number, rec.value);
+            break;
+
+        case PMC_ENABLE: // Enable RDPMC and RDTSC instructions
+            err = access.EnablePMC(true);
+            break;
+
+        case PMC_DISABLE: // Disable RDPMC instruction (RDTSC remains enabled)
+            err = access.EnablePMC(false);
+            break;
+
+        case PROC_GET: // Which processor number am I running on
+            err = access.GetProcessor(OutValue);
+            break;
+
+        case PROC_SET: // Fix to certain processor number
+            err = access.SetProcessor(rec.value, OutValue);
+            break;
+
+        case MSR_WRITE_MASKED: // read-modify-write of selected bits
+        {
+            if (i + 1 >= nInLen)
+            {
+                err = MSR_STATUS_INVALID_COMMAND;
+                break;
+            }
+            long long mask = pnIn[i + 1].value;
+            extra = 1;
+            err = access.ReadMSR(rec.register_number, OutValue);
+            if (err)
+                break;
+            v = (OutValue & ~mask) | (rec.value & mask);
+            err = access.WriteMSR(rec.register_number, v);
+            if (i + 1 < nOutLen)
+            {
+                pnOut[i + 1] = pnIn[i + 1];
+                pnOut[i + 1].value = v;
+            }
+            read = true;
+            break;
+        }
+
+        case MSR_READ_RANGE: // read consecutive registers
+            if (rec.value < 0 || rec.value >= nInLen - i)
+            {
+                err = MSR_STATUS_INVALID_COMMAND;
+                break;
+            }
+            extra = (int)rec.value;
+            for (k = 1; k <= extra && !err; k++)
+            {
+                err = access.ReadMSR(rec.register_number + k - 1, v);
+                if (i + k < nOutLen)
+                {
+                    pnOut[i + k] = pnIn[i + k];
+                    pnOut[i + k].value = v;
+                }
+                else
+                {
+                    err = MSR_STATUS_BUFFER_TOO_SMALL;
+                }
+            }
+            OutValue = extra;
+            break;
+
+        case TSC_READ: // read time stamp counter
+            err = access.ReadTSC(OutValue);
+            read = true;
+            break;
+
+        case PMC_READ: // read performance monitor counter
+            err = access.ReadPMC(rec.register_number, OutValue);
+            read = true;
+            break;
+
+        case CACHE_WBINVD: // write back and invalidate caches
+            err = access.WriteBackInvalidate();
+            break;
+
+        default: // unknown command
+            err = MSR_STATUS_INVALID_COMMAND;
+            break;
+        }
+
+        if (err && !status)
+            status = err;
+
+        // save data
+        if (i < nOutLen)
+        {
+            pnOut[i] = rec;
+            pnOut[i].value = OutValue;
+        }
+        else if (read && !status)
+        {
+            status = MSR_STATUS_BUFFER_TOO_SMALL;
+        }
+
+        i += extra;
+        if (stop)
+        {
+            i++;
+            break;
+        }
+    }
+
+    if (pnDone)
+        *pnDone = i < nInLen ? i : nInLen;
+    return status;
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Register access for ExecuteMSRCommands working on an in-memory
+// register file instead of the hardware, for testing the command
+// semantics on any machine. Registers never written read as 0.
+//
+//////////////////////////////////////////////////////////////////////
+
+#define MSR_MEMORY_REGISTERS 256 // maximum number of registers in SMSRMemoryAccess
+
+struct SMSRMemoryAccess
+{
+    unsigned int registers[MSR_MEMORY_REGISTERS]; // register numbers
+    long long values[MSR_MEMORY_REGISTERS];       // register values
+    int numRegisters;                             // number of registers used
+    long long processor;                          // processor number set by PROC_SET
+    long long tsc;                                // incremented by each TSC_READ
+    bool pmcEnabled;                              // set by PMC_ENABLE
+
+    SMSRMemoryAccess()
+        : numRegisters(0)
+        , processor(0)
+        , tsc(0)
+        , pmcEnabled(false)
+    {
+    }
+
+    long long* Find(unsigned int reg, bool create)
+    {
+        for (int i = 0; i < numRegisters; i++)
+        {
+            if (registers[i] == reg)
+                return &values[i];
+        }
+        if (!create || numRegisters >= MSR_MEMORY_REGISTERS)
+            return 0;
+        registers[numRegisters] = reg;
+        values[numRegisters] = 0;
+        return &values[numRegisters++];
+    }
+
+    int ReadMSR(unsigned int reg, long long& value)
+    {
+        long long* p = Find(reg, false);
+        value = p ? *p : 0;
+        return 0;
+    }
+
+    int WriteMSR(unsigned int reg, long long value)
+    {
+        long long* p = Find(reg, true);
+        if (!p)
+            return MSR_STATUS_BUFFER_TOO_SMALL;
+        *p = value;
+        return 0;
+    }
+
+    int ReadControlReg(unsigned int, long long& value)
+    {
+        value = 0;
+        return MSR_STATUS_INVALID_COMMAND;
+    }
+
+    int WriteControlReg(unsigned int, long long)
+    {
+        return MSR_STATUS_INVALID_COMMAND;
+    }
+
+    int EnablePMC(bool enable)
+    {
+        pmcEnabled = enable;
+        return 0;
+    }
+
+    int GetProcessor(long long& proc)
+    {
+        proc = processor;
+        return 0;
+    }
+
+    int SetProcessor(long long proc, long long& result)
+    {
+        processor = proc;
+        result = 0;
+        return 0;
+    }
+
+    int ReadTSC(long long& value)
+    {
+        value = ++tsc;
+        return 0;
+    }
+
+    int ReadPMC(unsigned int counter, long long& value)
+    {
+        return ReadMSR(counter, value);
+    }
+
+    int WriteBackInvalidate()
+    {
+        return 0; // no caches
+    }
+};
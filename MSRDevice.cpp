@@ -0,0 +1,376 @@
+#ifndef _WIN32
+#include "CCounters.h"
+#include "MSRCommands.h"
+#include <x86intrin.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <thread>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static const char* DefaultMSRDir = "/dev/cpu";
+static const char* RdpmcSetting = "/sys/bus/event_source/devices/cpu/rdpmc";
+
+// The rdpmc setting is system wide. It is changed by the first CMSRDriver
+// that enables RDPMC and restored by the last one that disables it
+static std::mutex RdpmcLock;  // protects RdpmcUsers and RdpmcSaved
+static int RdpmcUsers = 0;    // number of instances with RDPMC enabled
+static int RdpmcSaved = -1;   // previous value of rdpmc setting
+
+//////////////////////////////////////////////////////////////////////
+//
+// Pool of worker threads, each locked to one processor.
+// A worker is created the first time its processor is used and lives
+// until the pool is destroyed, so repeated batches don't pay for
+// thread creation. Each worker has a queue of tasks, so a processor
+// that occurs more than once in a batch runs its tasks one by one.
+//
+//////////////////////////////////////////////////////////////////////
+
+class CMSRWorkers
+{
+public:
+    ~CMSRWorkers();
+
+    // Run job(i) for i = 0 .. n-1 on the worker for cpus[i]. Returns when all are done.
+    // The jobs of the same processor run in the order of i
+    void Run(const int* cpus, int n, const std::function<void(int)>& job);
+
+private:
+    struct SWorker
+    {
+        std::thread thread;
+        std::deque<std::function<void()>> tasks; // tasks to do, empty if idle
+        bool quit = false;
+    };
+    std::map<int, SWorker*> workers; // worker for each processor
+    std::mutex lock;                 // protects tasks and pending
+    std::condition_variable start;   // signals new task or quit
+    std::condition_variable done;    // signals task finished
+    int pending = 0;                 // number of unfinished tasks
+
+    void Loop(int cpu, SWorker* w);
+};
+
+CMSRWorkers::~CMSRWorkers()
+{
+    {
+        std::lock_guard<std::mutex> g(lock);
+        for (auto& w : workers)
+            w.second->quit = true;
+    }
+    start.notify_all();
+    for (auto& w : workers)
+    {
+        w.second->thread.join();
+        delete w.second;
+    }
+}
+
+void CMSRWorkers::Loop(int cpu, SWorker* w)
+{
+    // lock this thread to its processor
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    sched_setaffinity(0, sizeof(set), &set);
+
+    std::unique_lock<std::mutex> g(lock);
+    for (;;)
+    {
+        start.wait(g, [w] { return w->quit || !w->tasks.empty(); });
+        if (w->quit)
+            return;
+        std::function<void()> task = std::move(w->tasks.front());
+        w->tasks.pop_front();
+        g.unlock();
+        task();
+        g.lock();
+        if (--pending == 0)
+            done.notify_one();
+    }
+}
+
+void CMSRWorkers::Run(const int* cpus, int n, const std::function<void(int)>& job)
+{
+    std::unique_lock<std::mutex> g(lock);
+    for (int i = 0; i < n; i++)
+    {
+        SWorker*& w = workers[cpus[i]];
+        if (!w)
+        {
+            w = new SWorker;
+            w->thread = std::thread(&CMSRWorkers::Loop, this, cpus[i], w);
+        }
+        w->tasks.push_back([&job, i] { job(i); });
+        pending++;
+    }
+    start.notify_all();
+    done.wait(g, [this] { return pending == 0; });
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+//                     class CMSRDriver (Linux)
+//
+//////////////////////////////////////////////////////////////////////
+
+CMSRDriver::CMSRDriver()
+    : cpu(0)
+    , rdpmcOn(false)
+    , workers(NULL)
+{
+    const char* d = getenv("PMC_MSR_DIR");
+    dir = d && *d ? d : DefaultMSRDir;
+    fake = dir != DefaultMSRDir;
+}
+
+CMSRDriver::~CMSRDriver()
+{
+    delete workers;
+    SetRdpmc(false);
+    for (int fd : fds)
+    {
+        if (fd >= 0)
+            close(fd);
+    }
+}
+
+int CMSRDriver::LoadDriver()
+{
+    // Check that the msr file of the present processor can be opened
+    int c = sched_getcpu();
+    cpu = c < 0 ? 0 : c;
+    if (GetFd(cpu) < 0)
+    {
+        int e = errno;
+        printf("\nCan't open %s/%i/msr. error %i", dir.c_str(), cpu, e);
+        if (!fake)
+            printf("\nLoad the msr module with 'modprobe msr' and run as root");
+        return e ? e : 1;
+    }
+    return 0;
+}
+
+int CMSRDriver::GetFd(int c)
+{
+    if (c < 0)
+    {
+        errno = EINVAL; // callers report errno
+        return -1;
+    }
+    std::lock_guard<std::mutex> g(fdsLock);
+    if ((size_t)c >= fds.size())
+        fds.resize(c + 1, -1);
+    if (fds[c] < 0)
+    {
+        std::string name = dir + "/" + std::to_string(c) + "/msr";
+        fds[c] = open(name.c_str(), O_RDWR);
+    }
+    return fds[c];
+}
+
+int CMSRDriver::SetRdpmc(bool on)
+{
+    // With the MSR driver in Windows, PMC_ENABLE sets CR4.PCE.
+    // Linux controls CR4.PCE through sysfs. 2 = RDPMC allowed for all processes
+    if (fake)
+        return 0;
+    std::lock_guard<std::mutex> g(RdpmcLock);
+    if (on == rdpmcOn)
+        return 0;
+    rdpmcOn = on;
+    if (on ? RdpmcUsers++ > 0 : --RdpmcUsers > 0)
+        return 0; // another instance has changed the setting
+    int fd = open(RdpmcSetting, O_RDWR);
+    if (fd < 0)
+        return errno;
+    int err = 0;
+    char buf[16] = {0};
+    if (on)
+    {
+        if (pread(fd, buf, sizeof(buf) - 1, 0) > 0 && pwrite(fd, "2", 1, 0) == 1)
+            RdpmcSaved = atoi(buf);
+        else
+            err = errno;
+    }
+    else
+    {
+        if (RdpmcSaved >= 0)
+        {
+            int len = snprintf(buf, sizeof(buf), "%i", RdpmcSaved);
+            if (pwrite(fd, buf, len, 0) != len)
+                err = errno;
+        }
+        RdpmcSaved = -1;
+    }
+    close(fd);
+    return err;
+}
+
+// Register access for ExecuteMSRCommands through /dev/cpu/N/msr
+struct SMSRDeviceAccess
+{
+    CMSRDriver& driver;
+    int& cpu;      // processor selected by PROC_SET
+    bool fixedCpu; // ignore PROC_SET
+
+    // errno if the call failed, EIO if it transferred less than the whole register
+    static int Status(ssize_t result, int e)
+    {
+        if (result < 0)
+            return e ? e : EIO;
+        return result == sizeof(long long) ? 0 : EIO;
+    }
+
+    int ReadMSR(unsigned int reg, long long& value)
+    {
+        ssize_t r = pread(driver.GetFd(cpu), &value, sizeof(value), reg);
+        return Status(r, errno);
+    }
+
+    int WriteMSR(unsigned int reg, long long value)
+    {
+        ssize_t r = pwrite(driver.GetFd(cpu), &value, sizeof(value), reg);
+        return Status(r, errno);
+    }
+
+    int ReadControlReg(unsigned int, long long& value)
+    {
+        value = 0;
+        return EINVAL; // not accessible in Linux user mode
+    }
+
+    int WriteControlReg(unsigned int, long long)
+    {
+        return EINVAL;
+    }
+
+    int EnablePMC(bool enable)
+    {
+        return driver.SetRdpmc(enable);
+    }
+
+    int GetProcessor(long long& proc)
+    {
+        proc = cpu;
+        return 0;
+    }
+
+    int SetProcessor(long long proc, long long& result)
+    {
+        result = 0;
+        if (fixedCpu)
+            return 0;
+        if (driver.GetFd((int)proc) < 0)
+            result = errno ? errno : EINVAL;
+        else
+            cpu = (int)proc;
+        return 0;
+    }
+
+    // TSC_READ and PMC_READ are executed on the calling thread,
+    // which must be locked to the selected processor
+    int ReadTSC(long long& value)
+    {
+        value = (long long)__rdtsc();
+        return 0;
+    }
+
+    int ReadPMC(unsigned int counter, long long& value)
+    {
+        value = (long long)PerfReadpmc(counter);
+        return 0;
+    }
+
+    int WriteBackInvalidate()
+    {
+        return EINVAL; // privileged instruction, not available in Linux user mode
+    }
+};
+
+int CMSRDriver::Execute(int& c, bool fixedCpu, const SMSRInOut* pnIn, int nInLen, SMSRInOut* pnOut, int nOutLen)
+{
+    SMSRDeviceAccess access = {*this, c, fixedCpu};
+    int status = ExecuteMSRCommands(access, pnIn, nInLen, pnOut, nOutLen);
+    if (status == MSR_STATUS_INVALID_COMMAND)
+        status = EINVAL;
+    if (status == MSR_STATUS_BUFFER_TOO_SMALL)
+        status = ENOBUFS;
+    return status;
+}
+
+int CMSRDriver::AccessRegisters(SMSRInOut* pnIn, int nInLen, SMSRInOut* pnOut, int nOutLen)
+{
+    if (nInLen <= 0)
+        return 0;
+
+    int res = Execute(cpu, false, pnIn, nInLen, pnOut, nOutLen);
+    if (res)
+    {
+        printf("\nCan't access MSR device %s/%i/msr. error %i", dir.c_str(), cpu, res);
+        return res;
+    }
+
+    // Check return error codes
+    for (int i = 0; i < nOutLen; i++)
+    {
+        if (pnOut[i].msr_command == PROC_SET && pnOut[i].val[0])
+        {
+            printf("\nSetting processor number failed, error 0x%X", pnOut[i].val[0]);
+        }
+    }
+    return 0;
+}
+
+int CMSRDriver::AccessRegisters(CMSRInOutQue& q)
+{
+    int n = q.GetSize();
+    if (n <= 0)
+        return 0;
+    return AccessRegisters(q.queue.data(), n, q.queue.data(), n);
+}
+
+int CMSRDriver::AccessRegisters(const CMSRInOutQue& q, const int* cpus, int numCpus, std::vector<CMSRInOutQue>& results)
+{
+    results.assign(numCpus, q);
+    int n = q.GetSize();
+    if (n <= 0 || numCpus <= 0)
+        return 0;
+
+    // Open all files first, so the workers don't need to
+    for (int i = 0; i < numCpus; i++)
+    {
+        if (GetFd(cpus[i]) < 0)
+        {
+            int e = errno;
+            printf("\nCan't open %s/%i/msr. error %i", dir.c_str(), cpus[i], e);
+            return e ? e : 1;
+        }
+    }
+
+    if (!workers)
+        workers = new CMSRWorkers;
+
+    std::vector<int> status(numCpus);
+    workers->Run(cpus, numCpus, [&](int i) {
+        int c = cpus[i];
+        status[i] = Execute(c, true, q.queue.data(), n, results[i].queue.data(), n);
+    });
+
+    for (int i = 0; i < numCpus; i++)
+    {
+        if (status[i])
+        {
+            printf("\nCan't access MSR device %s/%i/msr. error %i", dir.c_str(), cpus[i], status[i]);
+            return status[i];
+        }
+    }
+    return 0;
+}
+#endif
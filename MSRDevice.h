@@ -0,0 +1,103 @@
+#pragma once
+#ifndef _WIN32
+#include "MSRDriver.h"
+#include <string>
+#include <vector>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+
+class CMSRInOutQue;
+class CMSRWorkers;
+
+//////////////////////////////////////////////////////////////////////
+//
+//                     class CMSRDriver (Linux)
+//
+// This class executes the same SMSRInOut command lists as the Windows
+// driver MSRDriver.sys, using pread/pwrite on /dev/cpu/N/msr. This needs
+// the msr kernel module and root privileges (or CAP_SYS_RAWIO).
+// PROC_SET selects the /dev/cpu/N/msr file used by the following commands.
+//
+// The device directory can be changed with the environment variable
+// PMC_MSR_DIR. It may point to a directory of fake files N/msr where
+// the file offset is the register number, for testing on machines
+// without the msr module.
+//
+//////////////////////////////////////////////////////////////////////
+
+class CMSRDriver
+{
+public:
+    CMSRDriver();
+    ~CMSRDriver();
+
+    int LoadDriver(); // return 0 if the msr device can be accessed
+
+    // read or write MSR registers on the processor selected by PROC_SET
+    int AccessRegisters(SMSRInOut* pnIn, int nInLen, SMSRInOut* pnOut, int nOutLen);
+
+    int AccessRegisters(SMSRInOut& q)
+    {
+        return AccessRegisters(&q, 1, &q, 1);
+    }
+
+    int AccessRegisters(CMSRInOutQue& q);
+
+    // Execute the commands in q on each of the processors in cpus[] in parallel,
+    // from worker threads locked to these processors. PROC_SET commands in q are
+    // ignored. results[i] receives the output for cpus[i]
+    int AccessRegisters(const CMSRInOutQue& q, const int* cpus, int numCpus, std::vector<CMSRInOutQue>& results);
+
+    // read one MSR register
+    int64_t MSRRead(int r)
+    {
+        SMSRInOut a;
+        a.msr_command = MSR_READ;
+        a.register_number = r;
+        a.value = 0;
+        AccessRegisters(a);
+        return a.value;
+    }
+
+    // write one MSR register
+    int MSRWrite(int r, int64_t val)
+    {
+        SMSRInOut a;
+        a.msr_command = MSR_WRITE;
+        a.register_number = r;
+        a.value = val;
+        return AccessRegisters(a);
+    }
+
+    // control registers are not accessible in Linux user mode
+    size_t CRRead(int)
+    {
+        return 0;
+    }
+
+    int CRWrite(int, size_t)
+    {
+        return -12;
+    }
+
+private:
+    std::string dir;       // directory containing N/msr files
+    bool fake;             // dir is not /dev/cpu
+    int cpu;               // processor selected by PROC_SET
+    std::vector<int> fds;  // file descriptor for each processor, -1 if not open
+    std::mutex fdsLock;    // protects fds
+    bool rdpmcOn;          // this instance has enabled RDPMC
+    CMSRWorkers* workers;  // thread pool for multi-processor access
+
+    int GetFd(int cpu);     // get file descriptor for /dev/cpu/N/msr, -1 if error
+    int SetRdpmc(bool on);  // allow or restore RDPMC in user mode. Shared by all instances
+    // execute commands on processor cpu. return 0 or errno
+    int Execute(int& cpu, bool fixedCpu, const SMSRInOut* pnIn, int nInLen, SMSRInOut* pnOut, int nOutLen);
+
+    friend struct SMSRDeviceAccess;
+
+    CMSRDriver& operator=(const CMSRDriver&) = delete;
+    CMSRDriver(const CMSRDriver&) = delete;
+};
+#endif
@@ -24,6 +24,7 @@
 #include <intrin.h>    // Intrinsic functions
 #endif
 #include "MSRDriver.h" // Structures shared with calling program
+#include "MSRCommands.h" // Command interpreter
 
 // Define 32/64 bit integer
 #ifndef _SIZE_T_DEFINED
@@ -39,6 +40,87 @@ typedef unsigned int size_t;
 static size_t ReadCR(int r);              // read control register
 static void WriteCR(int r, size_t value); // write control register
 
+// Register access for the command interpreter. Runs in the context of the calling thread
+struct SKernelAccess
+{
+    int ReadMSR(unsigned int reg, long long& value)
+    {
+        value = __readmsr(reg);
+        return 0;
+    }
+
+    int WriteMSR(unsigned int reg, long long value)
+    {
+        __writemsr(reg, value);
+        return 0;
+    }
+
+    int ReadControlReg(unsigned int reg, long long& value)
+    {
+        value = (long long)ReadCR(reg);
+        return 0;
+    }
+
+    int WriteControlReg(unsigned int reg, long long value)
+    {
+        WriteCR(reg, (size_t)value);
+        return 0;
+    }
+
+    int EnablePMC(bool enable)
+    {
+        union
+        {
+            size_t val; // value of cr4 register, 32 or 64 bits
+            int lo;     // low 32 bits of value
+        } cr4val;
+        cr4val.val = __readcr4(); // Read CR4
+        if (enable)
+        {
+            cr4val.lo |= 0x100; // Enable RDPMC
+            cr4val.lo &= ~4;    // Enable RDTSC
+        }
+        else
+        {
+            cr4val.lo &= ~0x100; // Disable RDPMC
+            // cr4val.lo |= 4;   // Disable RDTSC
+        }
+        __writecr4(cr4val.val); // Write CR4
+        return 0;
+    }
+
+    int GetProcessor(long long& proc)
+    {
+        proc = KeGetCurrentProcessorNumber();
+        return 0;
+    }
+
+    int SetProcessor(long long proc, long long& result)
+    {
+        size_t affinity = (size_t)1 << proc;
+        result = ZwSetInformationThread(ZwCurrentThread(), ThreadAffinityMask, &affinity, sizeof(affinity));
+        return 0;
+    }
+
+    int ReadTSC(long long& value)
+    {
+        value = __rdtsc();
+        return 0;
+    }
+
+    int ReadPMC(unsigned int counter, long long& value)
+    {
+        value = __readpmc(counter);
+        return 0;
+    }
+
+    int WriteBackInvalidate()
+    {
+        __wbinvd();
+        return 0;
+    }
+};
+
 UNICODE_STRING g_usDeviceName = {40, 42, L"\\Device\\devMSRDriver"};
 
 UNICODE_STRING g_usSymbolicLinkName = {30, 32, L"\\??\\slMSRDriver"};
@@ -77,14 +159,7 @@ NTSTATUS DispatchControl(IN PDEVICE_OBJECT /*pDeviceObject*/, IN PIRP pIrp)
     NTSTATUS status = STATUS_SUCCESS;
     ULONG dwInArrSize;
     ULONG dwOutArrSize;
-    int i = 0, n1, n2 = 0, reg;
-    EMSR_COMMAND command;
-    long long InValue, OutValue;
-    union
-    {
-        size_t val; // value of cr4 register, 32 or 64 bits
-        int lo;     // low 32 bits of value
-    } cr4val;
+    int i = 0, n1, n2 = 0, err;
 
     PIO_STACK_LOCATION pIOStack = IoGetCurrentIrpStackLocation(pIrp);
 
@@ -118,85 +193,16 @@ NTSTATUS DispatchControl(IN PDEVICE_OBJECT /*pDeviceObject*/, IN PIRP pIrp)
         n1 = dwInArrSize / sizeof(SMSRInOut);
         n2 = dwOutArrSize / sizeof(SMSRInOut);
 
-        // command loop
-        for (i = 0; i < n1; i++, pInOut++)
+        // execute commands
+        SKernelAccess access;
+        err = ExecuteMSRCommands(access, pInOut, n1, pInOut, n2, &i);
+        if (err == MSR_STATUS_BUFFER_TOO_SMALL)
+        {
+            status = STATUS_BUFFER_TOO_SMALL;
+        }
+        else if (err)
         {
-            // get command
-            command = pInOut->msr_command;
-            // get register number
-            reg = pInOut->register_number;
-            // get data
-            InValue = pInOut->value;
-            OutValue = 0;
-
-            // dispatch command
-            switch (command)
-            {
-            case MSR_IGNORE: // do nothing
-                break;
-
-            case MSR_STOP: // stop loop
-                i = n1;
-                break;
-
-            case MSR_READ: // read model-specific register
-                OutValue = __readmsr(reg);
-                break;
-
-            case MSR_WRITE: // write model-specific register
-                __writemsr(reg, InValue);
-                break;
-
-            case CR_READ: // read control register
-                OutValue = (long long)ReadCR(reg);
-                break;
-
-            case CR_WRITE: // write control register
-                WriteCR(reg, (size_t)InValue);
-                break;
-
-            case PMC_ENABLE:              // Enable RDPMC and RDTSC instructions
-                cr4val.val = __readcr4(); // Read CR4
-                cr4val.lo |= 0x100;       // Enable RDPMC
-                cr4val.lo &= ~4;          // Enable RDTSC
-                __writecr4(cr4val.val);   // Write CR4
-                break;
-
-            case PMC_DISABLE:             // Disable RDPMC instruction (RDTSC remains enabled)
-                cr4val.val = __readcr4(); // Read CR4
-                cr4val.lo &= ~0x100;      // Disable RDPMC
-                // cr4val.lo |= 4;        // Disable RDTSC
-                __writecr4(cr4val.val);   // Write CR4
-                break;
-
-            case PROC_GET: // Which processor number am I running on (in multiprocessor system)
-                OutValue = KeGetCurrentProcessorNumber();
-                break;
-
-            case PROC_SET:
-            { // Fix to certain processor number (in multiprocessor system)
-                size_t affinity = (size_t)1 << InValue;
-                OutValue = ZwSetInformationThread(ZwCurrentThread(), ThreadAffinityMask, &affinity, sizeof(affinity));
-                break;
-            }
-
-            default: // unknown command
-                status = STATUS_INVALID_DEVICE_REQUEST;
-                break;
-            }
-
-            // save data
-            if (i < n2)
-            {
-                pInOut->value = OutValue;
-            }
-            else
-            {
-                if (command == MSR_READ || command == CR_READ)
-                {
-                    status = STATUS_BUFFER_TOO_SMALL;
-                }
-            }
+            status = STATUS_INVALID_DEVICE_REQUEST;
         }
     }
     else
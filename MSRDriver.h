@@ -10,17 +10,22 @@
 // commands for MSR driver. Shared with application program
 enum EMSR_COMMAND
 {
-    MSR_IGNORE = 0,      // do nothing
-    MSR_STOP = 1,        // skip rest of list
-    MSR_READ = 2,        // read model specific register
-    MSR_WRITE = 3,       // write model specific register
-    CR_READ = 4,         // read control register
-    CR_WRITE = 5,        // write control register
-    PMC_ENABLE = 6,      // Enable RDPMC and RDTSC instructions
-    PMC_DISABLE = 7,     // Disable RDPMC instruction (RDTSC remains enabled)
-    PROC_GET = 8,        // Get processor number (In multiprocessor systems. 0-based)
-    PROC_SET = 9,        // Set processor number (In multiprocessor systems. 0-based)
-    UNUSED1 = 0x7fffffff // make sure this enum takes 32 bits
+    MSR_IGNORE = 0,        // do nothing
+    MSR_STOP = 1,          // skip rest of list
+    MSR_READ = 2,          // read model specific register
+    MSR_WRITE = 3,         // write model specific register
+    CR_READ = 4,           // read control register
+    CR_WRITE = 5,          // write control register
+    PMC_ENABLE = 6,        // Enable RDPMC and RDTSC instructions
+    PMC_DISABLE = 7,       // Disable RDPMC instruction (RDTSC remains enabled)
+    PROC_GET = 8,          // Get processor number (In multiprocessor systems. 0-based)
+    PROC_SET = 9,          // Set processor number (In multiprocessor systems. 0-based)
+    MSR_WRITE_MASKED = 10, // Read-modify-write. Bits in mask (value of next record) are replaced by value
+    MSR_READ_RANGE = 11,   // Read value consecutive registers into the value of the following records
+    TSC_READ = 12,         // Read time stamp counter
+    PMC_READ = 13,         // Read performance monitor counter register_number with RDPMC
+    CACHE_WBINVD = 14,     // Write back and invalidate all caches with WBINVD
+    UNUSED1 = 0x7fffffff   // make sure this enum takes 32 bits
 };
 
 // input/output data structure for MSR driver
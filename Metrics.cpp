@@ -0,0 +1,220 @@
+#include "Metrics.h"
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+CMetric::CMetric()
+{
+    depth = 0;
+    next = NULL;
+    lookup = NULL;
+}
+
+// Compile formula to postfix program (return value is error message)
+const char* CMetric::parse(const char* formula, CCounters& counters)
+{
+    program.clear();
+    types.clear();
+    depth = 0;
+    next = formula;
+    lookup = &counters;
+    bool ok = ParseSum();
+    SkipSpace();
+    if (ok && *next)
+        ok = Fail("Unexpected character");
+    lookup = NULL;
+    if (!ok)
+    {
+        program.clear();
+        types.clear();
+        return error.c_str();
+    }
+    return NULL;
+}
+
+bool CMetric::Fail(const char* message)
+{
+    error = std::string(message) + " at \"" + next + "\"";
+    return false;
+}
+
+void CMetric::Emit(EOperation op, double value, int index)
+{
+    SInstruction ins = {op, value, index};
+    program.push_back(ins);
+}
+
+void CMetric::SkipSpace()
+{
+    while (isspace((unsigned char)*next))
+        next++;
+}
+
+// sum = product {(+|-) product}
+bool CMetric::ParseSum()
+{
+    if (!ParseProduct())
+        return false;
+    for (;;)
+    {
+        SkipSpace();
+        char c = *next;
+        if (c != '+' && c != '-')
+            return true;
+        next++;
+        if (!ParseProduct())
+            return false;
+        Emit(c == '+' ? OP_ADD : OP_SUB);
+        depth--;
+    }
+}
+
+// product = factor {(*|/) factor}
+bool CMetric::ParseProduct()
+{
+    if (!ParseFactor())
+        return false;
+    for (;;)
+    {
+        SkipSpace();
+        char c = *next;
+        if (c != '*' && c != '/')
+            return true;
+        next++;
+        if (!ParseFactor())
+            return false;
+        Emit(c == '*' ? OP_MUL : OP_DIV);
+        depth--;
+    }
+}
+
+// factor = -factor | (sum) | #N | [NAME] | clock | elements | number
+bool CMetric::ParseFactor()
+{
+    SkipSpace();
+    if (*next == '-')
+    {
+        next++;
+        if (!ParseFactor())
+            return false;
+        Emit(OP_NEG);
+        return true;
+    }
+    if (*next == '(')
+    {
+        next++;
+        if (!ParseSum())
+            return false;
+        SkipSpace();
+        if (*next != ')')
+            return Fail("Missing )");
+        next++;
+        return true;
+    }
+
+    // operands
+    if (++depth > MAX_METRIC_DEPTH)
+        return Fail("Formula too complex");
+    if (*next == '#')
+    {
+        char* end;
+        long type = strtol(next + 1, &end, 0);
+        if (end == next + 1 || type <= 0)
+            return Fail("Counter type expected");
+        next = end;
+        return ParseCounter((int)type);
+    }
+    if (*next == '[')
+    {
+        const char* close = strchr(next, ']');
+        if (!close)
+            return Fail("Missing ]");
+        std::string name(next + 1, close - next - 1);
+        int type = lookup->findCounterType(name.c_str());
+        if (type == 0)
+            return Fail("Unknown counter");
+        next = close + 1;
+        return ParseCounter(type);
+    }
+    if (strncmp(next, "clock", 5) == 0 && !isalnum((unsigned char)next[5]))
+    {
+        next += 5;
+        Emit(OP_CLOCK);
+        return true;
+    }
+    if (strncmp(next, "elements", 8) == 0 && !isalnum((unsigned char)next[8]))
+    {
+        next += 8;
+        Emit(OP_ELEMENTS);
+        return true;
+    }
+    char* end;
+    double value = strtod(next, &end);
+    if (end == next)
+        return Fail("Operand expected");
+    next = end;
+    Emit(OP_NUMBER, value);
+    return true;
+}
+
+// operand with the count of CounterType
+bool CMetric::ParseCounter(int CounterType)
+{
+    int index = 0;
+    while (index < (int)types.size() && types[index] != CounterType)
+        index++;
+    if (index == MAXCOUNTERS)
+        return Fail("Too many counters");
+    if (index == (int)types.size())
+        types.push_back(CounterType);
+    Emit(OP_COUNTER, 0, index);
+    return true;
+}
+
+// Run the postfix program
+double CMetric::evaluate(const double counts[], double clock, double elements) const
+{
+    double stack[MAX_METRIC_DEPTH];
+    int sp = 0;
+    if (program.empty())
+        return NAN;
+    for (const SInstruction& ins : program)
+    {
+        switch (ins.op)
+        {
+        case OP_NUMBER:
+            stack[sp++] = ins.value;
+            break;
+        case OP_COUNTER:
+            stack[sp++] = counts[ins.index];
+            break;
+        case OP_CLOCK:
+            stack[sp++] = clock;
+            break;
+        case OP_ELEMENTS:
+            stack[sp++] = elements;
+            break;
+        case OP_ADD:
+            sp--;
+            stack[sp - 1] += stack[sp];
+            break;
+        case OP_SUB:
+            sp--;
+            stack[sp - 1] -= stack[sp];
+            break;
+        case OP_MUL:
+            sp--;
+            stack[sp - 1] *= stack[sp];
+            break;
+        case OP_DIV:
+            sp--;
+            stack[sp - 1] = stack[sp] != 0 ? stack[sp - 1] / stack[sp] : NAN;
+            break;
+        case OP_NEG:
+            stack[sp - 1] = -stack[sp - 1];
+            break;
+        }
+    }
+    return stack[0];
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include "CCounters.h"
+#include <string>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//
+// Derived metrics computed from the counts of a test, e.g. instructions
+// per clock cycle or cache misses per 1000 instructions.
+//
+// A metric is a formula with the operators + - * / and parentheses over
+// these operands:
+//
+//   #N        count of counter type N, e.g. #9 for instructions
+//   [NAME]    count of the counter with this name, e.g. [INST_RETIRED.ANY]
+//             or [event=0xa3,umask=0x14]. See CCounters::findCounterType
+//   clock     clock count
+//   elements  number of elements that one run of the test code processes
+//   1000      a number
+//
+// The formulas for each PMC scheme and processor family are in
+// MetricDefinitions in CounterDefinitions.h. A formula is compiled once to
+// a postfix program, which is evaluated for each repetition and for the
+// summary statistics. A division by zero gives NaN.
+//
+//////////////////////////////////////////////////////////////////////
+
+// maximum depth of the evaluation stack of a formula
+const int MAX_METRIC_DEPTH = 32;
+
+class CMetric
+{
+public:
+    CMetric();
+
+    // compile formula. Counter names are looked up with counters. Returns error message or NULL
+    const char* parse(const char* formula, CCounters& counters);
+
+    // counter types used by the formula, in order of first use
+    const std::vector<int>& counterTypes() const
+    {
+        return types;
+    }
+
+    // value of the formula. counts[i] is the count of counter type counterTypes()[i]
+    double evaluate(const double counts[], double clock, double elements) const;
+
+protected:
+    enum EOperation
+    {
+        OP_NUMBER,   // push value
+        OP_COUNTER,  // push counts[index]
+        OP_CLOCK,    // push clock
+        OP_ELEMENTS, // push elements
+        OP_ADD,
+        OP_SUB,
+        OP_MUL,
+        OP_DIV,
+        OP_NEG
+    };
+
+    struct SInstruction
+    {
+        EOperation op;
+        double value; // OP_NUMBER
+        int index;    // OP_COUNTER
+    };
+
+    // recursive descent parser. Each function returns false on error
+    bool ParseSum();
+    bool ParseProduct();
+    bool ParseFactor();
+    bool ParseCounter(int CounterType);
+    bool Fail(const char* message);
+    void Emit(EOperation op, double value = 0, int index = 0);
+    void SkipSpace();
+
+    std::vector<SInstruction> program; // postfix program
+    std::vector<int> types;            // counter types used
+    int depth;                         // stack depth during parsing
+    const char* next;                  // parse position
+    CCounters* lookup;                 // for counter names during parsing
+    std::string error;                 // storage for error message
+};
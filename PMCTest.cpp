@@ -11,6 +11,119 @@
 // In 64-bit Windows: Run as administrator, with driver signature enforcement
 // off.
 //
+// In Linux the counters are set up with perf_event_open. Compile with
+//     g++ -O2 -std=c++20 -pthread PMCTest.cpp CCounters.cpp CacheControl.cpp EventDatabase.cpp LowNoise.cpp Metrics.cpp PerfEvents.cpp MSRDevice.cpp Results.cpp Statistics.cpp
+// RDPMC in user mode requires /sys/bus/event_source/devices/cpu/rdpmc >= 1,
+// otherwise the counters are read with a system call.
+// With command line option
+//     -msr
+// the counters are programmed directly through /dev/cpu/N/msr instead
+// (modprobe msr, run as root).
+//
+// Command line options for all platforms:
+//     -serialize cpuid|lfence|rdtscp|mfence|none
+//          How the counter reads are kept in order with the test code.
+//          cpuid is fully serializing but slow, and very slow in virtual machines.
+//     -checkcommands
+//          Check the MSR command interpreter against an in-memory register file and exit.
+//     -serializereport
+//          Print overhead and jitter of each serialization method before the test.
+//     -repetitions N
+//          Number of repetitions of the test code. Default REPETITIONS.
+//     -overhead N
+//          Number of repetitions of the loop that finds the overhead. Default OVERHEAD_REPETITIONS.
+//     -outliers K
+//          Leave out repetitions more than K median absolute deviations from the median
+//          in the statistics.
+//     -stat min|median
+//          Statistic for the confidence interval and for adaptive mode. Default median.
+//     -adaptive W
+//          Repeat until the confidence interval of the clock count is narrower than
+//          W times the statistic (e.g. 0.01), or -repetitions is reached.
+//     -budget S
+//          Adaptive mode: stop after S seconds.
+//     -inner N
+//          Run the test code N times in each repetition. Counts are reported per run.
+//     -mincycles C
+//          Find the smallest power of 2 inner repeat count that makes each repetition
+//          take at least C clock counts, e.g. 10000. Use this for very short test code,
+//          where the overhead of reading the counters is large compared to the code.
+//     -warmup T
+//          Before the measured repetitions, run the test code until the clock count and
+//          the ratio of core clock to reference clock change less than the fraction T
+//          between two windows of WARMUP_WINDOW runs. Default WARMUP_TOLERANCE. 0 = off.
+//     -warmuptime S
+//          Maximum time for warm-up in seconds. Default WARMUP_MAXTIME.
+//     -raw
+//          Print the counts of every repetition, also when there are more than MAXPRINTROWS.
+//     -events FILE
+//          Load counter definitions from a JSON file, e.g. an Intel perfmon event file.
+//          See EventDatabase.h. Can be given more than once.
+//     -counters LIST
+//          Counters to use instead of counterTypesDesired, as a comma separated list of
+//          id numbers and event names, e.g. 1,9,INST_RETIRED.ANY
+//     -event SPEC
+//          Add a raw event for Intel or AMD to the counters, e.g.
+//          event=0xa3,umask=0x14,cmask=20 for cycles with memory loads outstanding.
+//          The terms are event, umask, cmask, edge, inv, any, usr and os.
+//          Can be given more than once.
+//     -cpus LIST
+//          Also set up the counters on the processors in a comma separated list, e.g. 2,3,5,
+//          for test code that runs threads on them. Needs the driver backend (-msr in Linux),
+//          which sets up all of them in parallel.
+//     -tma
+//          Top-down microarchitecture analysis: the fractions of issue slots that are
+//          retiring, bad speculation, frontend bound and backend bound. Uses the topdown
+//          slots and PERF_METRICS of Intel Ice Lake and later with -msr, and level 2 on
+//          Golden Cove. Otherwise the level 1 fractions are computed from general events
+//          on Haswell and Skylake, which may need extra passes.
+//     -metrics LIST
+//          Derived metrics to compute instead of metricTypesDesired, as a comma separated
+//          list of id numbers and names from MetricDefinitions, e.g. IPC,L1DM/KI
+//     -metric [NAME=]FORMULA
+//          Add a metric with a formula over counter types, e.g. "MissRate=#311/#9".
+//          See Metrics.h. Can be given more than once. The counters that the metrics
+//          need are added to the counters.
+//     -elements N
+//          Number of elements or requests processed by one run of the test code, for metrics
+//          and the time per element.
+//     -bytes N
+//          Number of bytes processed by one run of the test code, for bytes per clock and GB/s.
+//     -noise
+//          Tag the repetitions that are disturbed by interrupts, system management interrupts,
+//          migration to another processor or thermal and power throttling, and leave them out
+//          of the statistics. Interrupts are counted with a counter in every pass where the
+//          processor has one. With -msr on Intel, the SMI count and the throttle logs are
+//          read through the driver after each repetition, which adds a system call between
+//          repetitions.
+//     -noisekeep
+//          As -noise, but the tagged repetitions are kept in the statistics.
+//     -lownoise
+//          Linux: run the test thread with SCHED_FIFO and lock all memory with mlockall,
+//          which also faults in the code and data pages. Prints a preflight report that
+//          warns if the processor is not in isolcpus or nohz_full, has interrupts routed
+//          to it, or has a busy hyperthread sibling. Everything is restored after the test.
+//          Needs CAP_SYS_NICE and CAP_IPC_LOCK. See LowNoise.h.
+//     -thp on|off|default
+//          Linux: use transparent huge pages for the test buffers, no huge pages at all,
+//          or the system setting.
+//          A huge page maps an aligned 2 MB block, so "on" only has an effect on buffers
+//          that contain such a block. UserData is smaller. Allocate larger buffers aligned
+//          to 2 MB and give them to CLowNoise::prepareBuffer.
+//     -cache MODE
+//          Cache state before each repetition, set up outside the timed region:
+//          asis (default): what the previous repetition left.
+//          warm: the test code runs once untimed before each repetition.
+//          cold-data: the buffers in RegisterUserBuffers are flushed with CLFLUSHOPT.
+//          cold-all: the caches are evicted by reading a buffer twice the size of the
+//          last level cache. The cost of this is reported.
+//     -wbinvd
+//          With -cache cold-all, also write back and invalidate all caches with WBINVD.
+//          Needs the Windows driver and -msr.
+//
+// The time in nanoseconds is found from the frequency of the time stamp counter, read from
+// cpuid or measured against the clock of the operating system.
+//
 // See PMCTest.txt for further instructions.
 //
 // To turn on counters for use in another program, run with command line option
@@ -21,22 +134,51 @@
 //  2000-2022 GNU General Public License v. 3. www.gnu.org/licenses
 //////////////////////////////////////////////////////////////////////////////
 
+#include "CacheControl.h"
 #include "CCounters.h"
+#include "EventSets.h"
+#include "Metrics.h"
+#include "Results.h"
+#include "Statistics.h"
+#ifdef _WIN32
 #include <windows.h>
+#endif
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <utility>
 
-// number of repetitions of test. You may change this up to MAXREPEAT
+// default number of repetitions of test. Can be changed with -repetitions
 #define REPETITIONS 8
 
 // Subtract overhead from counts (0 if not)
 #define SUBTRACT_OVERHEAD 1
 
-// Number of repetitions in loop to find overhead
+// Default number of repetitions in loop to find overhead. Can be changed with -overhead
 #define OVERHEAD_REPETITIONS 5
 
-// Cache line size (for preventing threads using same cache lines)
-#define CACHELINESIZE 64
+// Print the counts of each repetition if there are no more than this number of repetitions
+#define MAXPRINTROWS 100
+
+// Adaptive mode: number of repetitions before the first check of the confidence interval.
+// Later checks are made each time the number of repetitions has grown by 25%
+#define ADAPTIVE_FIRST_CHECK 16
+
+// -mincycles: repetitions of the test at each inner repeat count, and maximum inner repeat count
+#define CALIBRATE_REPETITIONS 5
+#define MAXINNERREPEAT (1 << 24)
+
+// Warm-up: maximum relative change between two windows, number of runs in each window,
+// and maximum time in seconds
+#define WARMUP_TOLERANCE 0.02
+#define WARMUP_WINDOW 8
+#define WARMUP_MAXTIME 1.0
+
+// Number of repetitions for each method in the serialization overhead report
+#define SERIALIZE_REPORT_REPETITIONS 1000
 
 /*############################################################################
 #
@@ -45,9 +187,11 @@
 ############################################################################*/
 //
 // Here you can select which performance monitor counters you want for your test.
-// Select id numbers from the table CounterDefinitions[] in PMCTest.cpp.
-// The maximum number of counters you can have is MAXCOUNTERS.
-// Insert zeros if you have less than MAXCOUNTERS counters.
+// Select id numbers from the table CounterDefinitions[] in CounterDefinitions.h,
+// or give a list of ids and event names with the command line option -counters.
+// If there are more counters than the processor can count at the same time,
+// the test is run in several passes, each with a group of counters that fit.
+// Every pass also counts the anchor counters, so the passes can be compared.
 
 static const int counterTypesDesired[] = {
     1,   // core clock cycles (Intel Core 2 and later)
@@ -56,20 +200,111 @@ static const int counterTypesDesired[] = {
     311  // data cache mises
 };
 
-struct SCounterData
+// Event set that is planned at compile time for all processors, see EventSets.h. The test
+// does not use it, but it checks the counter definitions: the build fails if the events don't
+// fit in the counter registers of a processor where they are all defined.
+// A set like EventSet<CoreCycles, Instructions, CoreCycles> does not compile, because an
+// event occurs twice
+typedef EventSet<CoreCycles, Instructions, Uops> CheckedEventSet;
+static_assert(CheckedEventSet::size == 3, "Event set not planned");
+
+// Derived metrics to compute from the counts. Select id numbers from the table
+// MetricDefinitions[] in CounterDefinitions.h, or use the command line options
+// -metrics and -metric. The counters that the metrics need are added to the list above
+
+static const int metricTypesDesired[] = {
+    1, // instructions per clock cycle, or per time stamp counter clock without a core clock counter
+    2  // micro-operations per instruction
+};
+
+// Counters included in every pass. Passes that disagree on these are reported
+static const int anchorCounterTypes[] = {
+    1, // core clock cycles
+    9  // instructions
+};
+
+// Report anchor counts that differ more than this fraction between passes
+#define ANCHOR_TOLERANCE 0.05
+
+// Counters for -tma on processors without PERF_METRICS
+static const int topdownCounterTypes[] = {
+    1,   // core clock cycles
+    400, // issue slots where the front end delivered no uop
+    401, // uops issued
+    402, // retirement slots used
+    403  // cycles of recovery from mispredict or machine clear
+};
+
+// Issue slots per clock cycle in Haswell and Skylake, for the -tma fallback
+#define TOPDOWN_SLOTS_PER_CYCLE 4
+
+// Counters for -noise. They are counted in every pass, as anchors
+static const int noiseCounterTypes[] = {
+    430, // hardware interrupts
+    431  // system management interrupts
+};
+
+CResults CounterData; // Results
+
+CCacheControl CacheControl; // cache state before each repetition with -cache
+
+// Cost of setting up the cache state before each repetition of the test loop
+struct SCacheData
+{
+    std::vector<uint64_t> cost; // clock count of each repetition
+    bool wbinvd = false;        // WBINVD was done
+};
+
+SCacheData CacheData;
+
+// Result of warm-up phase
+struct SWarmup
+{
+    int runs = 0;          // number of runs of the test region
+    double seconds = 0;    // duration
+    double clockRatio = 0; // core clock / reference clock in last window, 0 if not available
+    bool settled = false;  // false if stopped by time limit
+};
+
+SWarmup Warmup;
+
+// Topdown slots of each category of ETopdownMetric in the overhead loop and the test loop
+// with -tma. Only the measured regions are counted, not the code between them
+struct STopdownData
+{
+    bool valid = false;               // counted in this pass
+    bool level2 = false;              // PERF_METRICS has level 2 fields
+    double overhead[TD_METRICS] = {}; // overhead loop
+    double test[TD_METRICS] = {};     // test loop
+    int overheadRuns = 0;             // repetitions of overhead loop
+    int testRuns = 0;                 // repetitions of test loop
+
+    // add the slots of each category counted between the reads before and after a region
+    static void add(double sum[], const STopdown& before, const STopdown& after)
+    {
+        for (int k = 0; k < TD_METRICS; k++)
+            sum[k] += after.metric(k) - before.metric(k);
+    }
+};
+
+STopdownData TopdownData;
+
+// Derived metric and where its counts are in this pass
+struct SMetricColumn
 {
-    int CountTemp[MAXCOUNTERS + 1];            // temporary storage of clock counts and PMC counts
-    int CountOverhead[MAXCOUNTERS + 1];        // temporary storage of count overhead
-    int ClockResults[REPETITIONS];             // clock count results
-    int PMCResults[REPETITIONS * MAXCOUNTERS]; // PMC count results
+    std::string name;         // column heading
+    CMetric metric;           // compiled formula
+    std::vector<int> columns; // counter number in CounterData of each counter type of the metric
+    bool available = false;   // all counter types are counted in this pass
 };
 
-SCounterData CounterData;                 // Results
-int* PCounterData = (int*)&CounterData;   // Pointer to measured data
-// offset of clock results into CounterData (bytes)
-int ClockResultsOS = int(CounterData.ClockResults - CounterData.CountTemp) * sizeof(int);
-// offset of PMC results into CounterData (bytes)
-int PMCResultsOS = int(CounterData.PMCResults - CounterData.CountTemp) * sizeof(int);
+std::vector<SMetricColumn> Metrics;
+
+// Subtract overhead from a count. Noise can make a count smaller than the overhead
+static inline uint64_t SubtractOverhead(uint64_t count, uint64_t overhead)
+{
+    return count > overhead ? count - overhead : 0;
+}
 
 /*############################################################################
 #
@@ -87,15 +322,297 @@ int PMCResultsOS = int(CounterData.PMCResults - CounterData.CountTemp) * sizeof(
 
 int UserData[USER_DATA_SIZE];
 
-int TestLoop(const CCounters& MSRCounters)
+// Data buffers that -cache cold-data flushes from the caches before each repetition.
+// Add the buffers that your test code uses
+static void RegisterUserBuffers(CCacheControl& cache)
+{
+    cache.addBuffer(UserData, sizeof(UserData));
+}
+
+// Counter reads for the measurement kernel with BACKEND_DRIVER.
+// The register numbers and masks are local copies so the compiler can keep them in registers
+struct SReadPmc
+{
+    int reg[MAXCOUNTERS];
+    uint64_t masks[MAXCOUNTERS];
+    CCounters* counters;
+    bool migration;
+
+    explicit SReadPmc(CCounters& MSRCounters)
+        : counters(&MSRCounters)
+        , migration(MSRCounters.noiseTagging())
+    {
+        for (int i = 0; i < MSRCounters.countersCount(); i++)
+        {
+            reg[i] = MSRCounters.counterRegister(i);
+            masks[i] = MSRCounters.counterMask(i);
+        }
+    }
+    uint64_t read(int i) const
+    {
+        return Readpmc(reg[i]);
+    }
+    uint64_t mask(int i) const
+    {
+        return masks[i];
+    }
+    bool readClocks(uint64_t& core, uint64_t& ref) const
+    {
+        return counters->readClocks(core, ref);
+    }
+    bool tagMigration() const
+    {
+        return migration;
+    }
+};
+
+// Counter reads for the measurement kernel through CCounters, used with BACKEND_PERF
+struct SReadCounters
+{
+    CCounters& MSRCounters;
+
+    uint64_t read(int i) const
+    {
+        return MSRCounters.counterRead(i);
+    }
+    uint64_t mask(int i) const
+    {
+        return MSRCounters.counterMask(i);
+    }
+    bool readClocks(uint64_t& core, uint64_t& ref) const
+    {
+        return MSRCounters.readClocks(core, ref);
+    }
+    bool tagMigration() const
+    {
+        return MSRCounters.noiseTagging();
+    }
+};
+
+// Read counters 0, 1, .. N-1
+template <class R, int... I>
+static inline void ReadForward(const R& r, uint64_t* v, std::integer_sequence<int, I...>)
+{
+    ((v[I] = r.read(I)), ...);
+}
+
+// Read counters N-1, .. 1, 0
+template <class R, int... I>
+static inline void ReadReverse(const R& r, uint64_t* v, std::integer_sequence<int, I...>)
+{
+    const int N = sizeof...(I);
+    ((v[N - 1 - I] = r.read(N - 1 - I)), ...);
+}
+
+// Measurement kernel. Runs Code between two reads of the time stamp counter and N counters.
+// The reads are unrolled and the start values are kept in local variables. The end values are
+// read in reverse order, so each counter sees the same instructions around the test code.
+// The core and reference clocks are read before the first counter read and after the last one,
+// so the counters don't count the clock reads, which can be system calls. Their ratio is the
+// clock frequency of this run relative to the time stamp counter frequency.
+// With noise tagging, the processor number is read from TSC_AUX before the first read and
+// after the last read, to detect a migration to another processor.
+// Nothing is stored in Count until after the last read.
+// Count[0] = clock count, Count[1..N] = counter counts, Count[N+1] = core clock cycles,
+// Count[N+2] = reference cycles, both 0 if not available, Count[N+3] = 1 if migrated
+template <ESerialize S, int N, class R, class F>
+static inline void Measure(const R& r, uint64_t* Count, F&& Code)
+{
+    uint64_t start[N + 1], end[N + 1];
+    uint64_t tscStart, tscEnd;
+    uint64_t coreStart = 0, refStart = 0, coreEnd = 0, refEnd = 0;
+    unsigned int cpuStart = 0, cpuEnd = 0;
+    const bool migration = r.tagMigration();
+
+    if (migration)
+        cpuStart = ReadTscAux();
+    SerializeWith<S>();
+    bool clocks = r.readClocks(coreStart, refStart);
+    ReadForward(r, start, std::make_integer_sequence<int, N>());
+    SerializeWith<S>();
+    tscStart = Readtsc();
+    SerializeWith<S>();
+
+    Code();
+
+    if (S == SERIALIZE_RDTSCP)
+    {
+        tscEnd = Readtscp(); // RDTSCP waits for the test code to execute
+    }
+    else
+    {
+        SerializeWith<S>();
+        tscEnd = Readtsc();
+    }
+    SerializeWith<S>();
+    ReadReverse(r, end, std::make_integer_sequence<int, N>());
+    if (clocks)
+        r.readClocks(coreEnd, refEnd);
+    SerializeWith<S>();
+    if (migration)
+        cpuEnd = ReadTscAux();
+
+    Count[0] = tscEnd - tscStart;
+    for (int i = 0; i < N; i++)
+        Count[i + 1] = (end[i] - start[i]) & r.mask(i);
+    Count[N + 1] = coreEnd - coreStart;
+    Count[N + 2] = refEnd - refStart;
+    Count[N + 3] = cpuStart != cpuEnd;
+}
+
+// Call f.template operator()<S, N>(reader) with the serialization method S and
+// number of counters N of this run, and the counter reader of the backend
+template <ESerialize S, int N, class F>
+static int DispatchCounters(CCounters& MSRCounters, int n, F& f)
+{
+    if constexpr (N < MAXCOUNTERS)
+    {
+        if (n > N)
+            return DispatchCounters<S, N + 1>(MSRCounters, n, f);
+    }
+    if (MSRCounters.getBackend() == BACKEND_DRIVER)
+        return f.template operator()<S, N>(SReadPmc(MSRCounters));
+    return f.template operator()<S, N>(SReadCounters{MSRCounters});
+}
+
+template <class F>
+static int Dispatch(CCounters& MSRCounters, ESerialize serialize, F&& f)
+{
+    int n = MSRCounters.usePMC() ? MSRCounters.countersCount() : 0;
+    switch (serialize)
+    {
+    case SERIALIZE_LFENCE:
+        return DispatchCounters<SERIALIZE_LFENCE, 0>(MSRCounters, n, f);
+    case SERIALIZE_RDTSCP:
+        return DispatchCounters<SERIALIZE_RDTSCP, 0>(MSRCounters, n, f);
+    case SERIALIZE_MFENCE:
+        return DispatchCounters<SERIALIZE_MFENCE, 0>(MSRCounters, n, f);
+    case SERIALIZE_NONE:
+        return DispatchCounters<SERIALIZE_NONE, 0>(MSRCounters, n, f);
+    default:
+        return DispatchCounters<SERIALIZE_CPUID, 0>(MSRCounters, n, f);
+    }
+}
+
+// Settings for TestLoop
+struct SRunOptions
+{
+    int overheadRepetitions = OVERHEAD_REPETITIONS; // repetitions of loop to find overhead
+    double targetWidth = 0;         // adaptive mode: target width of confidence interval relative to statistic. 0 = off
+    double timeBudget = 0;          // adaptive mode: maximum time in seconds. 0 = no limit
+    SStatisticsOptions statistics;  // statistic, confidence level and outlier rejection
+    int innerRepeat = 1;            // number of times to run the test code in each repetition
+    int minCycles = 0;              // find innerRepeat so that a repetition takes at least this many clock counts. 0 = off
+    double warmupTolerance = WARMUP_TOLERANCE; // warm-up ends when changes are smaller than this fraction. 0 = no warm-up
+    double warmupMaxTime = WARMUP_MAXTIME;     // maximum warm-up time in seconds
+    double elements = 0;            // number of elements processed by one run of the test code, for metrics
+    double bytes = 0;               // number of bytes processed by one run of the test code
+    bool noiseTag = false;          // tag disturbed repetitions in CounterData.noise()
+    bool noiseExclude = false;      // leave tagged repetitions out of the statistics
+    ECacheMode cacheMode = CACHE_ASIS; // cache state before each repetition
+    bool wbinvd = false;            // CACHE_COLD_ALL: also WBINVD through the driver
+};
+
+// Noise tags of the repetitions to leave out of the statistics. NULL if all are used
+static const uint64_t* ExcludedRepetitions(const SRunOptions& run)
+{
+    return run.noiseTag && run.noiseExclude ? CounterData.noise() : NULL;
+}
+
+// Width of the confidence interval of the clock counts of the first repetitions runs,
+// relative to the statistic
+static double ConfidenceWidth(int repetitions, const SRunOptions& run)
+{
+    const SStatisticsOptions& options = run.statistics;
+    SStatistics st;
+    if (ComputeStatistics(CounterData.clock(), repetitions, options, st, ExcludedRepetitions(run)))
+        return HUGE_VAL;
+    double value = options.ciStatistic == STAT_MIN ? (double)st.min : st.median;
+    double width = st.ciHigh - st.ciLow;
+    if (width <= 0)
+        return 0;
+    return value > 0 ? width / value : HUGE_VAL;
+}
+
+// Find the smallest power of 2 inner repeat count that makes the test code take
+// at least minCycles clock counts
+template <ESerialize S, int N, class R, class F>
+static int CalibrateInnerRepeat(const R& r, int minCycles, const F& TestCode)
+{
+    int inner = 1;
+    for (; inner < MAXINNERREPEAT; inner *= 2)
+    {
+        uint64_t clock = UINT64_MAX;
+        for (int k = 0; k < CALIBRATE_REPETITIONS; k++)
+        {
+            Measure<S, N>(r, CounterData.CountTemp, [&TestCode, inner] {
+                for (int j = 0; j < inner; j++)
+                    TestCode();
+            });
+            if (CounterData.CountTemp[0] < clock)
+                clock = CounterData.CountTemp[0];
+        }
+        if (clock >= (uint64_t)minCycles)
+            break;
+    }
+    return inner;
+}
+
+// Run the test region until the caches, branch predictors and clock frequency have settled:
+// the minimum clock count and the ratio of core clock to reference clock of a window of
+// WARMUP_WINDOW runs both differ less than run.warmupTolerance from the previous window
+template <ESerialize S, int N, class R, class F>
+static void WarmUp(CCounters& MSRCounters, const R& r, const SRunOptions& run, const F& Region)
+{
+    auto startTime = std::chrono::steady_clock::now();
+    double prevClock = 0, prevRatio = 0;
+    Warmup = SWarmup();
+
+    for (int window = 0;; window++)
+    {
+        uint64_t core0 = 0, ref0 = 0, core1 = 0, ref1 = 0;
+        bool clocks = MSRCounters.readClocks(core0, ref0);
+        uint64_t clock = UINT64_MAX;
+        for (int k = 0; k < WARMUP_WINDOW; k++)
+        {
+            Measure<S, N>(r, CounterData.CountTemp, Region);
+            if (CounterData.CountTemp[0] < clock)
+                clock = CounterData.CountTemp[0];
+        }
+        Warmup.runs += WARMUP_WINDOW;
+        clocks = clocks && MSRCounters.readClocks(core1, ref1);
+        double ratio = clocks && ref1 > ref0 ? double(core1 - core0) / double(ref1 - ref0) : 0;
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+        Warmup.seconds = elapsed.count();
+        Warmup.clockRatio = ratio;
+
+        if (window > 0 && fabs(clock - prevClock) <= run.warmupTolerance * prevClock &&
+            fabs(ratio - prevRatio) <= run.warmupTolerance * prevRatio)
+        {
+            Warmup.settled = true;
+            return;
+        }
+        if (Warmup.seconds >= run.warmupMaxTime)
+            return;
+        prevClock = double(clock);
+        prevRatio = ratio;
+    }
+}
+
+template <ESerialize S, int N, class R>
+int TestLoop(CCounters& MSRCounters, const R& r, const SRunOptions& run)
 {
-    // this function runs the code to test REPETITIONS times
-    // and reads the counters before and after each run:
+    // this function runs the code to test CounterData.capacity() times, or until the
+    // adaptive mode stops it, and reads the counters before and after each run:
     int repi; // repetition index
+    const int repetitions = CounterData.capacity();
+    const bool adaptive = run.targetWidth > 0;
+    int nextCheck = ADAPTIVE_FIRST_CHECK; // adaptive mode: repetitions before next check
+    auto startTime = std::chrono::steady_clock::now();
 
-    for (int i = 0; i < MSRCounters.countersCount() + 1; i++)
+    for (int i = 0; i < N + 1; i++)
     {
-        CounterData.CountOverhead[i] = 0x7FFFFFFF;
+        CounterData.CountOverhead[i] = UINT64_MAX;
     }
 
     /*############################################################################
@@ -112,158 +629,1235 @@ int TestLoop(const CCounters& MSRCounters)
     #
     ############################################################################*/
 
+    // The code to test
+    auto TestCode = [] {
+        /*############################################################################
+        #
+        #        Test code start
+        #
+        ############################################################################*/
+
+        // Put the code to test here,
+        // or a call to a function defined in a separate module
+
+        for (int i = 0; i < 1000; i++)
+            UserData[i] *= 99;
+
+        /*############################################################################
+        #
+        #        Test code end
+        #
+        ############################################################################*/
+    };
+
+    // warm up with the inner repeat count of the test, or 1 if not known yet
+    if (run.warmupTolerance > 0)
+    {
+        int warmupInner = run.minCycles > 0 ? 1 : run.innerRepeat;
+        WarmUp<S, N>(MSRCounters, r, run, [&TestCode, warmupInner] {
+            for (int j = 0; j < warmupInner; j++)
+                TestCode();
+        });
+    }
+
+    // number of times to run the test code in each repetition
+    const int inner = run.minCycles > 0 ? CalibrateInnerRepeat<S, N>(r, run.minCycles, TestCode) : run.innerRepeat;
+    CounterData.setInnerRepeat(inner);
+
+    // Cache state before each repetition, outside the timed region. Done in both loops, so the
+    // overhead is measured in the same state. Returns the clock count that it took
+    CacheData.wbinvd = run.cacheMode == CACHE_COLD_ALL && run.wbinvd && MSRCounters.writeBackInvalidate();
+    auto PrepareCache = [&MSRCounters, &TestCode, &run]() -> uint64_t {
+        if (run.cacheMode == CACHE_ASIS)
+            return 0;
+        uint64_t start = Readtsc();
+        if (run.cacheMode == CACHE_WARM)
+            TestCode();
+        else
+            CacheControl.evict();
+        if (CacheData.wbinvd)
+            MSRCounters.writeBackInvalidate();
+        Lfence();
+        return Readtsc() - start;
+    };
+
+    // topdown slots and PERF_METRICS are reset before each loop and read with RDPMC before
+    // and after each repetition, so the cache preparation and the bookkeeping between the
+    // repetitions are not counted
+    const bool topdown = MSRCounters.topdownAvailable();
+    STopdown topdownBefore, topdownAfter;
+    TopdownData = STopdownData();
+    if (topdown)
+        MSRCounters.topdownReset();
+
     // first test loop.
     // Measure overhead = the test count produced by the test program itself
-    for (repi = 0; repi < OVERHEAD_REPETITIONS; repi++)
+    for (repi = 0; repi < run.overheadRepetitions; repi++)
     {
+        PrepareCache();
+        if (topdown)
+            MSRCounters.topdownRead(topdownBefore);
+        Measure<S, N>(r, CounterData.CountTemp, [inner] {
+            // no test code here. The barrier keeps the compiler from removing the loop,
+            // so the overhead includes the loop of the test
+            for (int j = 0; j < inner; j++)
+                CompilerBarrier();
+        });
+        if (topdown)
+        {
+            MSRCounters.topdownRead(topdownAfter);
+            STopdownData::add(TopdownData.overhead, topdownBefore, topdownAfter);
+        }
+
+        // find minimum counts
+        for (int i = 0; i < N + 1; i++)
+        {
+            if (CounterData.CountTemp[i] < CounterData.CountOverhead[i])
+            {
+                CounterData.CountOverhead[i] = CounterData.CountTemp[i];
+            }
+        }
+    }
 
-        Serialize();
+    if (topdown)
+        MSRCounters.topdownReset();
 
-        if (MSRCounters.usePMC()) // Read counters
+    // noise tagging: counters of interrupts and SMIs in this pass, and the SMI count and
+    // throttle logs from the driver, read after each repetition
+    int interruptColumn = -1, smiColumn = -1;
+    uint64_t smiCount = 0;
+    bool throttled = false;
+    bool noiseMSRs = false;
+    if (run.noiseTag)
+    {
+        for (int i = 0; i < N; i++)
         {
-            for (int i = 0; i < MSRCounters.countersCount(); i++)
-                CounterData.CountTemp[i + 1] = (int)MSRCounters.counterRead(i);
+            if (MSRCounters.counterType(i) == noiseCounterTypes[0])
+                interruptColumn = i;
+            if (MSRCounters.counterType(i) == noiseCounterTypes[1])
+                smiColumn = i;
         }
+        noiseMSRs = MSRCounters.readNoise(smiCount, throttled);
+    }
 
-        Serialize();
-        CounterData.CountTemp[0] = (int)Readtsc();
-        Serialize();
+    // Second test loop. Includes code to test.
+    // This must be identical to first test loop, except for the test code
+    for (repi = 0; repi < repetitions; repi++)
+    {
+        uint64_t cacheCost = PrepareCache();
+        if (topdown)
+            MSRCounters.topdownRead(topdownBefore);
+        Measure<S, N>(r, CounterData.CountTemp, [&TestCode, inner] {
+            for (int j = 0; j < inner; j++)
+                TestCode();
+        });
+        if (topdown)
+        {
+            MSRCounters.topdownRead(topdownAfter);
+            STopdownData::add(TopdownData.test, topdownBefore, topdownAfter);
+        }
 
-        // no test code here
+        // subtract overhead
+        CounterData.clock()[repi] = SubtractOverhead(CounterData.CountTemp[0], CounterData.CountOverhead[0]);
+        if (repi < (int)CacheData.cost.size())
+            CacheData.cost[repi] = cacheCost;
+        for (int i = 0; i < N; i++)
+        {
+            CounterData.pmc(i)[repi] = SubtractOverhead(CounterData.CountTemp[i + 1], CounterData.CountOverhead[i + 1]);
+        }
+        if (CounterData.hasClocks())
+        {
+            // clock frequency of this repetition
+            CounterData.coreClock()[repi] = CounterData.CountTemp[N + 1];
+            CounterData.refClock()[repi] = CounterData.CountTemp[N + 2];
+        }
 
-        Serialize();
-        CounterData.CountTemp[0] -= (int)Readtsc();
-        Serialize();
+        if (run.noiseTag)
+        {
+            uint64_t tags = CounterData.CountTemp[N + 3] ? NOISE_MIGRATION : 0;
+            if (interruptColumn >= 0 && CounterData.pmc(interruptColumn)[repi])
+                tags |= NOISE_INTERRUPT;
+            if (smiColumn >= 0 && CounterData.pmc(smiColumn)[repi])
+                tags |= NOISE_SMI;
+            if (noiseMSRs)
+            {
+                // SMIs and throttling since the previous repetition
+                uint64_t smi;
+                MSRCounters.readNoise(smi, throttled);
+                if (smi != smiCount)
+                    tags |= NOISE_SMI;
+                if (throttled)
+                    tags |= NOISE_THERMAL;
+                smiCount = smi;
+            }
+            CounterData.noise()[repi] = tags;
+        }
 
-        if (MSRCounters.usePMC()) // Read counters
+        // adaptive mode: stop when the time is up, checked after each repetition, or when the
+        // confidence interval is narrow enough, checked at growing intervals
+        if (adaptive && run.timeBudget > 0)
         {
-            for (int i = 0; i < MSRCounters.countersCount(); i++)
-                CounterData.CountTemp[i + 1] -= (int)MSRCounters.counterRead(i);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+            if (elapsed.count() >= run.timeBudget)
+            {
+                repi++;
+                break;
+            }
+        }
+        if (adaptive && repi + 1 == nextCheck)
+        {
+            if (ConfidenceWidth(repi + 1, run) < run.targetWidth)
+            {
+                repi++;
+                break;
+            }
+            nextCheck = repi + 1 + (repi + 1) / 4;
         }
+    }
 
-        Serialize();
+    if (topdown)
+    {
+        TopdownData.valid = true;
+        TopdownData.level2 = MSRCounters.topdownLevel2();
+        TopdownData.overheadRuns = run.overheadRepetitions;
+        TopdownData.testRuns = repi;
+    }
 
-        // find minimum counts
-        for (int i = 0; i < MSRCounters.countersCount() + 1; i++)
+    CounterData.setRepetitions(repi);
+    return repi;
+}
+
+// Run TestLoop with the specified serialization method
+static int RunTestLoop(CCounters& MSRCounters, ESerialize serialize, const SRunOptions& run)
+{
+    return Dispatch(MSRCounters, serialize, [&MSRCounters, &run]<ESerialize S, int N>(const auto& r) {
+        return TestLoop<S, N>(MSRCounters, r, run);
+    });
+}
+
+// Measure overhead of an empty test region with serialization method S.
+// Print minimum, mean and standard deviation of the clock count and the minimum of each counter
+template <ESerialize S, int N, class R>
+static int SerializeReport(const R& r)
+{
+    uint64_t Count[N + 4];
+    uint64_t CountMin[N + 1];
+    double sum = 0, sum2 = 0;
+
+    for (int i = 0; i < N + 1; i++)
+        CountMin[i] = UINT64_MAX;
+
+    for (int repi = 0; repi < SERIALIZE_REPORT_REPETITIONS; repi++)
+    {
+        Measure<S, N>(r, Count, [] {});
+
+        for (int i = 0; i < N + 1; i++)
         {
-            if (-CounterData.CountTemp[i] < CounterData.CountOverhead[i])
+            if (Count[i] < CountMin[i])
+                CountMin[i] = Count[i];
+        }
+        sum += double(Count[0]);
+        sum2 += double(Count[0]) * double(Count[0]);
+    }
+
+    double mean = sum / SERIALIZE_REPORT_REPETITIONS;
+    double var = sum2 / SERIALIZE_REPORT_REPETITIONS - mean * mean;
+    printf("\n%10s %10llu %10.1f %10.1f ", SerializeNames[S], (unsigned long long)CountMin[0], mean,
+        var > 0 ? sqrt(var) : 0.);
+    for (int i = 1; i < N + 1; i++)
+        printf("%10llu ", (unsigned long long)CountMin[i]);
+    return 0;
+}
+
+// Print the overhead and jitter of all serialization methods on this CPU
+static void SerializeReportAll(CCounters& MSRCounters)
+{
+    printf("\nOverhead of serialization methods, %i repetitions", SERIALIZE_REPORT_REPETITIONS);
+    printf("\n    Method  Clock min Clock mean  Clock std ");
+    if (MSRCounters.usePMC())
+    {
+        for (int i = 0; i < MSRCounters.countersCount(); i++)
+            printf("%10s ", MSRCounters.counterName(i));
+    }
+    for (int m = 0; m < SERIALIZE_METHODS; m++)
+    {
+        Dispatch(MSRCounters, ESerialize(m),
+            []<ESerialize S, int N>(const auto& r) { return SerializeReport<S, N>(r); });
+    }
+    printf("\n");
+}
+
+// Print statistics of the counts of all repetitions, one column for each counter
+// Statistics of clock (column 0) and each counter in CounterData. Returns number of columns
+static int ComputeAllStatistics(const SRunOptions& run, SStatistics stat[MAXCOUNTERS + 1])
+{
+    int columns = CounterData.countersCount() + 1;
+    for (int i = 0; i < columns; i++)
+    {
+        const uint64_t* values = i ? CounterData.pmc(i - 1) : CounterData.clock();
+        ComputeStatistics(values, CounterData.repetitions(), run.statistics, stat[i], ExcludedRepetitions(run));
+    }
+    return columns;
+}
+
+static void PrintStatistics(const CCounters& MSRCounters, const SRunOptions& run)
+{
+    const SStatisticsOptions& options = run.statistics;
+    int inner = CounterData.innerRepeat();
+    double scale = 1. / inner; // counts are reported per run of the test code
+    SStatistics stat[MAXCOUNTERS + 1];
+    int columns = ComputeAllStatistics(run, stat);
+
+    const char* ciName = options.ciStatistic == STAT_MIN ? "min" : "median";
+    printf("\n\nStatistics of %i repetitions. %.0f%% confidence interval of %s", CounterData.repetitions(),
+        options.confidence * 100., ciName);
+    if (options.outlierMads > 0)
+        printf(". Outliers beyond %g MAD rejected", options.outlierMads);
+    if (ExcludedRepetitions(run))
+        printf(". Disturbed repetitions excluded");
+    if (inner > 1)
+        printf(". Counts per run of test code, %i runs per repetition", inner);
+    printf("\n%10s      Clock ", "");
+    for (int i = 1; i < columns; i++)
+        printf("%10s ", MSRCounters.counterName(i - 1));
+
+    // print one row of the table
+    auto Row = [&](const char* name, auto value) {
+        printf("\n%10s ", name);
+        for (int i = 0; i < columns; i++)
+            printf(inner > 1 ? "%10.2f " : "%10.1f ", value(stat[i]) * scale);
+    };
+    auto IntegerRow = [&](const char* name, auto value) {
+        if (inner > 1)
+            return Row(name, value);
+        printf("\n%10s ", name);
+        for (int i = 0; i < columns; i++)
+            printf("%10llu ", (unsigned long long)value(stat[i]));
+    };
+
+    IntegerRow("min", [](const SStatistics& st) { return (double)st.min; });
+    Row("median", [](const SStatistics& st) { return st.median; });
+    Row("p90", [](const SStatistics& st) { return st.p90; });
+    Row("p99", [](const SStatistics& st) { return st.p99; });
+    IntegerRow("max", [](const SStatistics& st) { return (double)st.max; });
+    Row("mean", [](const SStatistics& st) { return st.mean; });
+    Row("stddev", [](const SStatistics& st) { return st.stddev; });
+    Row("MAD", [](const SStatistics& st) { return st.mad; });
+    Row("CI low", [](const SStatistics& st) { return st.ciLow; });
+    Row("CI high", [](const SStatistics& st) { return st.ciHigh; });
+    if (options.outlierMads > 0)
+    {
+        printf("\n%10s ", "rejected");
+        for (int i = 0; i < columns; i++)
+            printf("%10i ", stat[i].rejected);
+    }
+    if (ExcludedRepetitions(run))
+    {
+        printf("\n%10s ", "excluded");
+        for (int i = 0; i < columns; i++)
+            printf("%10i ", stat[i].excluded);
+    }
+}
+
+// Find the counters of each metric among the counters of this pass
+static void FindMetricColumns(const CCounters& MSRCounters)
+{
+    for (SMetricColumn& m : Metrics)
+    {
+        const std::vector<int>& types = m.metric.counterTypes();
+        m.columns.assign(types.size(), -1);
+        m.available = MSRCounters.usePMC();
+        for (size_t k = 0; k < types.size(); k++)
+        {
+            for (int i = 0; i < CounterData.countersCount(); i++)
             {
-                CounterData.CountOverhead[i] = -CounterData.CountTemp[i];
+                if (MSRCounters.counterType(i) == types[k])
+                    m.columns[k] = i;
             }
+            if (m.columns[k] < 0)
+                m.available = false;
         }
     }
+}
 
-    // Second test loop. Includes code to test.
-    // This must be identical to first test loop, except for the test code
-    for (repi = 0; repi < REPETITIONS; repi++)
+// Value of metric for repetition repi, from the counts per run of the test code
+static double MetricValue(const SMetricColumn& m, int repi, double elements)
+{
+    double counts[MAXCOUNTERS];
+    double inner = CounterData.innerRepeat();
+    for (size_t k = 0; k < m.columns.size(); k++)
+        counts[k] = double(CounterData.pmc(m.columns[k])[repi]) / inner;
+    return m.metric.evaluate(counts, double(CounterData.clock()[repi]) / inner, elements);
+}
+
+// Print a metric value, n/a if it is not a number
+static void PrintMetricValue(double value)
+{
+    if (isnan(value))
+        printf("%10s ", "n/a");
+    else
+        printf("%10.3f ", value);
+}
+
+// Print the metrics of the statistics of the counts, and the statistics of the metric
+// of each repetition
+static void PrintMetrics(const SRunOptions& run)
+{
+    if (Metrics.empty())
+        return;
+    SStatistics stat[MAXCOUNTERS + 1];
+    ComputeAllStatistics(run, stat);
+    double inner = CounterData.innerRepeat();
+    const uint64_t* exclude = ExcludedRepetitions(run);
+
+    printf("\n\nMetrics per run of test code. Metric of median counts, and statistics of the metric of each repetition");
+    printf("\n%10s %10s %10s %10s %10s", "Metric", "of median", "min", "median", "max");
+    for (const SMetricColumn& m : Metrics)
     {
-        Serialize();
+        printf("\n%10s ", m.name.c_str());
+        if (!m.available)
+        {
+            printf("%10s  counters not counted in this pass", "n/a");
+            continue;
+        }
+        double counts[MAXCOUNTERS];
+        for (size_t k = 0; k < m.columns.size(); k++)
+            counts[k] = stat[m.columns[k] + 1].median / inner;
+        PrintMetricValue(m.metric.evaluate(counts, stat[0].median / inner, run.elements));
 
-        if (MSRCounters.usePMC()) // Read counters
+        std::vector<double> values;
+        for (int repi = 0; repi < CounterData.repetitions(); repi++)
         {
-            for (int i = 0; i < MSRCounters.countersCount(); i++)
-                CounterData.CountTemp[i + 1] = (int)MSRCounters.counterRead(i);
+            if (exclude && exclude[repi])
+                continue;
+            double v = MetricValue(m, repi, run.elements);
+            if (!isnan(v))
+                values.push_back(v);
         }
+        if (values.empty())
+            continue;
+        std::sort(values.begin(), values.end());
+        size_t n = values.size();
+        double median = n & 1 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) * 0.5;
+        PrintMetricValue(values[0]);
+        PrintMetricValue(median);
+        PrintMetricValue(values[n - 1]);
+    }
+}
 
-        Serialize();
-        CounterData.CountTemp[0] = (int)Readtsc();
-        Serialize();
+// Print the statistics of the clock count as time and throughput per run of the test code
+static void PrintTime(const SRunOptions& run)
+{
+    const char* source;
+    double frequency = CCounters::tscFrequency(&source);
+    SStatistics stat[MAXCOUNTERS + 1];
+    ComputeAllStatistics(run, stat);
+    double inner = CounterData.innerRepeat();
 
-        /*############################################################################
-        #
-        #        Test code start
-        #
-        ############################################################################*/
+    printf("\n\nTime per run of test code. Time stamp counter %.4f GHz (%s). clk = clock count",
+        frequency * 1E-9, source);
+    printf("\n%10s %10s ", "", "ns");
+    if (run.elements > 0)
+        printf("%10s %10s ", "ns/elem", "elem/clk");
+    if (run.bytes > 0)
+        printf("%10s %10s ", "bytes/clk", "GB/s");
 
-        // Put the code to test here,
-        // or a call to a function defined in a separate module
+    // print one row for a statistic of the clock count
+    auto Row = [&](const char* name, double clock) {
+        clock /= inner;
+        double ns = clock / frequency * 1E9;
+        printf("\n%10s %10.2f ", name, ns);
+        if (run.elements > 0)
+            printf("%10.3f %10.3f ", ns / run.elements, clock > 0 ? run.elements / clock : 0.);
+        if (run.bytes > 0)
+            printf("%10.3f %10.3f ", clock > 0 ? run.bytes / clock : 0., ns > 0 ? run.bytes / ns : 0.);
+    };
+    const SStatistics& st = stat[0];
+    Row("min", (double)st.min);
+    Row("median", st.median);
+    Row("p90", st.p90);
+    Row("p99", st.p99);
+    Row("max", (double)st.max);
+    Row("mean", st.mean);
+    Row("CI low", st.ciLow);
+    Row("CI high", st.ciHigh);
+}
 
-        for (int i = 0; i < 1000; i++)
-            UserData[i] *= 99;
+// true if the average clock factor of the run from the driver is used for the corrected clock
+static bool AverageClockFactor(const CCounters& MSRCounters)
+{
+    return !CounterData.hasClocks() && MSRCounters.usePMC() && MSRCounters.MScheme == S_AMD2 &&
+           MSRCounters.getBackend() == BACKEND_DRIVER;
+}
 
-        /*############################################################################
-        #
-        #        Test code end
-        #
-        ############################################################################*/
+// Core clock frequency relative to the time stamp counter frequency in repetition repi.
+// 0 if not known
+static double ClockRatio(const CCounters& MSRCounters, int repi)
+{
+    if (CounterData.hasClocks())
+    {
+        uint64_t ref = CounterData.refClock()[repi];
+        return ref ? double(CounterData.coreClock()[repi]) / double(ref) : 0;
+    }
+    return AverageClockFactor(MSRCounters) ? MSRCounters.getClockFactor() : 0;
+}
+
+// Print the variation of the clock frequency between repetitions
+static void PrintClockVariation(const CCounters& MSRCounters)
+{
+    std::vector<double> ratios;
+    for (int repi = 0; repi < CounterData.repetitions(); repi++)
+    {
+        double ratio = ClockRatio(MSRCounters, repi);
+        if (ratio > 0)
+            ratios.push_back(ratio);
+    }
+    if (ratios.empty())
+        return;
+    std::sort(ratios.begin(), ratios.end());
+    size_t n = ratios.size();
+    double median = n & 1 ? ratios[n / 2] : (ratios[n / 2 - 1] + ratios[n / 2]) * 0.5;
+    printf("\n\nCore clock / time stamp counter in each repetition: min %.4f, median %.4f, max %.4f. "
+           "Range %.1f%% of median",
+        ratios[0], median, ratios[n - 1], (ratios[n - 1] - ratios[0]) / median * 100.);
+}
+
+// Letters of the noise tags: I = interrupt, S = SMI, M = migration, T = throttling
+static const char* NoiseLetters(uint64_t tags, char buf[5])
+{
+    static const char letters[] = "ISMT";
+    int n = 0;
+    for (int k = 0; k < 4; k++)
+    {
+        if (tags & (1u << k))
+            buf[n++] = letters[k];
+    }
+    if (n == 0)
+        buf[n++] = '-';
+    buf[n] = 0;
+    return buf;
+}
+
+// Print the number of repetitions with each noise tag
+static void PrintNoise(const CCounters& MSRCounters, const SRunOptions& run)
+{
+    static const char* const names[] = {"interrupts", "SMIs", "migrations", "throttling"};
+    int count[4] = {0};
+    int disturbed = 0;
+    const uint64_t* tags = CounterData.noise();
+    for (int repi = 0; repi < CounterData.repetitions(); repi++)
+    {
+        for (int k = 0; k < 4; k++)
+            count[k] += (tags[repi] >> k) & 1;
+        disturbed += tags[repi] != 0;
+    }
+    printf("\n\nNoise: %i of %i repetitions disturbed", disturbed, CounterData.repetitions());
+    for (int k = 0; k < 4; k++)
+        printf(", %s %i", names[k], count[k]);
+    if (disturbed && run.noiseExclude)
+        printf(disturbed < CounterData.repetitions() ? ". Excluded from statistics" : ". All disturbed, none excluded");
+    if (!MSRCounters.noiseAvailable())
+        printf("\nSMIs and throttling are only detected with -msr on Intel");
+}
+
+// Print the cache mode and the cost of setting up the cache state before each repetition
+static void PrintCache(const SRunOptions& run)
+{
+    if (run.cacheMode == CACHE_ASIS)
+        return;
+    printf("\n\nCache mode %s", CacheModeNames[run.cacheMode]);
+    if (run.cacheMode == CACHE_COLD_DATA)
+        printf(": user buffers flushed with %s", CacheControl.hasClflushopt() ? "CLFLUSHOPT" : "CLFLUSH");
+    if (run.cacheMode == CACHE_COLD_ALL)
+    {
+        printf(": %.1f MB eviction buffer", CacheControl.evictionSize() / 1048576.);
+        size_t llc = CCacheControl::lastLevelCacheSize();
+        if (llc)
+            printf(", last level cache %.1f MB", llc / 1048576.);
+        if (CacheData.wbinvd)
+            printf(", WBINVD");
+        else if (run.wbinvd)
+            printf(". WBINVD not available");
+    }
+    SStatistics st;
+    if (ComputeStatistics(CacheData.cost.data(), CounterData.repetitions(), run.statistics, st) == 0)
+    {
+        double ns = 1E9 / CCounters::tscFrequency();
+        printf("\nCost before each repetition, clock counts: min %llu, median %.0f, max %llu. Median %.2f us",
+            (unsigned long long)st.min, st.median, (unsigned long long)st.max, st.median * ns * 1E-3);
+    }
+}
+
+// Print counts of each repetition and statistics of CounterData
+static void PrintResults(const CCounters& MSRCounters, const SRunOptions& run, bool printRaw)
+{
+    // The corrected clock is the clock count at the actual clock frequency of each repetition
+    bool corrected = CounterData.hasClocks() || AverageClockFactor(MSRCounters);
 
-        Serialize();
-        CounterData.CountTemp[0] -= (int)Readtsc();
-        Serialize();
+    // print column headings
+    printf("\n     Clock ");
+    if (corrected)
+        printf("%10s ", "Corrected");
+    if (CounterData.hasClocks())
+        printf("%10s ", "Clk ratio");
+    if (MSRCounters.usePMC())
+    {
+        for (int i = 0; i < MSRCounters.countersCount(); i++)
+        {
+            printf("%10s ", MSRCounters.counterName(i));
+        }
+        for (const SMetricColumn& m : Metrics)
+        {
+            if (m.available)
+                printf("%10s ", m.name.c_str());
+        }
+    }
+    if (run.noiseTag)
+        printf("%6s ", "Noise");
 
-        if (MSRCounters.usePMC()) // Read counters
+    // print counter outputs. Counts per run of the test code if it runs more than once in each repetition
+    int repetitions = CounterData.repetitions();
+    int rows = printRaw || repetitions <= MAXPRINTROWS ? repetitions : 0;
+    int inner = CounterData.innerRepeat();
+    for (int repi = 0; repi < rows; repi++)
+    {
+        uint64_t tscClock = CounterData.clock()[repi];
+        if (inner > 1)
+            printf("\n%10.2f ", double(tscClock) / inner);
+        else
+            printf("\n%10llu ", (unsigned long long)tscClock);
+        if (corrected)
+        {
+            double ratio = ClockRatio(MSRCounters, repi);
+            if (inner > 1)
+                printf("%10.2f ", tscClock * ratio / inner);
+            else
+                printf("%10llu ", (unsigned long long)(tscClock * ratio + 0.5)); // Calculated core clock count
+            if (CounterData.hasClocks())
+                printf("%10.4f ", ratio);
+        }
+        if (MSRCounters.usePMC())
         {
             for (int i = 0; i < MSRCounters.countersCount(); i++)
-                CounterData.CountTemp[i + 1] -= (int)MSRCounters.counterRead(i);
+            {
+                if (inner > 1)
+                    printf("%10.2f ", double(CounterData.pmc(i)[repi]) / inner);
+                else
+                    printf("%10llu ", (unsigned long long)CounterData.pmc(i)[repi]);
+            }
+            for (const SMetricColumn& m : Metrics)
+            {
+                if (m.available)
+                    PrintMetricValue(MetricValue(m, repi, run.elements));
+            }
+        }
+        if (run.noiseTag)
+        {
+            char buf[5];
+            printf("%6s ", NoiseLetters(CounterData.noise()[repi], buf));
         }
+    }
+    if (AverageClockFactor(MSRCounters))
+    {
+        printf("\nClock factor %.4f", MSRCounters.getClockFactor());
+    }
+    PrintClockVariation(MSRCounters);
+    if (run.noiseTag)
+        PrintNoise(MSRCounters, run);
 
-        Serialize();
+    if (run.warmupTolerance > 0)
+    {
+        printf("\n\nWarm-up: %i runs, %.1f ms", Warmup.runs, Warmup.seconds * 1000.);
+        if (Warmup.clockRatio > 0)
+            printf(", core clock / reference clock %.3f", Warmup.clockRatio);
+        if (!Warmup.settled)
+            printf(". Not settled within %g s", run.warmupMaxTime);
+    }
 
-        // subtract overhead
-        CounterData.ClockResults[repi] = -CounterData.CountTemp[0] - CounterData.CountOverhead[0];
-        for (int i = 0; i < MSRCounters.countersCount(); i++)
+    PrintCache(run);
+    PrintStatistics(MSRCounters, run);
+    PrintTime(run);
+    PrintMetrics(run);
+
+    if (run.targetWidth > 0)
+    {
+        double width = ConfidenceWidth(repetitions, run);
+        printf("\n\nAdaptive mode: %i repetitions, confidence interval width %.3g%% of clock %s, target %.3g%%",
+            repetitions, width * 100., run.statistics.ciStatistic == STAT_MIN ? "min" : "median",
+            run.targetWidth * 100.);
+        if (width >= run.targetWidth)
+            printf(". Stopped by %s", repetitions < CounterData.capacity() ? "time budget" : "repetition limit");
+    }
+}
+
+// Statistics of one counter in one pass
+struct SPassCount
+{
+    const char* name; // counter name
+    int type;         // counter type, 0 for clock
+    int pass;         // pass number
+    int inner;        // number of runs of test code in each repetition
+    SStatistics stat;
+};
+
+// Print statistics of all counters from all passes. Counters that are counted in more than
+// one pass are compared to the first pass
+static void PrintCombined(const std::vector<SPassCount>& merged, int numPasses, const SStatisticsOptions& options)
+{
+    const char* ciName = options.ciStatistic == STAT_MIN ? "min" : "median";
+    printf("\n\nCombined results of %i passes. Counts per run of test code, %.0f%% confidence interval of %s",
+        numPasses, options.confidence * 100., ciName);
+    printf("\n%10s %5s %10s %10s %10s %10s %10s", "Counter", "Pass", "min", "median", "p90", "CI low", "CI high");
+    for (size_t i = 0; i < merged.size(); i++)
+    {
+        const SPassCount& c = merged[i];
+        bool first = true; // first pass with this counter
+        for (size_t j = 0; j < i; j++)
         {
-            CounterData.PMCResults[repi + i * REPETITIONS] =
-                -CounterData.CountTemp[i + 1] - CounterData.CountOverhead[i + 1];
+            if (strcmp(merged[j].name, c.name) == 0)
+                first = false;
         }
+        if (!first)
+            continue;
+        double scale = 1. / c.inner;
+        printf("\n%10s %5i %10.2f %10.2f %10.2f %10.2f %10.2f", c.name, c.pass + 1, c.stat.min * scale,
+            c.stat.median * scale, c.stat.p90 * scale, c.stat.ciLow * scale, c.stat.ciHigh * scale);
     }
 
-    return REPETITIONS;
+    // Anchor consistency: median of each pass relative to the first pass
+    printf("\n\nAnchor consistency, median of each pass:");
+    for (size_t i = 0; i < merged.size(); i++)
+    {
+        const SPassCount& a = merged[i];
+        if (a.pass != 0)
+            continue;
+        double ref = a.stat.median / a.inner;
+        double maxDeviation = 0;
+        printf("\n%10s ", a.name);
+        for (size_t j = 0; j < merged.size(); j++)
+        {
+            const SPassCount& b = merged[j];
+            if (strcmp(b.name, a.name) != 0)
+                continue;
+            double m = b.stat.median / b.inner;
+            printf("%10.2f ", m);
+            if (ref > 0 && fabs(m - ref) / ref > maxDeviation)
+                maxDeviation = fabs(m - ref) / ref;
+        }
+        printf(" max deviation %.1f%%", maxDeviation * 100.);
+        if (maxDeviation > ANCHOR_TOLERANCE)
+            printf(". Passes are not consistent");
+    }
 }
 
-int main(int argc, char* argv[])
+// Print one row of the top-down analysis
+static void PrintTopdownRow(const char* name, double slots, double total, int indent)
 {
-    CCounters MSRCounters;
+    printf("\n%*s%-*s %6.1f%%", indent, "", 20 - indent, name, total > 0 ? slots / total * 100. : 0.);
+}
 
-    if (!MSRCounters.init(counterTypesDesired, std::size(counterTypesDesired)))
-        return 1;
+// Print the top-down analysis from topdown slots and PERF_METRICS in TopdownData.
+// The slots of the overhead loop are subtracted in proportion to the number of repetitions
+static void PrintTopdown()
+{
+    const STopdownData& t = TopdownData;
+    double scale = t.overheadRuns ? double(t.testRuns) / t.overheadRuns : 0;
+    double slots[TD_METRICS];
+    int levels = t.level2 ? TD_METRICS : TD_HEAVY_OPERATIONS;
+    double total = 0;
+    for (int k = 0; k < levels; k++)
+    {
+        slots[k] = t.test[k] - t.overhead[k] * scale;
+        if (slots[k] < 0)
+            slots[k] = 0;
+        if (k < TD_HEAVY_OPERATIONS)
+            total += slots[k];
+    }
+    int runs = t.testRuns * CounterData.innerRepeat();
 
-    int repetitions = TestLoop(MSRCounters); // Run the test code
+    printf("\n\nTop-down analysis from PERF_METRICS, %.1f slots per run of test code", runs ? total / runs : 0.);
+    // level 1 metric and the two parts of it in level 2
+    static const char* const names[4][3] = {{"Retiring", "Heavy operations", "Light operations"},
+        {"Bad speculation", "Branch mispredicts", "Machine clears"},
+        {"Frontend bound", "Fetch latency", "Fetch bandwidth"}, {"Backend bound", "Memory bound", "Core bound"}};
+    for (int k = 0; k < TD_HEAVY_OPERATIONS; k++)
+    {
+        PrintTopdownRow(names[k][0], slots[k], total, 0);
+        if (!t.level2)
+            continue;
+        double part = slots[k + TD_HEAVY_OPERATIONS] < slots[k] ? slots[k + TD_HEAVY_OPERATIONS] : slots[k];
+        PrintTopdownRow(names[k][1], part, total, 2);
+        PrintTopdownRow(names[k][2], slots[k] - part, total, 2);
+    }
+}
 
-    MSRCounters.deinit();
+// Print the metrics of the medians of the combined results of all passes. Each count is taken
+// from the first pass that has the counter
+static void PrintCombinedMetrics(const std::vector<SPassCount>& merged, double elements)
+{
+    if (Metrics.empty())
+        return;
+    // median per run of test code of the first pass with counter type, NaN if none
+    auto Median = [&merged](int type) {
+        for (const SPassCount& c : merged)
+        {
+            if (c.type == type)
+                return c.stat.median / c.inner;
+        }
+        return (double)NAN;
+    };
+    printf("\n\nMetrics of combined medians");
+    for (const SMetricColumn& m : Metrics)
+    {
+        const std::vector<int>& types = m.metric.counterTypes();
+        double counts[MAXCOUNTERS];
+        for (size_t k = 0; k < types.size(); k++)
+            counts[k] = Median(types[k]);
+        printf("\n%10s ", m.name.c_str());
+        PrintMetricValue(m.metric.evaluate(counts, Median(0), elements));
+    }
+}
 
-    // Print results
+// Print level 1 of the top-down analysis computed from the medians of topdownCounterTypes in the
+// combined results of all passes. Only valid when one thread runs in each core
+static void PrintTopdownFallback(CCounters& MSRCounters, const std::vector<SPassCount>& merged)
+{
+    double count[std::size(topdownCounterTypes)];
+    for (size_t i = 0; i < std::size(topdownCounterTypes); i++)
     {
-        // calculate offsets into CounterData
-        int ClockOS = ClockResultsOS / sizeof(int);
-        int PMCOS = PMCResultsOS / sizeof(int);
+        const char* name = MSRCounters.findCounterName(topdownCounterTypes[i]);
+        size_t j = 0;
+        while (j < merged.size() && !(name && strcmp(merged[j].name, name) == 0))
+            j++;
+        if (j == merged.size())
+        {
+            printf("\n\nTop-down analysis is not available on this processor");
+            return;
+        }
+        count[i] = merged[j].stat.median / merged[j].inner;
+    }
+    double slots = TOPDOWN_SLOTS_PER_CYCLE * count[0];
+    double frontend = count[1];
+    double badSpeculation = count[2] - count[3] + TOPDOWN_SLOTS_PER_CYCLE * count[4];
+    double retiring = count[3];
+    if (badSpeculation < 0)
+        badSpeculation = 0;
+    double backend = slots - frontend - badSpeculation - retiring;
+    if (backend < 0)
+        backend = 0;
 
-        // print column headings
-        printf("\n     Clock ");
-        if (MSRCounters.usePMC())
+    printf("\n\nTop-down analysis from general counters, %.1f slots per run of test code", slots);
+    PrintTopdownRow("Retiring", retiring, slots, 0);
+    PrintTopdownRow("Bad speculation", badSpeculation, slots, 0);
+    PrintTopdownRow("Frontend bound", frontend, slots, 0);
+    PrintTopdownRow("Backend bound", backend, slots, 0);
+}
+
+int main(int argc, char* argv[])
+{
+    CCounters MSRCounters;
+    ESerialize serialize = SERIALIZE_CPUID;
+    bool serializeReport = false;
+    int repetitions = REPETITIONS;
+    SRunOptions run;
+    bool printRaw = false;
+    const char* counterList = NULL;
+    const char* cpuList = NULL;
+    std::vector<const char*> rawEvents;
+    bool topdown = false;
+    const char* metricList = NULL;
+    std::vector<const char*> metricFormulas;
+#ifndef _WIN32
+    SLowNoiseOptions lowNoise;
+    bool lowNoiseMode = false;
+#endif
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-msr") == 0)
+            MSRCounters.setBackend(BACKEND_DRIVER);
+        else if (strcmp(argv[i], "-serialize") == 0 && i + 1 < argc)
         {
-            if (MSRCounters.MScheme == S_AMD2)
+            i++;
+            int m = 0;
+            while (m < SERIALIZE_METHODS && strcmp(argv[i], SerializeNames[m]) != 0)
+                m++;
+            if (m == SERIALIZE_METHODS)
             {
-                printf("%10s ", "Corrected");
+                printf("\nUnknown serialization method %s. Use one of:", argv[i]);
+                for (const char* name : SerializeNames)
+                    printf(" %s", name);
+                return 1;
             }
-            for (int i = 0; i < MSRCounters.countersCount(); i++)
+            serialize = ESerialize(m);
+        }
+        else if (strcmp(argv[i], "-checkcommands") == 0)
+        {
+            const char* err = CCounters::checkCommands();
+            printf("\nMSR command check: %s\n", err ? err : "OK");
+            return err ? 1 : 0;
+        }
+        else if (strcmp(argv[i], "-serializereport") == 0)
+            serializeReport = true;
+        else if (strcmp(argv[i], "-repetitions") == 0 && i + 1 < argc)
+            repetitions = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-overhead") == 0 && i + 1 < argc)
+            run.overheadRepetitions = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-outliers") == 0 && i + 1 < argc)
+            run.statistics.outlierMads = atof(argv[++i]);
+        else if (strcmp(argv[i], "-stat") == 0 && i + 1 < argc)
+        {
+            i++;
+            if (strcmp(argv[i], "min") == 0)
+                run.statistics.ciStatistic = STAT_MIN;
+            else if (strcmp(argv[i], "median") == 0)
+                run.statistics.ciStatistic = STAT_MEDIAN;
+            else
+            {
+                printf("\nUnknown statistic %s. Use one of: min median", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-adaptive") == 0 && i + 1 < argc)
+            run.targetWidth = atof(argv[++i]);
+        else if (strcmp(argv[i], "-budget") == 0 && i + 1 < argc)
+            run.timeBudget = atof(argv[++i]);
+        else if (strcmp(argv[i], "-inner") == 0 && i + 1 < argc)
+            run.innerRepeat = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-mincycles") == 0 && i + 1 < argc)
+            run.minCycles = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-warmup") == 0 && i + 1 < argc)
+            run.warmupTolerance = atof(argv[++i]);
+        else if (strcmp(argv[i], "-warmuptime") == 0 && i + 1 < argc)
+            run.warmupMaxTime = atof(argv[++i]);
+        else if (strcmp(argv[i], "-raw") == 0)
+            printRaw = true;
+        else if (strcmp(argv[i], "-events") == 0 && i + 1 < argc)
+        {
+            const char* err = CCounters::loadEvents(argv[++i]);
+            if (err)
+            {
+                printf("\n%s", err);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-counters") == 0 && i + 1 < argc)
+            counterList = argv[++i];
+        else if (strcmp(argv[i], "-event") == 0 && i + 1 < argc)
+            rawEvents.push_back(argv[++i]);
+        else if (strcmp(argv[i], "-cpus") == 0 && i + 1 < argc)
+            cpuList = argv[++i];
+        else if (strcmp(argv[i], "-tma") == 0)
+            topdown = true;
+        else if (strcmp(argv[i], "-metrics") == 0 && i + 1 < argc)
+            metricList = argv[++i];
+        else if (strcmp(argv[i], "-metric") == 0 && i + 1 < argc)
+            metricFormulas.push_back(argv[++i]);
+        else if (strcmp(argv[i], "-elements") == 0 && i + 1 < argc)
+            run.elements = atof(argv[++i]);
+        else if (strcmp(argv[i], "-bytes") == 0 && i + 1 < argc)
+            run.bytes = atof(argv[++i]);
+        else if (strcmp(argv[i], "-cache") == 0 && i + 1 < argc)
+        {
+            i++;
+            int m = 0;
+            while (m < CACHE_MODES && strcmp(argv[i], CacheModeNames[m]) != 0)
+                m++;
+            if (m == CACHE_MODES)
+            {
+                printf("\nUnknown cache mode %s. Use one of:", argv[i]);
+                for (const char* name : CacheModeNames)
+                    printf(" %s", name);
+                return 1;
+            }
+            run.cacheMode = ECacheMode(m);
+        }
+        else if (strcmp(argv[i], "-wbinvd") == 0)
+            run.wbinvd = true;
+        else if (strcmp(argv[i], "-noise") == 0)
+            run.noiseTag = run.noiseExclude = true;
+        else if (strcmp(argv[i], "-noisekeep") == 0)
+        {
+            run.noiseTag = true;
+            run.noiseExclude = false;
+        }
+#ifndef _WIN32
+        else if (strcmp(argv[i], "-lownoise") == 0)
+            lowNoiseMode = true;
+        else if (strcmp(argv[i], "-thp") == 0 && i + 1 < argc)
+        {
+            i++;
+            if (strcmp(argv[i], "on") == 0)
+                lowNoise.thp = THP_ON;
+            else if (strcmp(argv[i], "off") == 0)
+                lowNoise.thp = THP_OFF;
+            else if (strcmp(argv[i], "default") == 0)
+                lowNoise.thp = THP_DEFAULT;
+            else
+            {
+                printf("\nUnknown huge page mode %s. Use one of: on off default", argv[i]);
+                return 1;
+            }
+        }
+#else
+        else if (strcmp(argv[i], "-lownoise") == 0 || strcmp(argv[i], "-thp") == 0)
+            printf("\n%s is only for Linux. Windows uses the realtime priority class", argv[i]);
+#endif
+    }
+
+    if (repetitions <= 0 || run.overheadRepetitions <= 0 || run.innerRepeat <= 0)
+    {
+        printf("\nNumber of repetitions must be positive");
+        return 1;
+    }
+    if (run.wbinvd && run.cacheMode != CACHE_COLD_ALL)
+        printf("\nWarning: -wbinvd has no effect without -cache cold-all");
+
+    // other processors to set up the counters on, from -cpus
+    if (cpuList)
+    {
+        std::vector<int> cpus;
+        std::string list(cpuList);
+        size_t pos = 0;
+        while (pos <= list.size())
+        {
+            size_t end = list.find(',', pos);
+            if (end == std::string::npos)
+                end = list.size();
+            std::string item = list.substr(pos, end - pos);
+            pos = end + 1;
+            if (item.empty())
+                continue;
+            char* e;
+            long cpu = strtol(item.c_str(), &e, 10);
+            if (*e || cpu < 0)
             {
-                printf("%10s ", MSRCounters.counterName(i));
+                printf("\nInvalid processor number %s", item.c_str());
+                return 1;
             }
+            cpus.push_back((int)cpu);
         }
+        if (MSRCounters.getBackend() != BACKEND_DRIVER)
+            printf("\nWarning: -cpus needs the driver backend. The counters are set up on the test processor only");
+        MSRCounters.setCpuSet(cpus.data(), (int)cpus.size());
+    }
 
-        // print counter outputs
-        for (int repi = 0; repi < repetitions; repi++)
+    // counter types from -counters, or counterTypesDesired
+    std::vector<int> counterTypes(std::begin(counterTypesDesired), std::end(counterTypesDesired));
+    if (counterList)
+    {
+        counterTypes.clear();
+        std::string list(counterList);
+        size_t pos = 0;
+        while (pos <= list.size())
         {
-            int tscClock = PCounterData[repi + ClockOS];
-            printf("\n%10i ", tscClock);
-            if (MSRCounters.usePMC())
+            size_t end = list.find(',', pos);
+            if (end == std::string::npos)
+                end = list.size();
+            std::string item = list.substr(pos, end - pos);
+            pos = end + 1;
+            if (item.empty())
+                continue;
+            char* e;
+            int type = (int)strtol(item.c_str(), &e, 0);
+            if (*e)
+                type = MSRCounters.findCounterType(item.c_str());
+            if (type == 0)
             {
-                if (MSRCounters.MScheme == S_AMD2)
-                {
-                    printf("%10i ", int(tscClock * MSRCounters.getClockFactor() + 0.5)); // Calculated core clock count
-                }
-                for (int i = 0; i < MSRCounters.countersCount(); i++)
-                {
-                    printf("%10i ", PCounterData[repi + i * repetitions + PMCOS]);
-                }
+                printf("\nUnknown counter %s", item.c_str());
+                return 1;
             }
+            counterTypes.push_back(type);
         }
-        if (MSRCounters.MScheme == S_AMD2)
+    }
+    for (const char* spec : rawEvents)
+    {
+        int type = MSRCounters.findCounterType(spec);
+        if (type == 0)
         {
-            printf("\nClock factor %.4f", MSRCounters.getClockFactor());
+            printf("\nInvalid event %s", spec);
+            return 1;
         }
+        counterTypes.push_back(type);
     }
+    if (topdown)
+    {
+        // Use PERF_METRICS if available. The general counters for the fallback are only
+        // defined for processors without PERF_METRICS, so planPasses leaves them out otherwise
+        MSRCounters.setTopdown(true);
+        for (int type : topdownCounterTypes)
+        {
+            if (std::find(counterTypes.begin(), counterTypes.end(), type) == counterTypes.end())
+                counterTypes.push_back(type);
+        }
+    }
+
+    // metrics from -metrics, or metricTypesDesired, and -metric
+    std::vector<const SMetricDefinition*> metricDefs;
+    if (metricList)
+    {
+        std::string list(metricList);
+        size_t pos = 0;
+        while (pos <= list.size())
+        {
+            size_t end = list.find(',', pos);
+            if (end == std::string::npos)
+                end = list.size();
+            std::string item = list.substr(pos, end - pos);
+            pos = end + 1;
+            if (item.empty())
+                continue;
+            char* e;
+            int type = (int)strtol(item.c_str(), &e, 0);
+            const SMetricDefinition* def = *e ? MSRCounters.findMetric(item.c_str()) : MSRCounters.findMetric(type);
+            if (!def)
+            {
+                printf("\nUnknown metric %s", item.c_str());
+                return 1;
+            }
+            metricDefs.push_back(def);
+        }
+    }
+    else
+    {
+        // metrics that are not defined for this processor are left out
+        for (int type : metricTypesDesired)
+        {
+            if (const SMetricDefinition* def = MSRCounters.findMetric(type))
+                metricDefs.push_back(def);
+        }
+    }
+    for (const SMetricDefinition* def : metricDefs)
+    {
+        SMetricColumn m;
+        m.name = def->Description;
+        const char* err = m.metric.parse(def->Formula, MSRCounters);
+        if (err)
+        {
+            printf("\nMetric %s: %s", def->Description, err);
+            return 1;
+        }
+        Metrics.push_back(m);
+    }
+    for (const char* spec : metricFormulas)
+    {
+        // NAME=FORMULA. A formula without name is its own name
+        SMetricColumn m;
+        const char* formula = strchr(spec, '=');
+        const char* bracket = strchr(spec, '[');
+        if (formula && (!bracket || formula < bracket))
+            m.name.assign(spec, formula++ - spec);
+        else
+            m.name = formula = spec;
+        const char* err = m.metric.parse(formula, MSRCounters);
+        if (err)
+        {
+            printf("\nMetric %s: %s", spec, err);
+            return 1;
+        }
+        Metrics.push_back(m);
+    }
+    // add the counters that the metrics need
+    for (const SMetricColumn& m : Metrics)
+    {
+        for (int type : m.metric.counterTypes())
+        {
+            if (std::find(counterTypes.begin(), counterTypes.end(), type) == counterTypes.end())
+                counterTypes.push_back(type);
+        }
+    }
+
+    // with -noise, every pass counts interrupts
+    std::vector<int> anchors(std::begin(anchorCounterTypes), std::end(anchorCounterTypes));
+    if (run.noiseTag)
+    {
+        MSRCounters.setNoiseTagging(true);
+        anchors.insert(anchors.end(), std::begin(noiseCounterTypes), std::end(noiseCounterTypes));
+    }
+
+    std::vector<std::vector<int>> passes;
+    MSRCounters.planPasses(counterTypes.data(), (int)counterTypes.size(), anchors.data(), (int)anchors.size(),
+        passes);
+    if (passes.empty())
+        passes.push_back(std::vector<int>(1, 0)); // no counters available. Measure clock only
+
+#ifndef _WIN32
+    // huge pages for the test buffers, and map them before the test
+    CLowNoise::prepareBuffer(UserData, sizeof(UserData), lowNoise.thp);
+    if (!lowNoiseMode)
+    {
+        // -thp alone
+        lowNoise.fifoPriority = 0;
+        lowNoise.lockMemory = false;
+    }
+    lowNoise.enabled = lowNoiseMode || lowNoise.thp != THP_DEFAULT;
+    MSRCounters.setLowNoise(lowNoise);
+#endif
+
+    // cache state before each repetition. Allocated before the test
+    if (CacheControl.init(run.cacheMode))
+        return 1;
+    RegisterUserBuffers(CacheControl);
+    CacheData.cost.assign(repetitions, 0);
+
+    std::vector<SPassCount> merged;
+    for (int p = 0; p < (int)passes.size(); p++)
+    {
+        if (passes.size() > 1)
+            printf("\n\nPass %i of %i", p + 1, (int)passes.size());
+
+        if (!MSRCounters.init(passes[p].data(), (int)passes[p].size()))
+            return 1;
+
+        // Allocate result buffer before the test, so it doesn't page fault during the test
+        if (CounterData.init(repetitions, MSRCounters.usePMC() ? MSRCounters.countersCount() : 0,
+                MSRCounters.clockSource() != CLOCK_NONE))
+        {
+            MSRCounters.deinit();
+            return 1;
+        }
+
+#ifndef _WIN32
+        if (lowNoiseMode && p == 0)
+            CLowNoise::preflight(MSRCounters.getCpu());
+#endif
+
+        if (serializeReport && p == 0)
+            SerializeReportAll(MSRCounters);
+
+        FindMetricColumns(MSRCounters);
+
+        RunTestLoop(MSRCounters, serialize, run); // Run the test code
+
+        MSRCounters.deinit();
+
+        PrintResults(MSRCounters, run, printRaw);
+        if (TopdownData.valid)
+            PrintTopdown();
+
+        // save statistics for combined report
+        SStatistics stat[MAXCOUNTERS + 1];
+        int columns = ComputeAllStatistics(run, stat);
+        for (int i = 0; i < columns; i++)
+        {
+            SPassCount c;
+            c.name = i ? MSRCounters.counterName(i - 1) : "Clock";
+            c.type = i ? MSRCounters.counterType(i - 1) : 0;
+            c.pass = p;
+            c.inner = CounterData.innerRepeat();
+            c.stat = stat[i];
+            merged.push_back(c);
+        }
+    }
+
+    if (passes.size() > 1)
+    {
+        PrintCombined(merged, (int)passes.size(), run.statistics);
+        PrintCombinedMetrics(merged, run.elements);
+    }
+
+    if (topdown && !TopdownData.valid)
+        PrintTopdownFallback(MSRCounters, merged);
 
     printf("\n");
 
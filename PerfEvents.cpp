@@ -0,0 +1,103 @@
+#ifndef _WIN32
+#include "PerfEvents.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+static int PerfEventOpen(perf_event_attr* attr, int pid, int cpu, int group_fd, unsigned long flags)
+{
+    return (int)syscall(__NR_perf_event_open, attr, pid, cpu, group_fd, flags);
+}
+
+CPerfEvents::CPerfEvents()
+{
+    events.reserve(MAXPERFEVENTS);
+}
+
+CPerfEvents::~CPerfEvents()
+{
+    close();
+}
+
+int CPerfEvents::open(uint32_t type, uint64_t config, bool user, bool kernel)
+{
+    if (count() >= MAXPERFEVENTS)
+        return E2BIG;
+
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = events.empty(); // the group is started and stopped through the leader
+    attr.pinned = events.empty();   // never multiplex the group with other users of the PMU
+    attr.exclude_user = !user;
+    attr.exclude_kernel = !kernel;  // default is user level only, same as the MSR driver setup
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    // count the calling thread on any CPU
+    int leader = events.empty() ? -1 : events[0].fd;
+    int fd = PerfEventOpen(&attr, 0, -1, leader, 0);
+    if (fd < 0)
+        return errno;
+
+    SEvent e;
+    e.fd = fd;
+    e.page = NULL;
+    void* p = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fd, 0);
+    if (p != MAP_FAILED)
+        e.page = (perf_event_mmap_page*)p;
+    events.push_back(e);
+    return 0;
+}
+
+void CPerfEvents::close()
+{
+    // close members before leader
+    for (int i = count() - 1; i >= 0; i--)
+    {
+        if (events[i].page)
+            munmap(events[i].page, sysconf(_SC_PAGESIZE));
+        ::close(events[i].fd);
+    }
+    events.clear();
+}
+
+void CPerfEvents::enable()
+{
+    if (count())
+        ioctl(events[0].fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void CPerfEvents::disable()
+{
+    if (count())
+        ioctl(events[0].fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+}
+
+bool CPerfEvents::running() const
+{
+    if (!count())
+        return false;
+    // time enabled and time running follow the number of events
+    uint64_t buf[3 + MAXPERFEVENTS];
+    ssize_t len = ::read(events[0].fd, buf, sizeof(buf));
+    if (len < (ssize_t)(3 * sizeof(uint64_t)))
+        return false; // a pinned group in error state reads as end of file
+    return buf[1] > 0 && buf[2] == buf[1];
+}
+
+uint64_t CPerfEvents::readGroup(int i) const
+{
+    // layout: number of events, time enabled, time running, one value per event
+    uint64_t buf[3 + MAXPERFEVENTS];
+    ssize_t len = ::read(events[0].fd, buf, sizeof(buf));
+    if (len < (ssize_t)((i + 4) * sizeof(uint64_t)))
+        return 0;
+    return buf[3 + i];
+}
+#endif
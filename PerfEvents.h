@@ -0,0 +1,105 @@
+#pragma once
+#ifndef _WIN32
+#include <stdint.h>
+#include <vector>
+#include <linux/perf_event.h>
+
+// maximum number of events in one perf_event group
+const int MAXPERFEVENTS = 16;
+
+// read performance monitor counter number nPerfCtr, all 64 bits
+static inline uint64_t PerfReadpmc(unsigned int nPerfCtr)
+{
+    unsigned int lo, hi;
+    __asm__ __volatile__("rdpmc" : "=a"(lo), "=d"(hi) : "c"(nPerfCtr));
+    return (uint64_t)hi << 32 | lo;
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+//                         class CPerfEvents
+//
+// This class encapsulates the Linux perf_event_open interface.
+// All events are opened for the calling thread in one group, so they
+// are scheduled on the PMU together. Each event has its
+// perf_event_mmap_page mapped, which allows the counters to be read
+// with RDPMC in user mode without any system call. If the kernel does
+// not allow RDPMC, or the event is a software event, the group is read
+// with read() instead.
+//
+//////////////////////////////////////////////////////////////////////
+
+class CPerfEvents
+{
+public:
+    CPerfEvents();
+    ~CPerfEvents();
+
+    // open one event and add it to the group, counting in user mode and/or kernel mode.
+    // return 0 or errno
+    int open(uint32_t type, uint64_t config, bool user = true, bool kernel = false);
+    // close all events
+    void close();
+    // start counting all events in the group
+    void enable();
+    // stop counting all events in the group
+    void disable();
+    // true if the enabled group has been on the PMU all the time. A pinned group that
+    // cannot be scheduled with the other pinned groups goes into error state and counts nothing
+    bool running() const;
+
+    int count() const
+    {
+        return (int)events.size();
+    }
+
+    // true if event number i is read with RDPMC
+    bool usesRdpmc(int i) const
+    {
+        return events[i].page && events[i].page->cap_user_rdpmc;
+    }
+
+    // read event number i
+    uint64_t read(int i) const
+    {
+        const volatile perf_event_mmap_page* pc = events[i].page;
+        if (pc)
+        {
+            // seqlock protected self-monitoring read. See linux/perf_event.h
+            uint32_t seq, idx;
+            uint64_t count;
+            do
+            {
+                seq = pc->lock;
+                __asm__ __volatile__("" : : : "memory");
+                idx = pc->index;
+                count = pc->offset;
+                if (idx && pc->cap_user_rdpmc)
+                {
+                    // sign extend the hardware counter value from pmc_width bits
+                    unsigned int shift = 64 - pc->pmc_width;
+                    count += (uint64_t)((int64_t)(PerfReadpmc(idx - 1) << shift) >> shift);
+                }
+                __asm__ __volatile__("" : : : "memory");
+            } while (pc->lock != seq);
+            if (idx && pc->cap_user_rdpmc)
+                return count;
+        }
+        // event is not currently on a hardware counter, or RDPMC not permitted
+        return readGroup(i);
+    }
+
+private:
+    struct SEvent
+    {
+        int fd;                     // file descriptor from perf_event_open
+        perf_event_mmap_page* page; // mapped control page, or NULL
+    };
+    std::vector<SEvent> events; // events[0] is the group leader
+
+    uint64_t readGroup(int i) const; // read all events in group by read() and return event i
+
+    CPerfEvents& operator=(const CPerfEvents&) = delete;
+    CPerfEvents(const CPerfEvents&) = delete;
+};
+#endif
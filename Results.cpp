@@ -0,0 +1,61 @@
+#include "Results.h"
+#include <new>
+#include <stdio.h>
+#include <string.h>
+
+CResults::CResults()
+    : Data(NULL)
+    , Stride(0)
+    , Capacity(0)
+    , Repetitions(0)
+    , InnerRepeat(1)
+    , NumCounters(0)
+    , Clocks(false)
+{
+    memset(CountTemp, 0, sizeof(CountTemp));
+    memset(CountOverhead, 0, sizeof(CountOverhead));
+}
+
+CResults::~CResults()
+{
+    free();
+}
+
+int CResults::init(int repetitions, int counters, bool clocks)
+{
+    free();
+    if (repetitions <= 0 || counters < 0 || counters > MAXCOUNTERS)
+        return 1;
+
+    const size_t lineElements = CACHELINESIZE / sizeof(uint64_t);
+    size_t stride = ((size_t)repetitions + lineElements - 1) / lineElements * lineElements;
+    size_t size = stride * (counters + 2 + (clocks ? 2 : 0)) * sizeof(uint64_t);
+
+    Data = (uint64_t*)operator new[](size, std::align_val_t(CACHELINESIZE), std::nothrow);
+    if (!Data)
+    {
+        printf("\nCannot allocate %zu bytes for %i repetitions", size, repetitions);
+        return 1;
+    }
+
+    // write all pages now, so the operating system maps them before the test
+    memset(Data, 0, size);
+    Stride = stride;
+    Capacity = repetitions;
+    Repetitions = repetitions;
+    NumCounters = counters;
+    Clocks = clocks;
+    return 0;
+}
+
+void CResults::free()
+{
+    if (Data)
+        operator delete[](Data, std::align_val_t(CACHELINESIZE));
+    Data = NULL;
+    Stride = 0;
+    Capacity = 0;
+    Repetitions = 0;
+    NumCounters = 0;
+    Clocks = false;
+}
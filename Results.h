@@ -0,0 +1,136 @@
+#pragma once
+#include "CCounters.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Cache line size (for preventing threads using same cache lines)
+#define CACHELINESIZE 64
+
+//////////////////////////////////////////////////////////////////////
+//
+//                     class CResults
+//
+// Storage for the clock counts and PMC counts of all repetitions of a
+// test. The size is set at run time. The buffer is cache line aligned,
+// and it is allocated and written once before the test, so the test
+// never takes page faults on it.
+// Row 0 holds the clock counts, row 1 .. counters the PMC counts.
+// Optionally two more rows hold the core clock cycles and reference
+// cycles of each repetition, for finding the actual clock frequency.
+// The last row holds the noise tags of each repetition, bits of ENoiseTag.
+// Each row starts on a new cache line.
+// A test can stop before the buffer is full. repetitions() is then the
+// number of repetitions done, set by setRepetitions().
+// Each repetition may run the test code innerRepeat() times. The counts
+// are totals for all inner repeats.
+//
+//////////////////////////////////////////////////////////////////////
+
+// Events that disturbed a repetition
+enum ENoiseTag
+{
+    NOISE_INTERRUPT = 1, // hardware interrupt
+    NOISE_SMI = 2,       // system management interrupt
+    NOISE_MIGRATION = 4, // the thread moved to another processor
+    NOISE_THERMAL = 8    // thermal, PROCHOT or power limit throttling
+};
+
+class CResults
+{
+public:
+    CResults();
+    ~CResults();
+
+    // Allocate space for the counts of repetitions runs with counters counters, and
+    // core and reference clocks if clocks is true. Return 0 if success, 1 if out of memory
+    int init(int repetitions, int counters, bool clocks = false);
+
+    void free();
+
+    // maximum number of repetitions
+    int capacity() const
+    {
+        return Capacity;
+    }
+
+    // number of repetitions with valid counts
+    int repetitions() const
+    {
+        return Repetitions;
+    }
+
+    void setRepetitions(int repetitions)
+    {
+        if (repetitions >= 0 && repetitions <= Capacity)
+            Repetitions = repetitions;
+    }
+
+    // number of times the test code runs in each repetition
+    int innerRepeat() const
+    {
+        return InnerRepeat;
+    }
+
+    void setInnerRepeat(int inner)
+    {
+        InnerRepeat = inner > 0 ? inner : 1;
+    }
+
+    int countersCount() const
+    {
+        return NumCounters;
+    }
+
+    // clock counts of all repetitions
+    uint64_t* clock() const
+    {
+        return Data;
+    }
+
+    // counts of counter counterNum for all repetitions
+    uint64_t* pmc(int counterNum) const
+    {
+        return Data + (size_t)(counterNum + 1) * Stride;
+    }
+
+    // true if there are rows for core and reference clocks
+    bool hasClocks() const
+    {
+        return Clocks;
+    }
+
+    // core clock cycles of all repetitions. Only valid if hasClocks()
+    uint64_t* coreClock() const
+    {
+        return Data + (size_t)(NumCounters + 1) * Stride;
+    }
+
+    // reference cycles of all repetitions, at the rate of the time stamp counter. Only valid if hasClocks()
+    uint64_t* refClock() const
+    {
+        return Data + (size_t)(NumCounters + 2) * Stride;
+    }
+
+    // noise tags of all repetitions, bits of ENoiseTag. 0 if undisturbed
+    uint64_t* noise() const
+    {
+        return Data + (size_t)(NumCounters + 1 + (Clocks ? 2 : 0)) * Stride;
+    }
+
+    // temporary storage of clock counts and PMC counts, followed by core and reference clocks
+    // and processor migration
+    alignas(CACHELINESIZE) uint64_t CountTemp[MAXCOUNTERS + 4];
+    alignas(CACHELINESIZE) uint64_t CountOverhead[MAXCOUNTERS + 1]; // temporary storage of count overhead
+
+private:
+    uint64_t* Data;   // counts and noise tags, rows of Stride elements
+    size_t Stride;    // row length, multiple of cache line size
+    int Capacity;     // maximum number of repetitions
+    int Repetitions;  // number of repetitions with valid counts
+    int InnerRepeat;  // number of times the test code runs in each repetition
+    int NumCounters;  // number of PMC counters
+    bool Clocks;      // rows for core and reference clocks are allocated
+
+    CResults& operator=(const CResults&) = delete;
+    CResults(const CResults&) = delete;
+};
@@ -0,0 +1,137 @@
+#include "Statistics.h"
+#include <algorithm>
+#include <math.h>
+#include <random>
+#include <vector>
+
+// Value at fraction q (0..1) of sorted values v[0..n-1], nearest rank
+template <class T>
+static inline double Percentile(const T* v, int n, double q)
+{
+    int k = (int)ceil(q * n) - 1;
+    return (double)v[k < 0 ? 0 : k >= n ? n - 1 : k];
+}
+
+// Median of sorted values v[0..n-1]
+static inline double Median(const uint64_t* v, int n)
+{
+    return n & 1 ? (double)v[n / 2] : ((double)v[n / 2 - 1] + (double)v[n / 2]) * 0.5;
+}
+
+// Median absolute deviation from med of v[0..n-1]. dev is scratch space for n values
+static double MedianAbsoluteDeviation(const uint64_t* v, int n, double med, std::vector<double>& dev)
+{
+    dev.resize(n);
+    for (int i = 0; i < n; i++)
+        dev[i] = fabs((double)v[i] - med);
+    std::nth_element(dev.begin(), dev.begin() + n / 2, dev.end());
+    double m = dev[n / 2];
+    if (!(n & 1))
+    {
+        // even count: average with the largest value of the lower half
+        m = (m + *std::max_element(dev.begin(), dev.begin() + n / 2)) * 0.5;
+    }
+    return m;
+}
+
+// Draw from the Beta(a, b) distribution
+static inline double Beta(std::mt19937_64& rng, double a, double b)
+{
+    double x = std::gamma_distribution<double>(a, 1.0)(rng);
+    double y = std::gamma_distribution<double>(b, 1.0)(rng);
+    return x / (x + y);
+}
+
+// Bootstrap confidence interval of the k-th smallest value (1-based) of sorted values v[0..n-1]
+static void BootstrapRank(const uint64_t* v, int n, int k, const SStatisticsOptions& options, double& low, double& high)
+{
+    int samples = options.bootstrapSamples > 0 ? options.bootstrapSamples : 1;
+    std::vector<double> s(samples);
+    std::mt19937_64 rng(options.seed);
+    for (int i = 0; i < samples; i++)
+    {
+        int r = (int)(n * Beta(rng, k, n + 1 - k));
+        s[i] = (double)v[r < n ? r : n - 1];
+    }
+    std::sort(s.begin(), s.end());
+    double tail = (1. - options.confidence) * 0.5;
+    low = Percentile(s.data(), samples, tail);
+    high = Percentile(s.data(), samples, 1. - tail);
+}
+
+int ComputeStatistics(const uint64_t* values, int n, const SStatisticsOptions& options, SStatistics& result,
+    const uint64_t* exclude)
+{
+    result = SStatistics();
+    if (n <= 0)
+        return 1;
+
+    std::vector<uint64_t> sorted;
+    std::vector<double> dev;
+    try
+    {
+        sorted.reserve(n);
+        for (int i = 0; i < n; i++)
+        {
+            if (!exclude || !exclude[i])
+                sorted.push_back(values[i]);
+        }
+        if (sorted.empty())
+            sorted.assign(values, values + n); // all are tagged. Keep them all
+    }
+    catch (const std::bad_alloc&)
+    {
+        return 1;
+    }
+    result.excluded = n - (int)sorted.size();
+    n = (int)sorted.size();
+    std::sort(sorted.begin(), sorted.end());
+    const uint64_t* v = sorted.data();
+
+    double med = Median(v, n);
+    double mad = MedianAbsoluteDeviation(v, n, med, dev);
+
+    // Outlier rejection. The values kept are a contiguous range of the sorted values.
+    // Skipped if MAD is 0, because then every value different from the median would be rejected
+    if (options.outlierMads > 0 && mad > 0)
+    {
+        double limit = options.outlierMads * mad;
+        const uint64_t* first = std::lower_bound(v, v + n, (uint64_t)ceil(std::max(med - limit, 0.)));
+        const uint64_t* last = std::upper_bound(v, v + n, (uint64_t)floor(med + limit));
+        if (last > first)
+        {
+            result.rejected = n - int(last - first);
+            v = first;
+            n = int(last - first);
+            med = Median(v, n);
+            mad = MedianAbsoluteDeviation(v, n, med, dev);
+        }
+    }
+
+    result.count = n;
+    result.min = v[0];
+    result.max = v[n - 1];
+    result.median = med;
+    result.mad = mad;
+    result.p90 = Percentile(v, n, 0.90);
+    result.p99 = Percentile(v, n, 0.99);
+
+    // two-pass mean and standard deviation, for accuracy with large counts
+    double sum = 0;
+    for (int i = 0; i < n; i++)
+        sum += (double)v[i];
+    result.mean = sum / n;
+    double sum2 = 0;
+    for (int i = 0; i < n; i++)
+    {
+        double d = (double)v[i] - result.mean;
+        sum2 += d * d;
+    }
+    result.stddev = n > 1 ? sqrt(sum2 / (n - 1)) : 0;
+
+    // The median of an even count is the mean of two order statistics.
+    // The bootstrap uses the upper one
+    int k = options.ciStatistic == STAT_MIN ? 1 : n / 2 + 1;
+    BootstrapRank(v, n, k, options, result.ciLow, result.ciHigh);
+    return 0;
+}
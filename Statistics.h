@@ -0,0 +1,54 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+//////////////////////////////////////////////////////////////////////
+//
+// Statistics of the counts from the repetitions of a test.
+//
+// The values are sorted once. Percentiles are read from the sorted
+// values, and the confidence interval is found by bootstrap: the k-th
+// smallest of n values drawn with replacement from the sorted values
+// is the value at rank floor(n * B), where B has a Beta(k, n + 1 - k)
+// distribution. Each bootstrap sample therefore costs O(1) instead of
+// O(n), which keeps million-repetition runs cheap.
+//
+//////////////////////////////////////////////////////////////////////
+
+// Statistic that the confidence interval is computed for
+enum EStatistic
+{
+    STAT_MIN,
+    STAT_MEDIAN
+};
+
+struct SStatisticsOptions
+{
+    double outlierMads = 0;        // reject values more than outlierMads * MAD from the median. 0 = keep all
+    EStatistic ciStatistic = STAT_MEDIAN; // statistic for confidence interval
+    double confidence = 0.95;      // confidence level of interval
+    int bootstrapSamples = 2000;   // number of bootstrap samples
+    uint64_t seed = 1;             // random seed for bootstrap, for reproducible results
+};
+
+struct SStatistics
+{
+    int count = 0;       // number of values used, after outlier rejection
+    int rejected = 0;    // number of outliers rejected
+    int excluded = 0;    // number of values excluded because they are tagged as disturbed
+    uint64_t min = 0;    // smallest value
+    uint64_t max = 0;    // largest value
+    double median = 0;
+    double p90 = 0;      // 90th percentile
+    double p99 = 0;      // 99th percentile
+    double mean = 0;
+    double stddev = 0;   // sample standard deviation
+    double mad = 0;      // median absolute deviation from median, not scaled
+    double ciLow = 0;    // confidence interval of ciStatistic
+    double ciHigh = 0;
+};
+
+// Compute statistics of values[0..n-1]. Values where exclude[i] is not 0 are left out,
+// unless all values are tagged. Returns 0, or 1 if n <= 0 or out of memory
+int ComputeStatistics(const uint64_t* values, int n, const SStatisticsOptions& options, SStatistics& result,
+    const uint64_t* exclude = NULL);